@@ -24,7 +24,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), data_offset_(0), diff_offset_(0), count_(0),
+         capacity_(0), channel_block_(1) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -222,6 +223,7 @@ class Blob {
   const Dtype* gpu_data() const;
   void set_gpu_data(Dtype* data);
   const Dtype* cpu_diff() const;
+  void set_cpu_diff(Dtype* diff);
   const Dtype* gpu_diff() const;
   Dtype* mutable_cpu_data();
   Dtype* mutable_gpu_data();
@@ -229,7 +231,11 @@ class Blob {
   Dtype* mutable_gpu_diff();
   void Update();
   void FromProto(const BlobProto& proto, bool reshape = true);
-  void ToProto(BlobProto* proto, bool write_diff = false) const;
+  /// @brief Writes the blob; storage FLOAT16 or BFLOAT16 writes the data in
+  ///        16 bits to half_data, and CSR only its nonzeros, in compressed
+  ///        sparse rows over the first axis.
+  void ToProto(BlobProto* proto, bool write_diff = false,
+      StorageType storage = DTYPE) const;
 
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
   Dtype asum_data() const;
@@ -245,6 +251,27 @@ class Blob {
   /// @brief Scale the blob diff by a constant factor.
   void scale_diff(Dtype scale_factor);
 
+  /**
+   * @brief Declares the diff row-sparse: nonzero only in the rows (slices
+   *        along the first axis) passed to add_diff_row since the last
+   *        ClearDiff. On the CPU, ClearDiff, Update, sumsq_diff and scale_diff
+   *        then visit only those rows. Blobs sharing the diff share its rows.
+   */
+  void set_row_sparse_diff(bool row_sparse);
+  /// @brief Whether the diff is row-sparse, with its rows in diff_rows().
+  bool row_sparse_diff() const { return diff_rows_ && !diff_rows_->dense; }
+  /// @brief Whether the diff was declared row-sparse, dense for now or not.
+  bool has_diff_rows() const { return diff_rows_.get() != NULL; }
+  /// @brief The rows a row-sparse diff may be nonzero in, in no order.
+  const vector<int>& diff_rows() const { return diff_rows_->rows; }
+  /// @brief Marks a row of a row-sparse diff as nonzero.
+  void add_diff_row(int row);
+  /// @brief Makes a row-sparse diff dense until the next ClearDiff, for
+  ///        writers that do not report their rows.
+  void set_diff_dense();
+  /// @brief Zeroes the diff.
+  void ClearDiff();
+
   /**
    * @brief Set the data_ shared_ptr to point to the SyncedMemory holding the
    *        data_ of Blob other -- useful in Layer%s which simply perform a copy
@@ -254,6 +281,20 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareData(const Blob& other);
+
+  /**
+   * @brief The layout of the CPU data: 1 for the plain row-major layout, or b
+   *        for the blocked layout NCHWb of a 4D blob whose channels are a
+   *        multiple of b, in which each block of b channels is stored as a
+   *        N x (C / b) x H x W x b array.
+   *
+   * The shape stays (N, C, H, W) either way. Net sets this under
+   * NetParameter.cpu_layout; see Layer::SupportsChannelBlock.
+   */
+  inline int channel_block() const { return channel_block_; }
+  inline void set_channel_block(int channel_block) {
+    channel_block_ = channel_block;
+  }
   /**
    * @brief Set the diff_ shared_ptr to point to the SyncedMemory holding the
    *        diff_ of Blob other -- useful in Layer%s which simply perform a copy
@@ -264,15 +305,39 @@ class Blob {
    */
   void ShareDiff(const Blob& other);
 
+  /**
+   * @brief Makes the data and diff of this Blob the count() values of those
+   *        of Blob other from offset on, sharing its SyncedMemory -- useful
+   *        in Layer%s whose tops are contiguous parts of their bottom, such
+   *        as slices along the first axis.
+   *
+   * The capacity of a view is its count: reshaping it to as many values or
+   * fewer keeps it a view, to more gives it its own storage again.
+   */
+  void ShareView(const Blob& other, const int offset);
+
   bool ShapeEquals(const BlobProto& other);
 
  protected:
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
+  // Where the values of a view (see ShareView) start in data_ and diff_
+  int data_offset_;
+  int diff_offset_;
   shared_ptr<SyncedMemory> shape_data_;
   vector<int> shape_;
   int count_;
   int capacity_;
+  int channel_block_;
+  // The rows of a row-sparse diff (see set_row_sparse_diff): dense until
+  // the first ClearDiff, and after set_diff_dense.
+  struct DiffRows {
+    DiffRows() : dense(true) {}
+    bool dense;
+    vector<int> rows;
+    vector<bool> listed;
+  };
+  shared_ptr<DiffRows> diff_rows_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
@@ -38,7 +38,7 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param) {
+    : layer_param_(param), top_views_(true) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -163,6 +163,15 @@ class Layer {
    */
   const LayerParameter& layer_param() const { return layer_param_; }
 
+  /**
+   * @brief Returns the type that parameter i is stored in (see
+   *        ParamSpec.storage).
+   */
+  inline StorageType param_storage(int i) const {
+    return i < layer_param_.param_size() ?
+        layer_param_.param(i).storage() : DTYPE;
+  }
+
   /**
    * @brief Writes the layer parameter to a protocol buffer
    */
@@ -269,6 +278,44 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Returns whether Forward_cpu can take its bottoms in the blocked
+   *        layout of the given channel block (see Blob::channel_block), and
+   *        then produces its tops in that layout too.
+   *
+   * Under NetParameter.cpu_layout, the Net keeps chains of such layers in the
+   * blocked layout and reorders the bottoms of the others to the plain one.
+   */
+  virtual inline bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    return false;
+  }
+  /**
+   * @brief Returns whether the Net should reorder plain bottoms to the
+   *        blocked layout for this layer, starting a chain, rather than only
+   *        keep blocked ones blocked.
+   */
+  virtual inline bool StartsChannelBlock() const { return false; }
+
+  /**
+   * @brief Returns true if the layer's top blobs may share the data of its
+   *        bottom blob (see Blob::ShareData) rather than hold their own.
+   *
+   * This method should be overridden to return true by layers which make
+   * their tops views of their bottom. Net relies on it when planning
+   * activation memory, as a bottom must then stay alive as long as its tops.
+   */
+  virtual inline bool SharesBottomData() const { return false; }
+
+  /**
+   * @brief Sets whether the layer may make its tops views of its bottom
+   *        (see SharesBottomData), or must copy it instead.
+   *
+   * Views are allowed by default. Net forbids them before the layer is set
+   * up when a layer would change them, and so the bottom, in place.
+   */
+  inline void set_top_views(bool top_views) { top_views_ = top_views; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -299,8 +346,22 @@ class Layer {
   Phase phase_;
   /** The vector that stores the learnable parameters as a set of blobs. */
   vector<shared_ptr<Blob<Dtype> > > blobs_;
+  /** @brief Whether the blobs are 4D with channels a multiple of the block. */
+  static bool CanBlockChannels(const vector<Blob<Dtype>*>& blobs,
+      const int channel_block) {
+    for (int i = 0; i < blobs.size(); ++i) {
+      if (blobs[i]->num_axes() != 4 ||
+          blobs[i]->shape(1) % channel_block != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   /** Vector indicating whether to compute the diff of each param blob. */
   vector<bool> param_propagate_down_;
+  /** Whether the tops may be views of the bottom (see set_top_views). */
+  bool top_views_;
 
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
@@ -468,7 +529,7 @@ void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff) {
   param->CopyFrom(layer_param_);
   param->clear_blobs();
   for (int i = 0; i < blobs_.size(); ++i) {
-    blobs_[i]->ToProto(param->add_blobs(), write_diff);
+    blobs_[i]->ToProto(param->add_blobs(), write_diff, param_storage(i));
   }
 }
 
@@ -30,16 +30,27 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input.
+  // The task argument of the cpu gemm helpers selects the col_buffer, so that
+  // the tasks of reshape_col_buffers(num_tasks) can run concurrently.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, int task = 0);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, int task = 0);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, int task = 0);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  /// @brief Provides a col_buffer to each of num_tasks tasks.
+  void reshape_col_buffers(int num_tasks);
+  // Variants of forward_cpu_gemm and weight_cpu_gemm for the batch images
+  // starting at input and output, which lay out the columns of all of them
+  // side by side for one GEMM per group. See gemm_batch_.
+  void forward_cpu_gemm_batch(const Dtype* input, int batch,
+      const Dtype* weights, Dtype* output);
+  void weight_cpu_gemm_batch(const Dtype* input, int batch,
+      const Dtype* output, Dtype* weights);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,8 +103,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief The number of images whose CPU GEMMs are batched together, within
+  ///        the budget of ConvolutionParameter.batched_col_buffer_bytes.
+  int gemm_batch_;
 
  private:
+  inline Dtype* task_col_buffer(int task) {
+    return task == 0 ? col_buffer_.mutable_cpu_data() :
+        task_col_buffers_[task - 1]->mutable_cpu_data();
+  }
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -166,7 +184,12 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int output_offset_;
 
   Blob<Dtype> col_buffer_;
+  // The col_buffers of the tasks but the first.
+  vector<shared_ptr<Blob<Dtype> > > task_col_buffers_;
   Blob<Dtype> bias_multiplier_;
+  // The columns and outputs of gemm_batch_ images, side by side.
+  Blob<Dtype> batch_col_buffer_;
+  Blob<Dtype> batch_output_buffer_;
 };
 
 }  // namespace caffe
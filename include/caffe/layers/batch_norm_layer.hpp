@@ -49,25 +49,42 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Normalizing with the stored statistics is a per-channel affine map,
+  // which is applied to blocked bottoms directly.
+  virtual inline bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    return use_global_stats_ && this->CanBlockChannels(bottom, channel_block);
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  void Forward_blocked_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void reshape_gpu_buffers(const Blob<Dtype>& bottom);
+  void forward_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* x_norm_data, Dtype* mean, Dtype* variance, Dtype* inv_std,
+      int num_tasks, int task);
+  void backward_cpu_task(const Dtype* top_diff, const Dtype* x_norm_data,
+      const Dtype* inv_std, Dtype* bottom_diff, int num_tasks, int task);
 
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
+  // 1 / sqrt(var + eps) of each channel, for the CPU path.
+  Blob<Dtype> inv_std_;
+  int num_, spatial_dim_;
   bool use_global_stats_;
   Dtype moving_average_fraction_;
   int channels_;
   Dtype eps_;
 
   // extra temporarary variables is used to carry out sums/broadcasting
-  // using BLAS
+  // using BLAS on the GPU
   Blob<Dtype> batch_sum_multiplier_;
   Blob<Dtype> num_by_chans_;
   Blob<Dtype> spatial_sum_multiplier_;
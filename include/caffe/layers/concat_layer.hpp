@@ -24,8 +24,23 @@ class ConcatLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Concat"; }
+  // Along the channels, the blocked images are concatenated like plain ones.
+  virtual inline bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    return concat_axis_ == 1 && this->CanBlockChannels(bottom, channel_block);
+  }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool SharesBottomData() const {
+    return this->layer_param_.bottom_size() == 1;
+  }
+  /**
+   * @brief The number of pieces of each bottom in the top: 1 if the bottoms
+   *        are contiguous in it, one after the other. Bottoms that are then
+   *        views of their place in the top (see
+   *        NetParameter.zero_copy_concat) are not copied.
+   */
+  inline int num_concats() const { return num_concats_; }
 
  protected:
   /**
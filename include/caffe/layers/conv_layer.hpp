@@ -8,6 +8,8 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
 
 namespace caffe {
 
@@ -60,11 +62,38 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
+   *
+   *  With a calibrated quantization_param.input_scale, 2D convolutions run
+   *  in int8 in the TEST phase on the CPU, and 1x1 convolutions with pruned
+   *  filters, at most convolution_param.max_sparse_density of them nonzero,
+   *  multiply them as a sparse matrix. Depthwise 2D convolutions, with group,
+   *  channels and num_output all equal, convolve each channel directly on
+   *  the CPU, without im2col.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), fused_relu_(false),
+        fused_negative_slope_(0), blocked_block_(0) {}
 
   virtual inline const char* type() const { return "Convolution"; }
+  /// 2D convolutions without groups or dilation run directly on blocked
+  /// bottoms, with the filters reordered to [OC/b][IC][KH][KW][b].
+  virtual bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const;
+  virtual inline bool StartsChannelBlock() const { return true; }
+
+  /**
+   * @brief Folds the BatchNorm layer batch_norm, and the Scale layer scale
+   *        unless NULL, which run in place on the output of this layer, into
+   *        the filters and bias of the CPU forward pass, which then also
+   *        applies ReLU with negative_slope if relu (see
+   *        NetParameter.fuse_batch_norm).
+   *
+   * The folded parameters are rebuilt when any of the parameters they come
+   * from change. The parameters themselves are left alone, so the net still
+   * saves them unfused, and the GPU forward pass does not fuse.
+   */
+  void FuseBatchNorm(const shared_ptr<Layer<Dtype> >& batch_norm,
+      const shared_ptr<Layer<Dtype> >& scale, bool relu, Dtype negative_slope);
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -77,6 +106,89 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // The filters and bias (NULL without one) of the CPU forward pass: the
+  // parameters of the layer, or their folding with a fused BatchNorm, which
+  // update_fused_params rebuilds before the forward tasks read them.
+  const Blob<Dtype>& forward_weights() const {
+    return fused_batch_norm_ ? fused_weights_ : *this->blobs_[0];
+  }
+  const Dtype* forward_bias() const;
+  void update_fused_params();
+  // Adds the fused bias to the plain output of one image and applies the
+  // fused ReLU, in one pass over each channel.
+  void forward_cpu_fused(Dtype* output) const;
+  // Applies the fused ReLU, if any, to count outputs.
+  void forward_cpu_relu(Dtype* data, int count) const;
+  shared_ptr<Layer<Dtype> > fused_batch_norm_;
+  shared_ptr<Layer<Dtype> > fused_scale_;
+  bool fused_relu_;
+  Dtype fused_negative_slope_;
+  Blob<Dtype> fused_weights_;
+  Blob<Dtype> fused_bias_;
+  // The parameters the folded ones come from, and their versions.
+  vector<shared_ptr<SyncedMemory> > fused_sources_;
+  vector<size_t> fused_versions_;
+
+  // Forward_cpu and Backward_cpu split the images of a batch into one block
+  // per thread of the ThreadPool; these run the block of one task. If sparse,
+  // the images go through the CSR filters of sparse_weights_.
+  void forward_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      bool sparse, int num_tasks, int task);
+  // A NULL bottom_diff or weight_diff skips that gradient; the tasks but the
+  // first write their weight gradient to task_weight_diffs.
+  void backward_cpu_task(const Dtype* top_diff, const Dtype* bottom_data,
+      Dtype* bottom_diff, Dtype* weight_diff, Dtype* task_weight_diffs,
+      int num_tasks, int task);
+
+  // The weight gradients of the tasks but the first, which are added to the
+  // weight diff in task order once all are done.
+  Blob<Dtype> task_weight_diffs_;
+
+  // Convolves blocked bottoms into blocked tops; the tasks split the
+  // (image, output block) pairs.
+  void forward_blocked_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_blocked_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      int num_tasks, int task);
+  /// Returns the filters reordered for the given channel block, which are
+  /// kept until the filters change.
+  const Dtype* blocked_filters(int channel_block);
+  Blob<Dtype> blocked_filters_;
+  shared_ptr<SyncedMemory> blocked_source_;
+  size_t blocked_version_;
+  int blocked_block_;
+
+  // Depthwise convolutions: the forward tasks split the (image, channel)
+  // planes, the backward ones the channels, so that each task owns the
+  // gradient of its filters. A NULL bottom_diff or weight_diff skips that
+  // gradient.
+  bool depthwise() const;
+  void forward_depthwise_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_depthwise_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      int num_tasks, int task);
+  void backward_depthwise_cpu_task(const Dtype* top_diff,
+      const Dtype* bottom_data, Dtype* bottom_diff, Dtype* weight_diff,
+      int num_tasks, int task);
+
+  // Whether the filters, if pruned, may be multiplied as a sparse matrix:
+  // in 1x1 convolutions without groups in the TEST phase.
+  bool sparse_inference() const;
+  SparseWeights<Dtype> sparse_weights_;
+
+  // int8 inference (see QuantizationParameter): the tasks split the images,
+  // which are quantized, unrolled by im2row_s8 and multiplied with the
+  // quantized filters; the int32 sums are scaled back with the bias added.
+  bool int8_inference() const;
+  void forward_int8_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_int8_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      int8_t* buffer, int* sums, int num_tasks, int task);
+  QuantizedWeights<Dtype> quantized_weights_;
+  // The quantized image and its rows, then the sums, of each task.
+  shared_ptr<SyncedMemory> int8_buffer_;
+  Blob<int> int8_sums_;
 };
 
 }  // namespace caffe
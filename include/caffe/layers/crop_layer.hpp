@@ -21,7 +21,7 @@ template <typename Dtype>
 class CropLayer : public Layer<Dtype> {
  public:
   explicit CropLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), view_offset_(-1) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -30,6 +30,8 @@ class CropLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Crop"; }
   virtual inline int ExactNumBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // A crop that is contiguous in the bottom is a view of it unless forbidden.
+  virtual inline bool SharesBottomData() const { return view_offset_ >= 0; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -44,6 +46,8 @@ class CropLayer : public Layer<Dtype> {
   Blob<int> offsets;
   Blob<int> src_strides_;
   Blob<int> dest_strides_;
+  // Where the top starts in the bottom if it is a view of it, or -1
+  int view_offset_;
 
  private:
   // Recursive copy function.
@@ -26,6 +26,11 @@ class EltwiseLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Eltwise"; }
+  // Elementwise, so indifferent to the layout.
+  virtual inline bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    return this->CanBlockChannels(bottom, channel_block);
+  }
   virtual inline int MinBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
@@ -0,0 +1,97 @@
+#ifndef CAFFE_FUSED_LSTM_LAYER_HPP_
+#define CAFFE_FUSED_LSTM_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/recurrent_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief CPU implementation of LSTMLayer which runs the recurrence directly
+ *        instead of through an unrolled net.
+ *
+ * The input projections W_xc * x_t + b_c of all the timesteps are computed by
+ * a single GEMM. The recurrence then runs one GEMM W_hc * h_{t-1} per
+ * timestep, followed by one pass over the gates computing c_t and h_t. The
+ * backward pass mirrors it: one pass over the gates and one GEMM per
+ * timestep, from the last timestep to the first, then single GEMMs for the
+ * gradients w.r.t. the input and the weights.
+ *
+ * The inputs, outputs and parameter blobs are those of LSTMLayer -- W_xc,
+ * b_c, W_xc_static (with a static input) and W_hc, in this order -- so the
+ * two are interchangeable, weights included. Like LSTMLayer, this layer does
+ * not backpropagate through the initial and final hidden states; unlike it,
+ * it takes any number of timesteps after setup.
+ */
+template <typename Dtype>
+class FusedLSTMLayer : public Layer<Dtype>, public RecurrentStreams<Dtype> {
+ public:
+  explicit FusedLSTMLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Zeroes the hidden state carried over to the next forward pass.
+  virtual void Reset();
+
+  /// @brief See RecurrentStreams; for any number of timesteps.
+  virtual void ForwardStreams(const vector<int>& streams,
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "LSTM"; }
+  virtual inline int MinBottomBlobs() const {
+    return this->layer_param_.recurrent_param().expose_hidden() ? 4 : 2;
+  }
+  virtual inline int MaxBottomBlobs() const { return MinBottomBlobs() + 1; }
+  virtual inline int ExactNumTopBlobs() const {
+    return this->layer_param_.recurrent_param().expose_hidden() ? 3 : 1;
+  }
+
+  virtual inline bool AllowForceBackward(const int bottom_index) const {
+    // Can't propagate to sequence continuation indicators.
+    return bottom_index != 1;
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// @brief The number of timesteps, of independent streams, and of inputs.
+  int T_, N_, input_dim_;
+  /// @brief The hidden and output dimension.
+  int hidden_dim_;
+  bool static_input_;
+  bool expose_hidden_;
+
+  /// The gates (i, f, o, g) after their nonlinearities, (T x N x 4H); their
+  /// diffs hold the gradients w.r.t. the gate inputs.
+  Blob<Dtype> gates_;
+  /// The cell states c_t, (T x N x H).
+  Blob<Dtype> cell_;
+  /// cont_t * h_{t-1}, the input of W_hc at timestep t, (T x N x H).
+  Blob<Dtype> hidden_conted_;
+  /// W_xc_static * x_static, (N x 4H), and the sum of its gradients.
+  Blob<Dtype> static_gates_;
+  /// The hidden and cell states before the first timestep, and after the
+  /// last one, kept for the next forward pass without expose_hidden.
+  Blob<Dtype> h_0_, c_0_, h_T_, c_T_;
+  /// The gradients w.r.t. h_{t-1} and c_{t-1} during the backward pass.
+  Blob<Dtype> h_prev_diff_, c_prev_diff_;
+  Blob<Dtype> bias_multiplier_;
+
+  /// The continuation indicators, and h_0, c_0, h_T and c_T, of the streams
+  /// in ForwardStreams.
+  Blob<Dtype> stream_cont_;
+  Blob<Dtype> stream_states_[4];
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_FUSED_LSTM_LAYER_HPP_
@@ -6,6 +6,9 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/packed_gemm.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
 
 namespace caffe {
 
@@ -13,13 +16,22 @@ namespace caffe {
  * @brief Also known as a "fully-connected" layer, computes an inner product
  *        with a set of learned weights, and (optionally) adds biases.
  *
+ * With a calibrated quantization_param.input_scale, the layer runs in int8 in
+ * the TEST phase on the CPU. Weights stored as FLOAT16 or BFLOAT16 (see
+ * ParamSpec.storage) are read in 16 bits in the TEST phase on the CPU.
+ * Pruned weights, with at most inner_product_param.max_sparse_density of them
+ * nonzero, are multiplied as a sparse matrix in the TEST phase on the CPU.
+ * Otherwise the TEST phase on the CPU multiplies single inputs, or any batch
+ * with MKL, with weights packed once for the GEMM (see PackedWeights) rather
+ * than at every pass.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
 class InnerProductLayer : public Layer<Dtype> {
  public:
   explicit InnerProductLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), half_version_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -45,6 +57,45 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+
+  // int8 inference (see QuantizationParameter): the tasks split the outputs,
+  // and multiply the quantized bottom with the quantized weights of theirs.
+  void forward_int8_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_int8_cpu_task(const int8_t* bottom_data, int* sums,
+      int num_tasks, int task);
+  QuantizedWeights<Dtype> quantized_weights_;
+  shared_ptr<SyncedMemory> int8_buffer_;
+  Blob<int> int8_sums_;
+
+  // Sparse weights in the TEST phase: the tasks split the outputs, and
+  // multiply the bottom with the CSR rows of the weights of theirs.
+  void forward_sparse_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_sparse_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      int num_tasks, int task);
+  SparseWeights<Dtype> sparse_weights_;
+
+  // Weights stored in 16 bits (see ParamSpec.storage) in the TEST phase: the
+  // forward pass reads a 16-bit copy, kept until the weights change, and
+  // widens it block by block right before the GEMM of each block. Unless
+  // another blob shares them, e.g. that of a training net, the Dtype weights
+  // are then freed, to be widened back from the copy if read.
+  void forward_half_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  shared_ptr<SyncedMemory> half_weights_;
+  shared_ptr<SyncedMemory> half_source_;
+  size_t half_version_;
+  Blob<Dtype> half_block_;
+  Blob<Dtype> half_output_;
+
+  // Batches PackedWeights suits in the TEST phase: the tasks split the panels
+  // of the packed weights.
+  void forward_packed_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void forward_packed_cpu_task(const Dtype* bottom_data, Dtype* top_data,
+      int num_tasks, int task);
+  PackedWeights<Dtype> packed_weights_;
 };
 
 }  // namespace caffe
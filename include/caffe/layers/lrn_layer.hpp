@@ -47,6 +47,10 @@ class LRNLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelForward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Normalizes the tiles of one task of the ThreadPool, keeping a running
+  // sum of the squares as the window slides across the channels.
+  void cross_channel_forward_cpu_task(const Dtype* bottom_data,
+      Dtype* top_data, Dtype* scale_data, int num_tasks, int task);
   virtual void WithinChannelForward(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
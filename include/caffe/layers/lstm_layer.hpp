@@ -35,6 +35,9 @@ template <typename Dtype> class RecurrentLayer;
  * Notably, this implementation lacks the "diagonal" gates, as used in the
  * LSTM architectures described by Alex Graves [3] and others.
  *
+ * In CPU mode, the LSTM layers of a net are FusedLSTMLayer's unless the
+ * UNROLLED engine is requested (see RecurrentParameter.engine).
+ *
  * [1] Hochreiter, Sepp, and Schmidhuber, Jürgen. "Long short-term memory."
  *     Neural Computation 9, no. 8 (1997): 1735-1780.
  *
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/elementwise.hpp"
 
 namespace caffe {
 
@@ -25,6 +26,26 @@ class NeuronLayer : public Layer<Dtype> {
 
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  /**
+   * @brief Computes top = op(bottom) on the CPU with caffe_cpu_elementwise;
+   *        see elementwise.hpp for what an op is.
+   */
+  template <typename Op>
+  void ForwardElementwise_cpu(const Op& op, const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    caffe_cpu_elementwise(bottom[0]->count(), op, bottom[0]->cpu_data(),
+        top[0]->mutable_cpu_data());
+  }
+  /// @brief Computes bottom_diff = op.backward(bottom, top, top_diff).
+  template <typename Op>
+  void BackwardElementwise_cpu(const Op& op, const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) {
+    caffe_cpu_elementwise_backward(bottom[0]->count(), op,
+        bottom[0]->cpu_data(), top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->mutable_cpu_diff());
+  }
 };
 
 }  // namespace caffe
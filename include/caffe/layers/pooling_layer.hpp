@@ -18,7 +18,7 @@ template <typename Dtype>
 class PoolingLayer : public Layer<Dtype> {
  public:
   explicit PoolingLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), mask_skipped_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -33,10 +33,25 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  // MAX and AVE pooling run on blocked bottoms, without recording the mask.
+  virtual inline bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    const PoolingParameter_PoolMethod pool =
+        this->layer_param_.pooling_param().pool();
+    return top.size() == 1 && this->CanBlockChannels(bottom, channel_block) &&
+        (pool == PoolingParameter_PoolMethod_MAX ||
+         pool == PoolingParameter_PoolMethod_AVE);
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Pools the channels of one task of the ThreadPool; NULL outputs are
+  // skipped.
+  void forward_cpu_task(const Dtype* bottom_data, Dtype* top_data, int* mask,
+      Dtype* top_mask, int num_tasks, int task);
+  void Forward_blocked_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
@@ -47,6 +62,7 @@ class PoolingLayer : public Layer<Dtype> {
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
+  int num_;
   int channels_;
   int height_, width_;
   int pooled_height_, pooled_width_;
@@ -54,6 +70,8 @@ class PoolingLayer : public Layer<Dtype> {
   PoolingParameter_RoundMode round_mode_;
   Blob<Dtype> rand_idx_;
   Blob<int> max_idx_;
+  /// Whether the last Forward_cpu left max_idx_ unset, as it does in TEST.
+  bool mask_skipped_;
 };
 
 }  // namespace caffe
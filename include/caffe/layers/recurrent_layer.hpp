@@ -16,6 +16,87 @@ namespace caffe {
 
 template <typename Dtype> class RecurrentLayer;
 
+/**
+ * @brief The hidden states of independent streams run a few timesteps at a
+ *        time through a recurrent layer -- see RecurrentStreams.
+ *
+ * Streams are identified by handles, which Open hands out and Close takes
+ * back. Each stream keeps its states between calls and the number of
+ * timesteps it has run, which decides its continuation indicators.
+ */
+template <typename Dtype>
+class RecurrentStreamStates {
+ public:
+  RecurrentStreamStates() {}
+
+  /// @brief Starts a stream at the beginning of a sequence; returns its handle.
+  int Open();
+  /// @brief Frees the states of a stream; Open may reuse its handle.
+  void Close(const int stream);
+  /// @brief The number of timesteps the stream has run.
+  int position(const int stream) const;
+
+  /**
+   * @brief Copies the states of the given streams into states, of shapes
+   *        @f$ (1 \times S \times ...) @f$ for @f$ S @f$ streams (zero for
+   *        streams that have not run yet), and sets cont to the continuation
+   *        indicators @f$ (T \times S) @f$ of their next num_timesteps.
+   */
+  void Load(const vector<int>& streams, const int num_timesteps,
+      const vector<Blob<Dtype>*>& states, Blob<Dtype>* cont) const;
+  /// @brief Keeps the states of the given streams after num_timesteps more.
+  void Store(const vector<int>& streams, const int num_timesteps,
+      const vector<Blob<Dtype>*>& states);
+
+ protected:
+  void CheckOpen(const int stream) const;
+
+  /// The states of each stream, one after the other.
+  vector<vector<Dtype> > states_;
+  /// The positions of the streams, -1 for closed handles.
+  vector<int> positions_;
+  vector<int> free_streams_;
+
+  DISABLE_COPY_AND_ASSIGN(RecurrentStreamStates);
+};
+
+/**
+ * @brief The interface of the recurrent layers which run independent streams
+ *        a few timesteps at a time, keeping their hidden states between
+ *        calls: RecurrentLayer and FusedLSTMLayer.
+ */
+template <typename Dtype>
+class RecurrentStreams {
+ public:
+  virtual ~RecurrentStreams() {}
+
+  /// @brief Starts a stream for ForwardStreams; returns its handle.
+  int OpenStream() { return streams_.Open(); }
+  /// @brief Ends a stream started by OpenStream.
+  void CloseStream(const int stream) { streams_.Close(stream); }
+  /**
+   * @brief Runs the next @f$ T @f$ timesteps of @f$ S @f$ independent
+   *        streams, each at its own position, and keeps their hidden states
+   *        for the next call. It does not use the hidden state Forward
+   *        carries from one batch to the next, but overwrites it: call Reset
+   *        before going back to Forward.
+   *
+   * @param streams the handles of the streams, from OpenStream
+   * @param bottom the time-varying input @f$ (T \times S \times ...) @f$
+   *        and, if the layer has one, the static input
+   *        @f$ (S \times ...) @f$. The sequence continuation indicators
+   *        follow from the positions of the streams.
+   * @param top the time-varying output @f$ (T \times S \times D) @f$
+   */
+  virtual void ForwardStreams(const vector<int>& streams,
+      const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) = 0;
+
+ protected:
+  /// @brief The states of the streams run by ForwardStreams.
+  RecurrentStreamStates<Dtype> streams_;
+};
+
 /**
  * @brief An abstract class for implementing recurrent behavior inside of an
  *        unrolled network.  This Layer type cannot be instantiated -- instead,
@@ -23,7 +104,7 @@ template <typename Dtype> class RecurrentLayer;
  *        architecture, such as RNNLayer or LSTMLayer.
  */
 template <typename Dtype>
-class RecurrentLayer : public Layer<Dtype> {
+class RecurrentLayer : public Layer<Dtype>, public RecurrentStreams<Dtype> {
  public:
   explicit RecurrentLayer(const LayerParameter& param)
       : Layer<Dtype>(param) {}
@@ -33,6 +114,11 @@ class RecurrentLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Reset();
 
+  /// @brief See RecurrentStreams; @f$ T @f$ is the number of timesteps the
+  ///        layer was set up with.
+  virtual void ForwardStreams(const vector<int>& streams,
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
   virtual inline const char* type() const { return "Recurrent"; }
   virtual inline int MinBottomBlobs() const {
     int min_bottoms = 2;
@@ -180,6 +266,11 @@ class RecurrentLayer : public Layer<Dtype> {
   Blob<Dtype>* x_input_blob_;
   Blob<Dtype>* x_static_input_blob_;
   Blob<Dtype>* cont_input_blob_;
+
+  /// The continuation indicators, and the recurrent inputs and outputs, of
+  /// the streams in ForwardStreams.
+  Blob<Dtype> stream_cont_;
+  vector<shared_ptr<Blob<Dtype> > > stream_states_;
 };
 
 }  // namespace caffe
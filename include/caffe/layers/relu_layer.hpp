@@ -28,6 +28,11 @@ class ReLULayer : public NeuronLayer<Dtype> {
       : NeuronLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "ReLU"; }
+  // Elementwise, so indifferent to the layout.
+  virtual inline bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    return this->CanBlockChannels(bottom, channel_block);
+  }
 
  protected:
   /**
@@ -19,7 +19,7 @@ template <typename Dtype>
 class SliceLayer : public Layer<Dtype> {
  public:
   explicit SliceLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), num_slices_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -28,6 +28,12 @@ class SliceLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Slice"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
+  // A single top, or the slices of single items along an axis, which are
+  // contiguous in the bottom, are views of it unless forbidden.
+  virtual inline bool SharesBottomData() const {
+    return this->layer_param_.top_size() == 1 ||
+        (num_slices_ == 1 && this->top_views_);
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
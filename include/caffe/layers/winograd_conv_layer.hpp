@@ -0,0 +1,104 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd implementation of ConvolutionLayer for 3x3 filters with
+ *        stride 1 on the CPU. Fallback to ConvolutionLayer for GPU mode and
+ *        for other shapes.
+ *
+ * Winograd's minimal filtering algorithm F(m x m, 3 x 3) computes each m x m
+ * tile of the output from an (m + 2) x (m + 2) tile of the input with
+ * (m + 2)^2 instead of 9 m^2 multiplications per pair of channels. These are
+ * batched into (m + 2)^2 GEMMs over the channels, of the transformed filters
+ * by the transformed input tiles. F(4x4, 3x3) is used for outputs of at least
+ * 8 x 8, F(2x2, 3x3) for smaller ones.
+ *
+ * The gradient w.r.t. the bottom is the convolution of the top diff with the
+ * flipped filters and goes through the same algorithm; the gradient w.r.t.
+ * the filters goes through im2col as in ConvolutionLayer. The transformed
+ * filters are kept until the filters change, so repeated forward passes at
+ * test time transform them only once. The images of a batch are split over
+ * the threads of the ThreadPool, as in ConvolutionLayer.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// Winograd convolutions keep to the plain layout.
+  virtual bool SupportsChannelBlock(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const int channel_block) const {
+    return !use_winograd_ && ConvolutionLayer<Dtype>::SupportsChannelBlock(
+        bottom, top, channel_block);
+  }
+
+  /// @brief Whether the filters described by param qualify for Winograd.
+  static bool IsSupported(const ConvolutionParameter& param);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /**
+   * @brief Returns weights transformed for tiles of the given size:
+   *        (m + 2)^2 matrices, one per group, of the (output x input channels)
+   *        of the convolution. If flip, the filters of the convolution
+   *        computing the gradient w.r.t. the bottom.
+   */
+  const Dtype* transformed_filters(const Blob<Dtype>& weights, int tile,
+      bool flip);
+  /**
+   * @brief Convolves one image by the filters given by transformed_filters,
+   *        in the tile buffers of the given task of reshape_tile_buffers.
+   */
+  void winograd_cpu(const Dtype* input, int in_channels, int height,
+      int width, int pad_h, int pad_w, int tile, const Dtype* filters,
+      int out_channels, int out_height, int out_width, Dtype* output,
+      int task);
+  /// @brief Provides tile buffers to each of num_tasks tasks.
+  void reshape_tile_buffers(int num_tasks);
+
+  // Forward_cpu and Backward_cpu split the images of a batch into one block
+  // per thread of the ThreadPool, as ConvolutionLayer does; these run the
+  // block of one task. A NULL bottom_diff or weight_diff skips that
+  // gradient; the tasks but the first write their weight gradient to
+  // task_weight_diffs.
+  void forward_winograd_task(const Dtype* bottom_data, Dtype* top_data,
+      int tile, const Dtype* filters, int num_tasks, int task);
+  void backward_winograd_task(const Dtype* top_diff,
+      const Dtype* bottom_data, Dtype* bottom_diff, Dtype* weight_diff,
+      Dtype* task_weight_diffs, const Dtype* filters, int num_tasks,
+      int task);
+
+  bool use_winograd_;
+  /// The transformed filters, and the version of the filters they are from,
+  /// indexed by flip: the forward pass transforms the filters it runs with,
+  /// the backward pass those of the layer.
+  Blob<Dtype> transformed_filters_[2];
+  shared_ptr<SyncedMemory> transformed_source_[2];
+  size_t transformed_version_[2];
+  int transformed_tile_[2];
+  /// The transformed input tiles and the products, before their transform to
+  /// output tiles, of each task.
+  vector<shared_ptr<Blob<Dtype> > > input_tiles_;
+  vector<shared_ptr<Blob<Dtype> > > output_tiles_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
@@ -26,6 +26,19 @@ class Net {
   explicit Net(const NetParameter& param);
   explicit Net(const string& param_file, Phase phase,
       const int level = 0, const vector<string>* stages = NULL);
+  /**
+   * @brief Creates an executor of a net: the layers named like layers of
+   *        weights_source share their parameter Blob%s instead of allocating
+   *        and filling their own.
+   *
+   * An executor only owns its activations and the internal buffers of its
+   * layers, so one model can be run by many executors, each calling Forward
+   * from its own thread, at the memory cost of the activations alone. The
+   * shared weights must not be modified while executors run; create the
+   * executors from one thread, then hand each to its worker thread (which
+   * must set its own Caffe::mode).
+   */
+  Net(const NetParameter& param, const Net& weights_source);
   virtual ~Net() {}
 
   /// @brief Initialize a network with a NetParameter.
@@ -78,7 +91,8 @@ class Net {
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. With
+   * zero_copy_concat, it must follow any change of the input shapes.
    */
   void Reshape();
 
@@ -114,10 +128,20 @@ class Net {
   void CopyTrainedLayersFrom(const string& trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string& trained_filename);
   void CopyTrainedLayersFromHDF5(const string& trained_filename);
+  /**
+   * @brief Loads the pre-trained layers from a flat weights file without
+   *        copying: the file is mapped into memory and the parameters point
+   *        at the mapped pages, which stay mapped as long as the net lives.
+   *
+   * The values are copied only if the file stores another data type.
+   */
+  void CopyTrainedLayersFromFlat(const string& trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /// @brief Writes the parameters of the net to a flat weights file.
+  void ToFlatWeights(const string& filename) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -266,6 +290,27 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Let top blobs with disjoint lifetimes share one memory arena.
+  void PlanMemory();
+  /// @brief Picks the layers which may make their tops views of their bottom
+  ///        (see Layer::set_top_views).
+  static void FindTopViews(const NetParameter& param, vector<bool>* top_views);
+  /// @brief Picks the bottoms of Concat layers to make views of their top
+  ///        (see NetParameter.zero_copy_concat).
+  void FindConcatViews();
+  /// @brief Points the bottoms picked by FindConcatViews into their top, at
+  ///        the offsets of the current shapes.
+  void ShareConcatViews();
+  /// @brief Runs a layer in the blocked layout if it supports it, reordering
+  ///        the bottoms whose layout differs.
+  Dtype ForwardBlocked(const int layer_id);
+  /// @brief Folds BatchNorm, Scale and ReLU layers that run in place after
+  ///        a convolution into it (see NetParameter.fuse_batch_norm).
+  void FuseBatchNorm();
+  /// @brief Whether layer_id runs in place on blob, with the given type.
+  bool RunsInPlace(const int layer_id, const Blob<Dtype>* blob,
+      const string& type) const;
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -326,8 +371,26 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The net whose parameters are shared by this executor, if any
+  const Net* weights_source_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// The shared storage of the activations placed by PlanMemory
+  shared_ptr<SyncedMemory> activation_arena_;
+  /// The Concat top each blob is a view of, or -1
+  vector<int> concat_view_top_;
+  /// The storage of the Concat tops, kept for their views should the tops
+  /// be reallocated
+  vector<shared_ptr<SyncedMemory> > concat_storage_;
+  /// The channel block of the CPU activations, 1 for plain NCHW
+  int channel_block_;
+  /// The bottoms reordered for each layer by ForwardBlocked, and the buffer
+  /// the blocked outputs are made plain through
+  vector<vector<shared_ptr<Blob<Dtype> > > > reordered_bottoms_;
+  Blob<Dtype> plain_output_;
+  /// Whether each layer is folded into the convolution before it, and
+  /// skipped by the CPU forward pass
+  vector<bool> fused_layers_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   // Callbacks
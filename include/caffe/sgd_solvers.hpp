@@ -11,6 +11,12 @@ namespace caffe {
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
+ *
+ * On the CPU, parameters with a row-sparse diff (see
+ * Blob::set_row_sparse_diff) are updated lazily: only the rows of the diff
+ * are regularized and updated. The history of a row decays when it is next
+ * updated, by as much as over the iterations it was left out of; the data of
+ * the row does not move in those iterations, unlike with dense momentum.
  */
 template <typename Dtype>
 class SGDSolver : public Solver<Dtype> {
@@ -37,11 +43,28 @@ class SGDSolver : public Solver<Dtype> {
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
+
+  /// @brief Whether ComputeUpdateValue handles row-sparse diffs; if not, they
+  ///        are made dense.
+  virtual inline bool LazyUpdate() const { return true; }
+  /// @brief Decays the history of a row as over steps iterations without
+  ///        gradient.
+  virtual void DecayHistoryRow(int param_id, int row, int steps);
+  /// @brief Decays the history of the rows of the diff of a lazily updated
+  ///        param for the iterations they were left out of.
+  void DecayLazyRows(int param_id);
+  /// @brief Decays the history of all the rows of a lazily updated param, as
+  ///        of the current iteration.
+  void DecayLazyHistory(int param_id);
+
   // history maintains the historical momentum data.
   // update maintains update related data and is not needed in snapshots.
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // history_iter maintains, for each row of the lazily updated params, the
+  //   iteration its history is up to date with.
+  vector<vector<int> > history_iter_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +79,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "Nesterov"; }
 
  protected:
+  virtual inline bool LazyUpdate() const { return false; }
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
@@ -71,6 +95,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "AdaGrad"; }
 
  protected:
+  virtual inline bool LazyUpdate() const { return false; }
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
@@ -91,6 +116,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "RMSProp"; }
 
  protected:
+  virtual inline bool LazyUpdate() const { return false; }
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
@@ -114,6 +140,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
   virtual inline const char* type() const { return "AdaDelta"; }
 
  protected:
+  virtual inline bool LazyUpdate() const { return false; }
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
 
@@ -125,6 +152,10 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  *        of stochastic objective functions, based on adaptive estimates of
  *        lower-order moments. Described in [1].
  *
+ * Row-sparse diffs are updated lazily as with SGDSolver: the moments of a
+ * row decay when it is next updated, and the row does not move in the
+ * iterations it was left out of.
+ *
  * [1] D. P. Kingma and J. L. Ba, "ADAM: A Method for Stochastic Optimization."
  *     arXiv preprint arXiv:1412.6980v8 (2014).
  */
@@ -140,6 +171,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void DecayHistoryRow(int param_id, int row, int steps);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
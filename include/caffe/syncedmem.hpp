@@ -3,11 +3,8 @@
 
 #include <cstdlib>
 
-#ifdef USE_MKL
-  #include "mkl.h"
-#endif
-
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 
 namespace caffe {
 
@@ -16,6 +13,8 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Otherwise memory comes from the caching HostAllocator, so the size of the
+// block must be given back to CaffeFreeHost.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -24,27 +23,19 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
-#ifdef USE_MKL
-  *ptr = mkl_malloc(size ? size:1, 64);
-#else
-  *ptr = malloc(size);
-#endif
+  *ptr = HostAllocator::Get().Allocate(size);
   *use_cuda = false;
   CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda) {
 #ifndef CPU_ONLY
   if (use_cuda) {
     CUDA_CHECK(cudaFreeHost(ptr));
     return;
   }
 #endif
-#ifdef USE_MKL
-  mkl_free(ptr);
-#else
-  free(ptr);
-#endif
+  HostAllocator::Get().Free(ptr, size);
 }
 
 
@@ -61,6 +52,11 @@ class SyncedMemory {
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /**
+   * @brief Sets the CPU data to memory held by owner, which is kept alive as
+   *        long as the data is in use, e.g. a mapped file.
+   */
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
   const void* gpu_data();
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
@@ -68,6 +64,22 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() const { return head_; }
   size_t size() const { return size_; }
+  /**
+   * @brief Counts the accesses that may have changed the data: the mutable
+   *        and set accessors. Lets derived data (e.g. transformed weights) be
+   *        cached until the data changes.
+   */
+  size_t version() const { return version_; }
+  /**
+   * @brief Frees the CPU data, if only on the CPU and allocated here, while
+   *        compact holds it in fewer bytes, e.g. 16-bit weights. The next
+   *        access calls restore(compact data, CPU data, size) to get it back.
+   *        Neither counts as a change of the data.
+   */
+  void ReleaseCpuData(const shared_ptr<SyncedMemory>& compact,
+      void (*restore)(const void*, void*, size_t));
+  /// @brief The bytes held on the CPU: the data, or its compact copy.
+  size_t cpu_bytes() const;
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -78,14 +90,22 @@ class SyncedMemory {
 
   void to_cpu();
   void to_gpu();
+  // Brings back the CPU data freed by ReleaseCpuData, if any.
+  void restore_cpu_data();
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
+  // The holder of cpu_ptr_ when set by set_cpu_data with an owner
+  shared_ptr<void> cpu_data_owner_;
+  // The compact copy of the CPU data freed by ReleaseCpuData
+  shared_ptr<SyncedMemory> compact_;
+  void (*restore_)(const void*, void*, size_t);
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int device_;
+  size_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
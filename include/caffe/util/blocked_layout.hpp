@@ -0,0 +1,32 @@
+#ifndef CAFFE_UTIL_BLOCKED_LAYOUT_H_
+#define CAFFE_UTIL_BLOCKED_LAYOUT_H_
+
+#include "caffe/blob.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Reorders num images of channels x spatial_dim values from the plain
+ *        NCHW layout to the blocked one of Blob::channel_block, with channels
+ *        a multiple of block.
+ */
+template <typename Dtype>
+void nchw_to_blocked_cpu(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* src, Dtype* dst);
+
+/// @brief The inverse of nchw_to_blocked_cpu.
+template <typename Dtype>
+void blocked_to_nchw_cpu(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* src, Dtype* dst);
+
+/**
+ * @brief Reshapes dst like src and fills its CPU data with that of src in
+ *        the layout of the given channel block.
+ */
+template <typename Dtype>
+void ReorderChannelBlock(const Blob<Dtype>& src, const int channel_block,
+    Blob<Dtype>* dst);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLOCKED_LAYOUT_H_
@@ -0,0 +1,81 @@
+#ifndef CAFFE_UTIL_ELEMENTWISE_H_
+#define CAFFE_UTIL_ELEMENTWISE_H_
+
+#include <boost/bind.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Elementwise loops over the ThreadPool.
+ *
+ * An op is a functor with
+ *   Dtype operator()(Dtype x) const;                   // y = f(x)
+ *   Dtype backward(Dtype x, Dtype y, Dtype dy) const;  // dx = dy * f'(x)
+ * defined inline and without branches (use the ternary operator, std::min
+ * and std::max, and the functions of fast_math.hpp), so that the loops below
+ * compile to SIMD code. The arrays are split into one contiguous chunk per
+ * task, of at least kElementwiseGrain elements.
+ */
+const int kElementwiseGrain = 1 << 15;
+
+template <typename Dtype, typename Op>
+void elementwise_cpu_task(const Op* op, const int n, const Dtype* x, Dtype* y,
+    const int num_tasks, const int task) {
+  const int begin = static_cast<int64_t>(n) * task / num_tasks;
+  const int end = static_cast<int64_t>(n) * (task + 1) / num_tasks;
+  for (int i = begin; i < end; ++i) {
+    y[i] = (*op)(x[i]);
+  }
+}
+
+template <typename Dtype, typename Op>
+void elementwise_backward_cpu_task(const Op* op, const int n, const Dtype* x,
+    const Dtype* y, const Dtype* dy, Dtype* dx, const int num_tasks,
+    const int task) {
+  const int begin = static_cast<int64_t>(n) * task / num_tasks;
+  const int end = static_cast<int64_t>(n) * (task + 1) / num_tasks;
+  for (int i = begin; i < end; ++i) {
+    dx[i] = op->backward(x[i], y[i], dy[i]);
+  }
+}
+
+inline int elementwise_num_tasks(const int n) {
+  return std::max(1, std::min(ThreadPool::Get().num_threads(),
+      n / kElementwiseGrain));
+}
+
+/// @brief y[i] = op(x[i]); y may be x.
+template <typename Dtype, typename Op>
+void caffe_cpu_elementwise(const int n, const Op& op, const Dtype* x,
+    Dtype* y) {
+  const int num_tasks = elementwise_num_tasks(n);
+  if (num_tasks == 1) {
+    elementwise_cpu_task(&op, n, x, y, 1, 0);
+    return;
+  }
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &elementwise_cpu_task<Dtype, Op>, &op, n, x, y, num_tasks, _1));
+}
+
+/// @brief dx[i] = op.backward(x[i], y[i], dy[i]); dx may be any of these.
+template <typename Dtype, typename Op>
+void caffe_cpu_elementwise_backward(const int n, const Op& op,
+    const Dtype* x, const Dtype* y, const Dtype* dy, Dtype* dx) {
+  const int num_tasks = elementwise_num_tasks(n);
+  if (num_tasks == 1) {
+    elementwise_backward_cpu_task(&op, n, x, y, dy, dx, 1, 0);
+    return;
+  }
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &elementwise_backward_cpu_task<Dtype, Op>, &op, n, x, y, dy, dx,
+      num_tasks, _1));
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ELEMENTWISE_H_
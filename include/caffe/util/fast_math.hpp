@@ -0,0 +1,122 @@
+#ifndef CAFFE_UTIL_FAST_MATH_H_
+#define CAFFE_UTIL_FAST_MATH_H_
+
+#include <stdint.h>
+#include <cmath>
+#include <limits>
+
+namespace caffe {
+
+/**
+ * @brief exp without branches or library calls, so loops of it vectorize.
+ *
+ * The float version reduces x = n ln(2) + r with |r| <= ln(2) / 2 and
+ * evaluates the Cephes polynomial for exp(r), scaled by 2^n through the
+ * exponent bits: the relative error is below 2e-7 (about 2 ulp) over the
+ * whole range. Inputs are clamped to [-87.3, 88.3], so the result is never
+ * 0 or inf; below the clamp it stays at about 1.2e-38. The double version
+ * is std::exp.
+ */
+inline float fast_exp(float x) {
+  x = x < -87.33654f ? -87.33654f : x;
+  x = x > 88.37626f ? 88.37626f : x;
+  const float n = std::floor(x * 1.44269504088896341f + 0.5f);
+  // ln(2) split in two so that n * ln(2) is exact in the reduction.
+  const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  union { int32_t i; float f; } scale;
+  scale.i = (static_cast<int32_t>(n) + 127) << 23;
+  return p * scale.f;
+}
+
+inline double fast_exp(double x) {
+  return std::exp(x);
+}
+
+/**
+ * @brief log without branches or library calls.
+ *
+ * The float version splits x = m 2^e with sqrt(1/2) <= m < sqrt(2) through
+ * the exponent bits, subnormals included, and evaluates the Cephes
+ * polynomial for log(m): the absolute error is below 1e-7 for x in
+ * [0.5, 2] and the relative error below 2e-7 elsewhere. log(0) is -inf and
+ * log(x < 0) NaN as for std::log. The double version is std::log.
+ */
+inline float fast_log(float x) {
+  // Scale subnormals up by 2^25 into the normal range.
+  const bool subnormal = x < 1.17549435e-38f;
+  union { float f; int32_t i; } u;
+  u.f = subnormal ? x * 33554432.0f : x;
+  float e = static_cast<float>(((u.i >> 23) & 0xff) - 126) -
+      (subnormal ? 25.0f : 0.0f);
+  u.i = (u.i & 0x807fffff) | 0x3f000000;  // m in [0.5, 1)
+  const bool low = u.f < 0.707106781186547524f;
+  e = low ? e - 1.0f : e;
+  const float m = (low ? u.f + u.f : u.f) - 1.0f;
+  const float z = m * m;
+  float p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  p = p * m * z;
+  p += e * -2.12194440e-4f - 0.5f * z;
+  const float result = m + p + e * 0.693359375f;
+  const float inf = std::numeric_limits<float>::infinity();
+  return x > 0 ? (x < inf ? result : inf) :
+      (x == 0 ? -inf : std::numeric_limits<float>::quiet_NaN());
+}
+
+inline double fast_log(double x) {
+  return std::log(x);
+}
+
+/**
+ * @brief tanh from an odd polynomial for |x| < 0.625 and from fast_exp as
+ *        1 - 2 / (exp(2|x|) + 1) beyond, both from Cephes: the relative
+ *        error of the float version is below 5e-7. The double version is
+ *        std::tanh.
+ */
+inline float fast_tanh(float x) {
+  const float z = x * x;
+  float p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  const float small = p * z * x + x;
+  const float abs_x = std::fabs(x);
+  const float large = 1.0f - 2.0f / (fast_exp(abs_x + abs_x) + 1.0f);
+  return abs_x < 0.625f ? small : (x < 0 ? -large : large);
+}
+
+inline double fast_tanh(double x) {
+  return std::tanh(x);
+}
+
+/**
+ * @brief 1 / (1 + exp(-x)) through fast_exp: the relative error of the float
+ *        version is below 5e-7; below x = -88.3 the result stays at about
+ *        4e-39 rather than going to 0. The double version uses std::exp.
+ */
+inline float fast_sigmoid(float x) {
+  return 1.0f / (1.0f + fast_exp(-x));
+}
+
+inline double fast_sigmoid(double x) {
+  return 1.0 / (1.0 + std::exp(-x));
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FAST_MATH_H_
@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_FLAT_WEIGHTS_H_
+#define CAFFE_UTIL_FLAT_WEIGHTS_H_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * A flat weights file stores the parameters of a net as raw values, in the
+ * native byte order, so they can be mapped into memory instead of parsed:
+ *
+ *   - the 8 bytes kFlatWeightsMagic,
+ *   - the size of the index as a uint64,
+ *   - the serialized FlatWeightsIndex,
+ *   - padding up to kFlatWeightsPageSize,
+ *   - the data region, in which each blob starts at a multiple of
+ *     kFlatWeightsAlignment bytes given by its FlatBlob::offset.
+ */
+extern const char kFlatWeightsMagic[8];
+const size_t kFlatWeightsPageSize = 4096;
+const size_t kFlatWeightsAlignment = 64;
+
+/// @brief Returns whether filename starts with kFlatWeightsMagic.
+bool IsFlatWeightsFile(const string& filename);
+
+/**
+ * @brief Writes a flat weights file.
+ *
+ * @param index the layers and blob shapes to write; the offsets are assigned
+ *        here. Blobs with the same data pointer are stored once.
+ * @param data the values of each blob, in the order of index.
+ */
+void WriteFlatWeightsFile(const string& filename, FlatWeightsIndex* index,
+    const vector<const void*>& data);
+
+/**
+ * @brief A file mapped into memory, unmapped on destruction.
+ *
+ * The pages are mapped privately and copy-on-write: they are shared with the
+ * page cache (and so with other processes mapping the file) until written,
+ * and writes never reach the file.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const string& filename);
+  ~MappedFile();
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  char* data_;
+  size_t size_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
+/**
+ * @brief Parses the index of a mapped flat weights file and checks that the
+ *        blobs it lists lie within the file.
+ *
+ * @return the start of the data region.
+ */
+char* ReadFlatWeightsIndex(const MappedFile& file, FlatWeightsIndex* index);
+
+/// @brief The size in bytes of one value of the given data type.
+size_t FlatWeightsElementSize(FlatWeightsIndex::DataType data_type);
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_FLAT_WEIGHTS_H_
@@ -0,0 +1,88 @@
+#ifndef CAFFE_UTIL_HALF_H_
+#define CAFFE_UTIL_HALF_H_
+
+#include <stdint.h>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief float to IEEE half precision, rounding to nearest even: values of
+ *        magnitude 65520 and up become inf, and those below 2^-14 subnormals.
+ */
+inline uint16_t float_to_half(float x) {
+  union { float f; uint32_t u; } v;
+  v.f = x;
+  const uint32_t sign = v.u & 0x80000000u;
+  v.u ^= sign;
+  uint32_t h;
+  if (v.u >= 0x47800000u) {  // 65536 and up, inf or NaN
+    h = v.u > 0x7f800000u ? 0x7e00 : 0x7c00;
+  } else if (v.u < 0x38800000u) {  // below 2^-14
+    // Adding 0.5 aligns the 10 mantissa bits of the subnormal at the bottom
+    // of the float, rounded by the addition.
+    union { float f; uint32_t u; } magic;
+    magic.u = 0x3f000000u;
+    v.f += magic.f;
+    h = v.u - magic.u;
+  } else {
+    const uint32_t odd = (v.u >> 13) & 1;
+    v.u += 0xc8000fffu + odd;  // rebias the exponent by -112 and round
+    h = v.u >> 13;
+  }
+  return static_cast<uint16_t>(h | (sign >> 16));
+}
+
+inline float half_to_float(uint16_t h) {
+  union { float f; uint32_t u; } v;
+  v.u = static_cast<uint32_t>(h & 0x7fff) << 13;
+  const uint32_t exponent = v.u & 0x0f800000u;
+  v.u += 0x38000000u;  // rebias the exponent by 112
+  if (exponent == 0x0f800000u) {  // inf or NaN
+    v.u += 0x38000000u;
+  } else if (exponent == 0) {  // zero or subnormal
+    union { float f; uint32_t u; } magic;
+    magic.u = 0x38800000u;  // 2^-14
+    v.u += 0x00800000u;
+    v.f -= magic.f;
+  }
+  v.u |= static_cast<uint32_t>(h & 0x8000) << 16;
+  return v.f;
+}
+
+/// @brief float to bfloat16, its upper 16 bits, rounding to nearest even.
+inline uint16_t float_to_bfloat16(float x) {
+  union { float f; uint32_t u; } v;
+  v.f = x;
+  if ((v.u & 0x7fffffffu) > 0x7f800000u) {  // keep NaN a quiet NaN
+    return static_cast<uint16_t>((v.u >> 16) | 0x40);
+  }
+  v.u += 0x7fffu + ((v.u >> 16) & 1);
+  return static_cast<uint16_t>(v.u >> 16);
+}
+
+inline float bfloat16_to_float(uint16_t h) {
+  union { float f; uint32_t u; } v;
+  v.u = static_cast<uint32_t>(h) << 16;
+  return v.f;
+}
+
+/// @brief Whether values of the storage type take 16 bits.
+inline bool is_half_storage(StorageType type) {
+  return type == FLOAT16 || type == BFLOAT16;
+}
+
+/// @brief Converts n values to the 16 bits of type FLOAT16 or BFLOAT16.
+template <typename Dtype>
+void caffe_cpu_to_half(const StorageType type, const int n, const Dtype* x,
+    uint16_t* y);
+
+/// @brief Widens n values stored as FLOAT16 or BFLOAT16.
+template <typename Dtype>
+void caffe_cpu_from_half(const StorageType type, const int n,
+    const uint16_t* x, Dtype* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_H_
@@ -21,10 +21,12 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+/// @brief Saves the data or diff of the blob; the data of storage FLOAT16 or
+///        BFLOAT16 is saved in 16 bits, which hdf5_load_nd_dataset widens.
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
-    bool write_diff = false);
+    bool write_diff = false, StorageType storage = DTYPE);
 
 int hdf5_load_int(hid_t loc_id, const string& dataset_name);
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i);
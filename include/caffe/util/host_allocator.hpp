@@ -0,0 +1,82 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe caching allocator for host memory, used by
+ *        CaffeMallocHost.
+ *
+ * Requests are rounded up to a size class (four per power of two, so at most
+ * a quarter of a block is wasted) and freed blocks are kept on a per-class
+ * free list to be handed out again. This spares the system allocator the
+ * churn of Blob%s being reshaped to varying sizes. Every block is aligned to
+ * kAlignment bytes.
+ */
+class HostAllocator {
+ public:
+  static const size_t kAlignment = 64;
+  /// @brief The default limit of the bytes held in the cache, 1 GiB.
+  static const size_t kDefaultMaxCachedBytes = size_t(1) << 30;
+
+  /// @brief Returns the process-wide allocator.
+  static HostAllocator& Get();
+
+  /// @brief Returns a block of at least size bytes.
+  void* Allocate(size_t size);
+  /// @brief Returns a block obtained from Allocate(size) to the cache.
+  void Free(void* ptr, size_t size);
+  /// @brief Releases all cached blocks to the system.
+  void Trim();
+
+  /// @brief Number of allocations served from the cache.
+  size_t hits() const;
+  /// @brief Number of allocations that had to go to the system.
+  size_t misses() const;
+  /// @brief Bytes currently held in the cache.
+  size_t cached_bytes() const;
+  /// @brief Resets the hit and miss counters.
+  void ResetCounters();
+
+  /**
+   * @brief Limits the bytes held in the cache; blocks freed beyond the limit
+   *        are released to the system right away, and cached blocks beyond
+   *        a lower limit too. kDefaultMaxCachedBytes by default.
+   */
+  void set_max_cached_bytes(size_t max_cached_bytes);
+  size_t max_cached_bytes() const;
+
+  /**
+   * @brief Rounds size up to its size class.
+   *
+   * @param index if not NULL, receives the index of the class.
+   */
+  static size_t RoundSize(size_t size, int* index = NULL);
+
+ private:
+  HostAllocator();
+
+  vector<vector<void*> > free_lists_;
+  size_t hits_;
+  size_t misses_;
+  size_t cached_bytes_;
+  size_t max_cached_bytes_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(HostAllocator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
@@ -145,6 +145,12 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]))
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Writes the softmax of the n contiguous x to y (which may be x) and returns
+// log(sum(exp(x))). One pass finds the max and the sum of the exponentials
+// together, rescaling the sum whenever the max grows; a second writes y.
+template <typename Dtype>
+Dtype caffe_cpu_softmax(const int n, const Dtype* x, Dtype* y);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -0,0 +1,65 @@
+#ifndef CAFFE_UTIL_PACKED_GEMM_H_
+#define CAFFE_UTIL_PACKED_GEMM_H_
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The weights of an inner product packed once for the GEMMs of the
+ *        TEST phase, instead of by BLAS at every call, and repacked when
+ *        they change.
+ *
+ * With MKL the weights are packed by cblas_?gemm_pack for
+ * cblas_?gemm_compute. Otherwise they are cut into panels of kPanelRows
+ * rows, stored column by column, which a built-in kernel multiplies with one
+ * input at a time; it beats caffe_cpu_gemm only for single inputs (see
+ * Suits), where BLAS spends most of the time packing.
+ */
+template <typename Dtype>
+class PackedWeights {
+ public:
+  /// @brief The number of weight rows in a panel of the built-in kernel.
+  static const int kPanelRows = 8;
+
+  PackedWeights() : version_(0), rows_(0), cols_(0), dim_(0) {}
+
+  /// @brief Whether packed products of dim inputs are faster than
+  ///        caffe_cpu_gemm.
+  static bool Suits(const int dim);
+
+  /**
+   * @brief Packs the weights, a matrix of rows x cols or, if transpose, one
+   *        stored as cols x rows, for products of dim inputs. They are only
+   *        repacked when they change or, with MKL, when dim does.
+   */
+  void Update(const Blob<Dtype>& weights, const int rows,
+      const bool transpose, const int dim);
+
+  /// @brief The number of blocks of rows gemm_nt may be split into, for
+  ///        tasks of the ThreadPool: one with MKL, which runs its own
+  ///        threads, else the panels.
+  int blocks() const;
+  /**
+   * @brief C = A W^T for the M x cols A and the M x rows C, over the rows of
+   *        the blocks [begin, end) only.
+   */
+  void gemm_nt(const int M, const Dtype* A, Dtype* C, const int begin,
+      const int end) const;
+
+ private:
+  shared_ptr<SyncedMemory> source_;
+  size_t version_;
+  int rows_;
+  int cols_;
+  int dim_;
+  shared_ptr<SyncedMemory> packed_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PACKED_GEMM_H_
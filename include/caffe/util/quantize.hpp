@@ -0,0 +1,79 @@
+#ifndef CAFFE_UTIL_QUANTIZE_H_
+#define CAFFE_UTIL_QUANTIZE_H_
+
+#include <stdint.h>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/// @brief y = round(x * inverse_scale), clamped to [-127, 127].
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype inverse_scale,
+    const Dtype* x, int8_t* y);
+
+/**
+ * @brief C = A B^T for the int8 matrices A (M x K) and B (N x K), with int32
+ *        C (M x N); lda, ldb and ldc are the row strides.
+ *
+ * Every output is the dot product of two contiguous rows. The products of
+ * values in [-127, 127] and the sums of two of them fit in 16 bits, so the
+ * inner loop compiles to the 16-bit multiply-add of SSE2 / AVX2 (pmaddwd)
+ * into 32-bit sums, without the int16 saturation of the u8 x s8 instruction.
+ */
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const int lda, const int8_t* B, const int ldb,
+    int32_t* C, const int ldc);
+
+/**
+ * @brief Unrolls an int8 channels x height x width image into one row of
+ *        channels x kernel_h x kernel_w values per output pixel: the
+ *        transpose of the im2col_cpu columns, as caffe_cpu_gemm_s8 wants it.
+ */
+void im2row_s8(const int8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, int8_t* data_row);
+
+/**
+ * @brief The int8 copy of a weight matrix, with one scale per output row
+ *        (max |w| / 127), which is rebuilt when the weights change.
+ */
+template <typename Dtype>
+class QuantizedWeights {
+ public:
+  QuantizedWeights() : version_(0) {}
+
+  /// @brief Quantizes the rows x cols weights, which are stored as
+  ///        cols x rows if transpose.
+  void Update(const Blob<Dtype>& weights, const int rows, const bool transpose);
+  /// @brief The rows x cols int8 weights.
+  const int8_t* data() const {
+    return static_cast<const int8_t*>(data_->cpu_data());
+  }
+  const Dtype* scales() const { return scales_.cpu_data(); }
+
+ private:
+  shared_ptr<SyncedMemory> source_;
+  size_t version_;
+  shared_ptr<SyncedMemory> data_;
+  Blob<Dtype> scales_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizedWeights);
+};
+
+/// @brief Returns a CPU buffer of at least size bytes, reallocating buffer
+///        only when it grows.
+inline void* int8_buffer(shared_ptr<SyncedMemory>* buffer, const size_t size) {
+  if (!*buffer || (*buffer)->size() < size) {
+    buffer->reset(new SyncedMemory(size));
+  }
+  return (*buffer)->mutable_cpu_data();
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_H_
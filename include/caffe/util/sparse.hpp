@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_SPARSE_H_
+#define CAFFE_UTIL_SPARSE_H_
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+// The sparse matrices below are in compressed sparse rows (CSR): the nonzero
+// values of row i, and their columns, are at row_offsets[i] up to
+// row_offsets[i + 1] of values and columns.
+
+/**
+ * @brief C = A B for the M x K sparse A and the dense K x N B and M x N C.
+ *
+ * Every nonzero of A adds a scaled row of B to a row of C, so the inner loop
+ * is a contiguous axpy over N, as in a 1x1 convolution of an image.
+ */
+template <typename Dtype>
+void caffe_cpu_csr_gemm(const int M, const int N, const int* row_offsets,
+    const int* columns, const Dtype* values, const Dtype* B, Dtype* C);
+
+/**
+ * @brief C = A B^T for the dense M x K A, the N x K sparse B and the dense
+ *        M x N C, with row stride ldc, as in an inner product with the
+ *        weights pruned.
+ *
+ * Every output gathers a row of A at the columns of a row of B; each row of
+ * B is applied to four rows of A at a time.
+ */
+template <typename Dtype>
+void caffe_cpu_gemm_csr_t(const int M, const int N, const int K,
+    const Dtype* A, const int* row_offsets, const int* columns,
+    const Dtype* values, Dtype* C, const int ldc);
+
+/**
+ * @brief The CSR copy of a weight matrix, kept while at most a given
+ *        fraction of the weights is nonzero and rebuilt when they change.
+ */
+template <typename Dtype>
+class SparseWeights {
+ public:
+  SparseWeights() : version_(0), density_(1), compressed_(false) {}
+
+  /**
+   * @brief Compresses the rows x cols weights, which are stored as
+   *        cols x rows if transpose, if at most max_density of them are
+   *        nonzero; returns whether they are.
+   */
+  bool Update(const Blob<Dtype>& weights, const int rows, const bool transpose,
+      const float max_density);
+  /// @brief The fraction of the weights that is nonzero.
+  float density() const { return density_; }
+  /// @brief The data of the weights last given to Update.
+  const shared_ptr<SyncedMemory>& source() const { return source_; }
+  const int* row_offsets() const { return row_offsets_.cpu_data(); }
+  const int* columns() const { return columns_.cpu_data(); }
+  const Dtype* values() const { return values_.cpu_data(); }
+
+ private:
+  shared_ptr<SyncedMemory> source_;
+  size_t version_;
+  float density_;
+  bool compressed_;
+  Blob<int> row_offsets_;
+  Blob<int> columns_;
+  Blob<Dtype> values_;
+
+  DISABLE_COPY_AND_ASSIGN(SparseWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_H_
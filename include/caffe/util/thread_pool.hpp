@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A process-wide pool of worker threads for the CPU code of layers,
+ *        such as the loop over the images of a batch in ConvolutionLayer.
+ *
+ * The pool has a single thread, the calling one, unless set_num_threads
+ * raises it; with several BLAS threads per process this is usually best left
+ * alone, while with single-threaded BLAS it lets a layer use several cores.
+ */
+class ThreadPool {
+ public:
+  /// @brief Returns the process-wide pool.
+  static ThreadPool& Get();
+
+  ~ThreadPool();
+
+  /// @brief The number of threads running tasks, including the calling one.
+  int num_threads() const { return workers_.size() + 1; }
+  /// @brief Sets the number of threads, waiting for running tasks first.
+  void set_num_threads(int num_threads);
+
+  /**
+   * @brief Runs task(0), ..., task(num_tasks - 1) on the threads of the pool
+   *        and returns when all of them are done.
+   *
+   * Which thread runs which task is unspecified: for results that do not
+   * depend on the scheduling, each task should only write its own outputs,
+   * to be combined by the caller in task order. A single task, or any number
+   * without workers, runs on the calling thread, concurrently with other
+   * calls; calls dispatching to the workers run one after the other. A task
+   * must not call Run itself.
+   */
+  void Run(int num_tasks, const boost::function<void(int)>& task);
+
+ private:
+  ThreadPool();
+
+  // Whether Run runs num_tasks tasks on the calling thread.
+  bool RunsInline(int num_tasks) const;
+  void WorkerEntry(size_t generation);
+  // Runs the tasks of the current call of Run until none are left.
+  void RunTasks();
+
+  class Sync;
+  shared_ptr<Sync> sync_;
+  vector<shared_ptr<boost::thread> > workers_;
+  // The current call of Run, counted by generation_.
+  const boost::function<void(int)>* task_;
+  int num_tasks_;
+  int next_task_;
+  int pending_tasks_;
+  size_t generation_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
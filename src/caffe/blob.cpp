@@ -1,9 +1,11 @@
 #include <climits>
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -41,6 +43,8 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_offset_ = 0;
+    diff_offset_ = 0;
   }
 }
 
@@ -63,14 +67,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : data_offset_(0), diff_offset_(0), capacity_(0), channel_block_(1) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : data_offset_(0), diff_offset_(0), capacity_(0), channel_block_(1) {
   Reshape(shape);
 }
 
@@ -83,7 +87,7 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->cpu_data();
+  return (const Dtype*)data_->cpu_data() + data_offset_;
 }
 
 template <typename Dtype>
@@ -94,6 +98,8 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
+    data_offset_ = 0;
+    diff_offset_ = 0;
   }
   data_->set_cpu_data(data);
 }
@@ -101,7 +107,7 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
-  return (const Dtype*)data_->gpu_data();
+  return (const Dtype*)data_->gpu_data() + data_offset_;
 }
 
 template <typename Dtype>
@@ -112,6 +118,8 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
   if (data_->size() != size) {
     data_.reset(new SyncedMemory(size));
     diff_.reset(new SyncedMemory(size));
+    data_offset_ = 0;
+    diff_offset_ = 0;
   }
   data_->set_gpu_data(data);
 }
@@ -119,49 +127,74 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->cpu_data();
+  return (const Dtype*)diff_->cpu_data() + diff_offset_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_diff(Dtype* diff) {
+  CHECK(diff);
+  size_t size = count_ * sizeof(Dtype);
+  if (diff_->size() != size) {
+    diff_.reset(new SyncedMemory(size));
+    diff_offset_ = 0;
+  }
+  diff_->set_cpu_data(diff);
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_diff() const {
   CHECK(diff_);
-  return (const Dtype*)diff_->gpu_data();
+  return (const Dtype*)diff_->gpu_data() + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_cpu_data());
+  return static_cast<Dtype*>(data_->mutable_cpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
-  return static_cast<Dtype*>(data_->mutable_gpu_data());
+  return static_cast<Dtype*>(data_->mutable_gpu_data()) + data_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_cpu_data());
+  return static_cast<Dtype*>(diff_->mutable_cpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_diff() {
   CHECK(diff_);
-  return static_cast<Dtype*>(diff_->mutable_gpu_data());
+  return static_cast<Dtype*>(diff_->mutable_gpu_data()) + diff_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
   data_ = other.data();
+  data_offset_ = other.data_offset_;
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
   diff_ = other.diff();
+  diff_offset_ = other.diff_offset_;
+  diff_rows_ = other.diff_rows_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareView(const Blob& other, const int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  data_ = other.data();
+  diff_ = other.diff();
+  data_offset_ = other.data_offset_ + offset;
+  diff_offset_ = other.diff_offset_ + offset;
+  capacity_ = count_;
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -176,17 +209,24 @@ void Blob<Dtype>::Update() {
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
-    caffe_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->cpu_data()),
-        static_cast<Dtype*>(data_->mutable_cpu_data()));
+    if (row_sparse_diff()) {
+      const int dim = count(1);
+      const Dtype* diff = cpu_diff();
+      Dtype* data = mutable_cpu_data();
+      const vector<int>& rows = diff_rows_->rows;
+      for (int i = 0; i < rows.size(); ++i) {
+        caffe_axpy<Dtype>(dim, Dtype(-1), diff + rows[i] * dim,
+            data + rows[i] * dim);
+      }
+      break;
+    }
+    caffe_axpy<Dtype>(count_, Dtype(-1), cpu_diff(), mutable_cpu_data());
     break;
   case SyncedMemory::HEAD_AT_GPU:
   case SyncedMemory::SYNCED:
 #ifndef CPU_ONLY
     // perform computation on GPU
-    caffe_gpu_axpy<Dtype>(count_, Dtype(-1),
-        static_cast<const Dtype*>(diff_->gpu_data()),
-        static_cast<Dtype*>(data_->mutable_gpu_data()));
+    caffe_gpu_axpy<Dtype>(count_, Dtype(-1), gpu_diff(), mutable_gpu_data());
 #else
     NO_GPU;
 #endif
@@ -321,6 +361,16 @@ Dtype Blob<Dtype>::sumsq_diff() const {
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = cpu_diff();
+    if (row_sparse_diff()) {
+      const int dim = count(1);
+      const vector<int>& rows = diff_rows_->rows;
+      sumsq = 0;
+      for (int i = 0; i < rows.size(); ++i) {
+        sumsq += caffe_cpu_dot(dim, diff + rows[i] * dim,
+            diff + rows[i] * dim);
+      }
+      break;
+    }
     sumsq = caffe_cpu_dot(count_, diff, diff);
     break;
   case SyncedMemory::HEAD_AT_GPU:
@@ -388,6 +438,14 @@ void Blob<Dtype>::scale_diff(Dtype scale_factor) {
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = mutable_cpu_diff();
+    if (row_sparse_diff()) {
+      const int dim = count(1);
+      const vector<int>& rows = diff_rows_->rows;
+      for (int i = 0; i < rows.size(); ++i) {
+        caffe_scal(dim, scale_factor, diff + rows[i] * dim);
+      }
+      return;
+    }
     caffe_scal(count_, scale_factor, diff);
     return;
   case SyncedMemory::HEAD_AT_GPU:
@@ -406,6 +464,74 @@ void Blob<Dtype>::scale_diff(Dtype scale_factor) {
   }
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_row_sparse_diff(bool row_sparse) {
+  if (!row_sparse) {
+    diff_rows_.reset();
+  } else if (!diff_rows_) {
+    diff_rows_.reset(new DiffRows());
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::add_diff_row(int row) {
+  DCHECK(diff_rows_) << "the diff is not row-sparse";
+  DiffRows* diff_rows = diff_rows_.get();
+  if (diff_rows->dense) { return; }
+  DCHECK_GE(row, 0);
+  DCHECK_LT(row, shape(0));
+  if (diff_rows->listed.size() < shape(0)) {
+    diff_rows->listed.resize(shape(0), false);
+  }
+  if (!diff_rows->listed[row]) {
+    diff_rows->listed[row] = true;
+    diff_rows->rows.push_back(row);
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_diff_dense() {
+  if (diff_rows_) {
+    diff_rows_->dense = true;
+  }
+}
+
+template <> void Blob<unsigned int>::ClearDiff() { NOT_IMPLEMENTED; }
+template <> void Blob<int>::ClearDiff() { NOT_IMPLEMENTED; }
+
+template <typename Dtype>
+void Blob<Dtype>::ClearDiff() {
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    if (row_sparse_diff()) {
+      const int dim = count(1);
+      Dtype* diff = mutable_cpu_diff();
+      const vector<int>& rows = diff_rows_->rows;
+      for (int i = 0; i < rows.size(); ++i) {
+        caffe_set(dim, Dtype(0), diff + rows[i] * dim);
+      }
+    } else {
+      caffe_set(count_, Dtype(0), mutable_cpu_diff());
+    }
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    caffe_gpu_set(count_, Dtype(0), mutable_gpu_diff());
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  if (diff_rows_) {
+    DiffRows* diff_rows = diff_rows_.get();
+    for (int i = 0; i < diff_rows->rows.size(); ++i) {
+      diff_rows->listed[diff_rows->rows[i]] = false;
+    }
+    diff_rows->rows.clear();
+    diff_rows->dense = false;
+  }
+}
+
 template <typename Dtype>
 bool Blob<Dtype>::ShapeEquals(const BlobProto& other) {
   if (other.has_num() || other.has_channels() ||
@@ -487,7 +613,40 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.has_half_data_type()) {
+    const string& half_data = proto.half_data();
+    CHECK_EQ(2 * count_, half_data.size());
+    const bool bfloat16 = proto.half_data_type() == BFLOAT16;
+    CHECK(bfloat16 || proto.half_data_type() == FLOAT16);
+    for (int i = 0; i < count_; ++i) {
+      const uint16_t h = static_cast<uint8_t>(half_data[2 * i]) |
+          static_cast<uint8_t>(half_data[2 * i + 1]) << 8;
+      data_vec[i] = bfloat16 ? bfloat16_to_float(h) : half_to_float(h);
+    }
+  } else if (proto.csr_row_offsets_size() > 0) {
+    const int rows = proto.csr_row_offsets_size() - 1;
+    CHECK_GT(rows, 0);
+    CHECK_EQ(count_ % rows, 0) << "CSR rows do not divide the blob";
+    const int cols = count_ / rows;
+    const int nonzeros = proto.csr_row_offsets(rows);
+    CHECK_EQ(nonzeros, proto.csr_columns_size());
+    const bool double_data = proto.double_data_size() > 0;
+    CHECK_EQ(nonzeros, double_data ? proto.double_data_size() :
+        proto.data_size());
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = 0;
+    }
+    for (int r = 0; r < rows; ++r) {
+      CHECK_LE(proto.csr_row_offsets(r), proto.csr_row_offsets(r + 1));
+      for (int k = proto.csr_row_offsets(r); k < proto.csr_row_offsets(r + 1);
+          ++k) {
+        const int c = proto.csr_columns(k);
+        CHECK(c >= 0 && c < cols) << "CSR column out of range";
+        data_vec[r * cols + c] = double_data ? proto.double_data(k) :
+            proto.data(k);
+      }
+    }
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -513,17 +672,70 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
 }
 
+// Writes the data of a blob as little-endian 16-bit values.
+template <typename Dtype>
+static void WriteHalfData(const StorageType storage, const int count,
+    const Dtype* data, BlobProto* proto) {
+  const bool bfloat16 = storage == BFLOAT16;
+  CHECK(bfloat16 || storage == FLOAT16);
+  string* half_data = proto->mutable_half_data();
+  half_data->resize(2 * count);
+  for (int i = 0; i < count; ++i) {
+    const uint16_t h = bfloat16 ? float_to_bfloat16(data[i]) :
+        float_to_half(data[i]);
+    (*half_data)[2 * i] = static_cast<char>(h & 0xff);
+    (*half_data)[2 * i + 1] = static_cast<char>(h >> 8);
+  }
+  proto->set_half_data_type(storage);
+}
+
+// Writes the row offsets and columns of the nonzero data of a blob in
+// compressed sparse rows over its first axis, and returns their values.
+template <typename Dtype>
+static vector<Dtype> WriteCSRIndices(const vector<int>& shape,
+    const int count, const Dtype* data, BlobProto* proto) {
+  const int rows = shape.size() > 1 && count > 0 ? shape[0] : 1;
+  const int cols = count / rows;
+  vector<Dtype> values;
+  proto->add_csr_row_offsets(0);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      if (data[r * cols + c] != 0) {
+        proto->add_csr_columns(c);
+        values.push_back(data[r * cols + c]);
+      }
+    }
+    proto->add_csr_row_offsets(values.size());
+  }
+  return values;
+}
+
 template <>
-void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<double>::ToProto(BlobProto* proto, bool write_diff,
+    StorageType storage) const {
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  proto->clear_half_data_type();
+  proto->clear_half_data();
+  proto->clear_csr_row_offsets();
+  proto->clear_csr_columns();
   const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
+  if (is_half_storage(storage)) {
+    WriteHalfData(storage, count_, data_vec, proto);
+  } else if (storage == CSR) {
+    const vector<double> values =
+        WriteCSRIndices(shape_, count_, data_vec, proto);
+    for (int i = 0; i < values.size(); ++i) {
+      proto->add_double_data(values[i]);
+    }
+  } else {
+    for (int i = 0; i < count_; ++i) {
+      proto->add_double_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const double* diff_vec = cpu_diff();
@@ -534,16 +746,31 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
 }
 
 template <>
-void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<float>::ToProto(BlobProto* proto, bool write_diff,
+    StorageType storage) const {
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
   }
   proto->clear_data();
   proto->clear_diff();
+  proto->clear_half_data_type();
+  proto->clear_half_data();
+  proto->clear_csr_row_offsets();
+  proto->clear_csr_columns();
   const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
+  if (is_half_storage(storage)) {
+    WriteHalfData(storage, count_, data_vec, proto);
+  } else if (storage == CSR) {
+    const vector<float> values =
+        WriteCSRIndices(shape_, count_, data_vec, proto);
+    for (int i = 0; i < values.size(); ++i) {
+      proto->add_data(values[i]);
+    }
+  } else {
+    for (int i = 0; i < count_; ++i) {
+      proto->add_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const float* diff_vec = cpu_diff();
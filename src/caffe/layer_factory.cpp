@@ -10,12 +10,15 @@
 #include "caffe/layers/clip_layer.hpp"
 #include "caffe/layers/conv_layer.hpp"
 #include "caffe/layers/deconv_layer.hpp"
+#include "caffe/layers/fused_lstm_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
+#include "caffe/layers/lstm_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/relu_layer.hpp"
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
 #ifdef USE_CUDNN
@@ -57,9 +60,21 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
+    // Calibrated int8 layers run on the CAFFE engine, as do depthwise ones,
+    // which have their own kernel there.
+    const bool depthwise = conv_param.group() > 1 &&
+        conv_param.group() == conv_param.num_output();
+    if (engine == ConvolutionParameter_Engine_CAFFE &&
+        param.quantization_param().input_scale() == 0 && !depthwise &&
+        WinogradConvolutionLayer<Dtype>::IsSupported(conv_param)) {
+      engine = ConvolutionParameter_Engine_WINOGRAD;
+    }
   }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_WINOGRAD) {
+    return shared_ptr<Layer<Dtype> >(
+        new WinogradConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
@@ -287,6 +302,28 @@ shared_ptr<Layer<Dtype> > GetTanHLayer(const LayerParameter& param) {
 
 REGISTER_LAYER_CREATOR(TanH, GetTanHLayer);
 
+// Get LSTM layer according to engine.
+template <typename Dtype>
+shared_ptr<Layer<Dtype> > GetLSTMLayer(const LayerParameter& param) {
+  RecurrentParameter_Engine engine = param.recurrent_param().engine();
+  if (engine == RecurrentParameter_Engine_DEFAULT) {
+    engine = RecurrentParameter_Engine_UNROLLED;
+    if (Caffe::mode() == Caffe::CPU && !param.recurrent_param().debug_info()) {
+      engine = RecurrentParameter_Engine_FUSED;
+    }
+  }
+  if (engine == RecurrentParameter_Engine_UNROLLED) {
+    return shared_ptr<Layer<Dtype> >(new LSTMLayer<Dtype>(param));
+  } else if (engine == RecurrentParameter_Engine_FUSED) {
+    return shared_ptr<Layer<Dtype> >(new FusedLSTMLayer<Dtype>(param));
+  } else {
+    LOG(FATAL) << "Layer " << param.name() << " has unknown engine.";
+    throw;  // Avoids missing return warning
+  }
+}
+
+REGISTER_LAYER_CREATOR(LSTM, GetLSTMLayer);
+
 #ifdef WITH_PYTHON_LAYER
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPythonLayer(const LayerParameter& param) {
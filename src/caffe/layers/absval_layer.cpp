@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/absval_layer.hpp"
@@ -13,24 +14,29 @@ void AbsValLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     "allow in-place computation.";
 }
 
+namespace {
+
+template <typename Dtype>
+struct AbsValOp {
+  Dtype operator()(Dtype x) const { return std::abs(x); }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return x > 0 ? dy : (x < 0 ? -dy : Dtype(0));
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void AbsValLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const int count = top[0]->count();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  caffe_abs(count, bottom[0]->cpu_data(), top_data);
+  this->ForwardElementwise_cpu(AbsValOp<Dtype>(), bottom, top);
 }
 
 template <typename Dtype>
 void AbsValLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  const int count = top[0]->count();
-  const Dtype* top_diff = top[0]->cpu_diff();
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    caffe_cpu_sign(count, bottom_data, bottom_diff);
-    caffe_mul(count, bottom_diff, top_diff, bottom_diff);
+    this->BackwardElementwise_cpu(AbsValOp<Dtype>(), top, bottom);
   }
 }
 
@@ -252,17 +252,34 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     caffe_set(bias_multiplier_.count(), Dtype(1),
         bias_multiplier_.mutable_cpu_data());
   }
+  // Batch the CPU GEMMs of as many images as fit in the budget.
+  gemm_batch_ = 1;
+  const uint64_t batch_bytes =
+      this->layer_param_.convolution_param().batched_col_buffer_bytes();
+  if (batch_bytes > 0 && !reverse_dimensions()) {
+    const uint64_t image_bytes = sizeof(Dtype) * conv_out_spatial_dim_ *
+        (static_cast<uint64_t>(kernel_dim_) * group_ + conv_out_channels_);
+    gemm_batch_ = std::max<uint64_t>(1,
+        std::min<uint64_t>(num_, batch_bytes / image_bytes));
+  }
+  if (gemm_batch_ > 1) {
+    batch_col_buffer_.Reshape(vector<int>(1,
+        kernel_dim_ * group_ * gemm_batch_ * conv_out_spatial_dim_));
+    batch_output_buffer_.Reshape(vector<int>(1,
+        conv_out_channels_ * gemm_batch_ * conv_out_spatial_dim_));
+  }
 }
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col, int task) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    Dtype* task_col_buff = task_col_buffer(task);
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, task_col_buff);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = task_col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -282,10 +299,10 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+    const Dtype* weights, Dtype* input, int task) {
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    col_buff = task_col_buffer(task);
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -300,11 +317,12 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, int task) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    Dtype* task_col_buff = task_col_buffer(task);
+    conv_im2col_cpu(input, task_col_buff);
+    col_buff = task_col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -314,6 +332,83 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::reshape_col_buffers(int num_tasks) {
+  while (static_cast<int>(task_col_buffers_.size()) < num_tasks - 1) {
+    task_col_buffers_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  for (int i = 0; i < num_tasks - 1; ++i) {
+    task_col_buffers_[i]->ReshapeLike(col_buffer_);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    int batch, const Dtype* weights, Dtype* output) {
+  CHECK_LE(batch, gemm_batch_);
+  // Row r of the batch columns holds row r of the columns of each image.
+  const int batch_dim = batch * conv_out_spatial_dim_;
+  Dtype* batch_col_buff = batch_col_buffer_.mutable_cpu_data();
+  for (int n = 0; n < batch; ++n) {
+    const Dtype* col_buff = input + n * bottom_dim_;
+    if (!is_1x1_) {
+      conv_im2col_cpu(col_buff, col_buffer_.mutable_cpu_data());
+      col_buff = col_buffer_.cpu_data();
+    }
+    for (int r = 0; r < kernel_dim_ * group_; ++r) {
+      caffe_copy(conv_out_spatial_dim_, col_buff + r * conv_out_spatial_dim_,
+          batch_col_buff + r * batch_dim + n * conv_out_spatial_dim_);
+    }
+  }
+  Dtype* batch_output = batch_output_buffer_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, batch_dim, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        batch_col_buff + col_offset_ * batch * g,
+        (Dtype)0., batch_output + output_offset_ * batch * g);
+  }
+  for (int n = 0; n < batch; ++n) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          batch_output + c * batch_dim + n * conv_out_spatial_dim_,
+          output + n * top_dim_ + c * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batch(const Dtype* input,
+    int batch, const Dtype* output, Dtype* weights) {
+  CHECK_LE(batch, gemm_batch_);
+  const int batch_dim = batch * conv_out_spatial_dim_;
+  Dtype* batch_col_buff = batch_col_buffer_.mutable_cpu_data();
+  Dtype* batch_output = batch_output_buffer_.mutable_cpu_data();
+  for (int n = 0; n < batch; ++n) {
+    const Dtype* col_buff = input + n * bottom_dim_;
+    if (!is_1x1_) {
+      conv_im2col_cpu(col_buff, col_buffer_.mutable_cpu_data());
+      col_buff = col_buffer_.cpu_data();
+    }
+    for (int r = 0; r < kernel_dim_ * group_; ++r) {
+      caffe_copy(conv_out_spatial_dim_, col_buff + r * conv_out_spatial_dim_,
+          batch_col_buff + r * batch_dim + n * conv_out_spatial_dim_);
+    }
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          output + n * top_dim_ + c * conv_out_spatial_dim_,
+          batch_output + c * batch_dim + n * conv_out_spatial_dim_);
+    }
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
+        kernel_dim_, batch_dim,
+        (Dtype)1., batch_output + output_offset_ * batch * g,
+        batch_col_buff + col_offset_ * batch * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
     const Dtype* input) {
@@ -1,8 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -55,25 +59,33 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     CHECK_EQ(bottom[0]->shape(1), channels_);
   top[0]->ReshapeLike(*bottom[0]);
 
+  num_ = bottom[0]->shape(0);
+  spatial_dim_ = bottom[0]->count()/(channels_*num_);
   vector<int> sz;
   sz.push_back(channels_);
   mean_.Reshape(sz);
   variance_.Reshape(sz);
-  temp_.ReshapeLike(*bottom[0]);
+  inv_std_.Reshape(sz);
   x_norm_.ReshapeLike(*bottom[0]);
-  sz[0] = bottom[0]->shape(0);
+}
+
+// The BLAS formulation of the GPU path sums and broadcasts through temp_ and
+// the multipliers, which the CPU path does without.
+template <typename Dtype>
+void BatchNormLayer<Dtype>::reshape_gpu_buffers(const Blob<Dtype>& bottom) {
+  temp_.ReshapeLike(bottom);
+  vector<int> sz(1, num_);
   batch_sum_multiplier_.Reshape(sz);
 
-  int spatial_dim = bottom[0]->count()/(channels_*bottom[0]->shape(0));
   if (spatial_sum_multiplier_.num_axes() == 0 ||
-      spatial_sum_multiplier_.shape(0) != spatial_dim) {
-    sz[0] = spatial_dim;
+      spatial_sum_multiplier_.shape(0) != spatial_dim_) {
+    sz[0] = spatial_dim_;
     spatial_sum_multiplier_.Reshape(sz);
     Dtype* multiplier_data = spatial_sum_multiplier_.mutable_cpu_data();
     caffe_set(spatial_sum_multiplier_.count(), Dtype(1), multiplier_data);
   }
 
-  int numbychans = channels_*bottom[0]->shape(0);
+  int numbychans = channels_*num_;
   if (num_by_chans_.num_axes() == 0 ||
       num_by_chans_.shape(0) != numbychans) {
     sz[0] = numbychans;
@@ -86,54 +98,36 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  int num = bottom[0]->shape(0);
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
-
-  if (bottom[0] != top[0]) {
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
+  if (bottom[0]->channel_block() > 1) {
+    Forward_blocked_cpu(bottom, top);
+    return;
   }
-
+  Dtype* mean = mean_.mutable_cpu_data();
+  Dtype* variance = variance_.mutable_cpu_data();
+  Dtype* inv_std = inv_std_.mutable_cpu_data();
   if (use_global_stats_) {
     // use the stored mean/variance estimates.
     const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
         0 : 1 / this->blobs_[2]->cpu_data()[0];
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
+        this->blobs_[0]->cpu_data(), mean);
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
-  } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
+        this->blobs_[1]->cpu_data(), variance);
+    for (int c = 0; c < channels_; ++c) {
+      inv_std[c] = 1 / std::sqrt(variance[c] + eps_);
+    }
   }
-
-  // subtract mean
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, -1, num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., top_data);
+  // Only training needs the normalized input again, in Backward_cpu.
+  // TODO(cdoersch): The caching is only needed because later in-place layers
+  //                 might clobber the data.  Can we skip this if they won't?
+  Dtype* x_norm_data = use_global_stats_ ? NULL : x_norm_.mutable_cpu_data();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(), channels_);
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &BatchNormLayer<Dtype>::forward_cpu_task, this, bottom[0]->cpu_data(),
+      top[0]->mutable_cpu_data(), x_norm_data, mean, variance, inv_std,
+      num_tasks, _1));
 
   if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_sqr<Dtype>(top[0]->count(), top_data,
-                     temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
-
     // compute and save moving average
     this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
     this->blobs_[2]->mutable_cpu_data()[0] += 1;
@@ -145,100 +139,164 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         variance_.cpu_data(), moving_average_fraction_,
         this->blobs_[1]->mutable_cpu_data());
   }
+}
 
-  // normalize variance
+// Normalizes a range of channels, after computing their statistics unless
+// use_global_stats_. Each channel is num_ planes of spatial_dim_ values: the
+// mean and squared deviations of every plane are summed in two passes over
+// it, while it is in cache, and merged into those of the channel by the
+// update of Chan et al., which is Welford's for single values. Unlike
+// E(X^2) - E(X)^2 this does not cancel when the mean is large.
+template <typename Dtype>
+void BatchNormLayer<Dtype>::forward_cpu_task(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* x_norm_data, Dtype* mean, Dtype* variance,
+    Dtype* inv_std, int num_tasks, int task) {
+  const int begin = channels_ * task / num_tasks;
+  const int end = channels_ * (task + 1) / num_tasks;
+  const int plane_stride = channels_ * spatial_dim_;
+  for (int c = begin; c < end; ++c) {
+    const int offset = c * spatial_dim_;
+    if (!use_global_stats_) {
+      Dtype count = 0, channel_mean = 0, squares = 0;
+      for (int n = 0; n < num_; ++n) {
+        const Dtype* x = bottom_data + offset + n * plane_stride;
+        Dtype sum = 0;
+        for (int s = 0; s < spatial_dim_; ++s) {
+          sum += x[s];
+        }
+        const Dtype plane_mean = sum / spatial_dim_;
+        Dtype plane_squares = 0;
+        for (int s = 0; s < spatial_dim_; ++s) {
+          plane_squares += (x[s] - plane_mean) * (x[s] - plane_mean);
+        }
+        const Dtype delta = plane_mean - channel_mean;
+        const Dtype total = count + spatial_dim_;
+        channel_mean += delta * spatial_dim_ / total;
+        squares += plane_squares + delta * delta * count * spatial_dim_ / total;
+        count = total;
+      }
+      mean[c] = channel_mean;
+      variance[c] = squares / count;
+      inv_std[c] = 1 / std::sqrt(variance[c] + eps_);
+    }
+    const Dtype channel_mean = mean[c];
+    const Dtype scale = inv_std[c];
+    for (int n = 0; n < num_; ++n) {
+      const int plane = offset + n * plane_stride;
+      const Dtype* x = bottom_data + plane;
+      Dtype* y = top_data + plane;
+      for (int s = 0; s < spatial_dim_; ++s) {
+        y[s] = (x[s] - channel_mean) * scale;
+      }
+      if (x_norm_data) {
+        caffe_copy(spatial_dim_, y, x_norm_data + plane);
+      }
+    }
+  }
+}
+
+// Applies the stored statistics to a [N][C/b][H][W][b] bottom:
+// y = (x - mean_c) / sqrt(var_c + eps).
+template <typename Dtype>
+void BatchNormLayer<Dtype>::Forward_blocked_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK(use_global_stats_);
+  const int block = bottom[0]->channel_block();
+  CHECK_EQ(channels_ % block, 0);
+  const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
+      0 : 1 / this->blobs_[2]->cpu_data()[0];
+  caffe_cpu_scale(variance_.count(), scale_factor,
+      this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
+  caffe_cpu_scale(variance_.count(), scale_factor,
+      this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
   caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
   caffe_sqrt(variance_.count(), variance_.cpu_data(),
              variance_.mutable_cpu_data());
-
-  // replicate variance to input size
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), variance_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., temp_.mutable_cpu_data());
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
-  // TODO(cdoersch): The caching is only needed because later in-place layers
-  //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data,
-      x_norm_.mutable_cpu_data());
+  const Dtype* mean = mean_.cpu_data();
+  const Dtype* stddev = variance_.cpu_data();
+  vector<Dtype> inv_std(channels_);
+  for (int c = 0; c < channels_; ++c) {
+    inv_std[c] = Dtype(1) / stddev[c];
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int spatial_dim = bottom[0]->count(2);
+  for (int n = 0; n < bottom[0]->shape(0); ++n) {
+    for (int cb = 0; cb < channels_; cb += block) {
+      for (int s = 0; s < spatial_dim; ++s) {
+        for (int i = 0; i < block; ++i) {
+          *top_data++ = (*bottom_data++ - mean[cb + i]) * inv_std[cb + i];
+        }
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff;
-  if (bottom[0] != top[0]) {
-    top_diff = top[0]->cpu_diff();
-  } else {
-    caffe_copy(x_norm_.count(), top[0]->cpu_diff(), x_norm_.mutable_cpu_diff());
-    top_diff = x_norm_.cpu_diff();
-  }
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
-    return;
+  const Dtype* x_norm_data = use_global_stats_ ? NULL : x_norm_.cpu_data();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(), channels_);
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &BatchNormLayer<Dtype>::backward_cpu_task, this, top[0]->cpu_diff(),
+      x_norm_data, inv_std_.cpu_data(), bottom[0]->mutable_cpu_diff(),
+      num_tasks, _1));
+}
+
+// if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
+//
+// dE(Y)/dX =
+//   (dE/dY - mean(dE/dY) - mean(dE/dY \cdot Y) \cdot Y)
+//     ./ sqrt(var(X) + eps)
+//
+// where \cdot and ./ are hadamard product and elementwise division,
+// respectively, dE/dY is the top diff, and mean/var/sum are all computed
+// along all dimensions except the channels dimension.  Both sums of a channel
+// are taken in one pass, and the bottom diff written in a second; as each
+// value of it only depends on the top diff at the same place, this holds
+// in-place as well. With the stored statistics, dE(Y)/dX is
+// dE/dY ./ sqrt(var + eps).
+template <typename Dtype>
+void BatchNormLayer<Dtype>::backward_cpu_task(const Dtype* top_diff,
+    const Dtype* x_norm_data, const Dtype* inv_std, Dtype* bottom_diff,
+    int num_tasks, int task) {
+  const int begin = channels_ * task / num_tasks;
+  const int end = channels_ * (task + 1) / num_tasks;
+  const int plane_stride = channels_ * spatial_dim_;
+  for (int c = begin; c < end; ++c) {
+    const int offset = c * spatial_dim_;
+    const Dtype scale = inv_std[c];
+    if (use_global_stats_) {
+      for (int n = 0; n < num_; ++n) {
+        const int plane = offset + n * plane_stride;
+        caffe_cpu_scale(spatial_dim_, scale, top_diff + plane,
+            bottom_diff + plane);
+      }
+      continue;
+    }
+    Dtype diff_sum = 0, diff_dot = 0;
+    for (int n = 0; n < num_; ++n) {
+      const int plane = offset + n * plane_stride;
+      const Dtype* dy = top_diff + plane;
+      const Dtype* y = x_norm_data + plane;
+      for (int s = 0; s < spatial_dim_; ++s) {
+        diff_sum += dy[s];
+        diff_dot += dy[s] * y[s];
+      }
+    }
+    const Dtype diff_mean = diff_sum / (num_ * spatial_dim_);
+    const Dtype dot_mean = diff_dot / (num_ * spatial_dim_);
+    for (int n = 0; n < num_; ++n) {
+      const int plane = offset + n * plane_stride;
+      const Dtype* dy = top_diff + plane;
+      const Dtype* y = x_norm_data + plane;
+      Dtype* dx = bottom_diff + plane;
+      for (int s = 0; s < spatial_dim_; ++s) {
+        dx[s] = (dy[s] - diff_mean - dot_mean * y[s]) * scale;
+      }
+    }
   }
-  const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
-  // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
-  //
-  // dE(Y)/dX =
-  //   (dE/dY - mean(dE/dY) - mean(dE/dY \cdot Y) \cdot Y)
-  //     ./ sqrt(var(X) + eps)
-  //
-  // where \cdot and ./ are hadamard product and elementwise division,
-  // respectively, dE/dY is the top diff, and mean/var/sum are all computed
-  // along all dimensions except the channels dimension.  In the above
-  // equation, the operations allow for expansion (i.e. broadcast) along all
-  // dimensions except the channels dimension where required.
-
-  // sum(dE/dY \cdot Y)
-  caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      bottom_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-
-  // reshape (broadcast) the above
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., bottom_diff);
-
-  // sum(dE/dY \cdot Y) \cdot Y
-  caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      top_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-  // reshape (broadcast) the above to make
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num * channels_,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., bottom_diff);
-
-  // dE/dY - mean(dE/dY)-mean(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff,
-      Dtype(-1. / (num * spatial_dim)), bottom_diff);
-
-  // note: temp_ still contains sqrt(var(X)+eps), computed during the forward
-  // pass.
-  caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
 }
 
 
@@ -1,23 +1,34 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/bnll_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 
 namespace caffe {
 
 const float kBNLL_THRESHOLD = 50.;
 
+namespace {
+
+template <typename Dtype>
+struct BNLLOp {
+  // log(1 + exp(x)) = max(x, 0) + log(1 + exp(-|x|)), which cannot overflow.
+  Dtype operator()(Dtype x) const {
+    return std::max(x, Dtype(0)) + fast_log(Dtype(1) + fast_exp(-std::abs(x)));
+  }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    const Dtype expval = fast_exp(std::min(x, Dtype(kBNLL_THRESHOLD)));
+    return dy * expval / (expval + Dtype(1));
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void BNLLLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = bottom_data[i] > 0 ?
-        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
-        log(1. + exp(bottom_data[i]));
-  }
+  this->ForwardElementwise_cpu(BNLLOp<Dtype>(), bottom, top);
 }
 
 template <typename Dtype>
@@ -25,15 +36,7 @@ void BNLLLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
-    Dtype expval;
-    for (int i = 0; i < count; ++i) {
-      expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
-      bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
-    }
+    this->BackwardElementwise_cpu(BNLLOp<Dtype>(), top, bottom);
   }
 }
 
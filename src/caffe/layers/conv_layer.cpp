@@ -1,6 +1,13 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -21,19 +28,189 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::FuseBatchNorm(
+    const shared_ptr<Layer<Dtype> >& batch_norm,
+    const shared_ptr<Layer<Dtype> >& scale, bool relu, Dtype negative_slope) {
+  CHECK_EQ(batch_norm->blobs().size(), 3);
+  CHECK_EQ(batch_norm->blobs()[0]->count(), this->num_output_);
+  if (scale) {
+    CHECK_EQ(scale->blobs()[0]->count(), this->num_output_);
+  }
+  fused_batch_norm_ = batch_norm;
+  fused_scale_ = scale;
+  fused_relu_ = relu;
+  fused_negative_slope_ = negative_slope;
+  fused_sources_.clear();
+  fused_versions_.clear();
+}
+
+template <typename Dtype>
+const Dtype* ConvolutionLayer<Dtype>::forward_bias() const {
+  if (fused_batch_norm_) {
+    return fused_bias_.cpu_data();
+  }
+  return this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::update_fused_params() {
+  if (!fused_batch_norm_) {
+    return;
+  }
+  vector<Blob<Dtype>*> params;
+  params.push_back(this->blobs_[0].get());
+  if (this->bias_term_) {
+    params.push_back(this->blobs_[1].get());
+  }
+  for (int i = 0; i < 3; ++i) {
+    params.push_back(fused_batch_norm_->blobs()[i].get());
+  }
+  for (int i = 0; fused_scale_ && i < fused_scale_->blobs().size(); ++i) {
+    params.push_back(fused_scale_->blobs()[i].get());
+  }
+  bool changed = fused_sources_.size() != params.size();
+  for (int i = 0; i < params.size() && !changed; ++i) {
+    changed = fused_sources_[i] != params[i]->data() ||
+        fused_versions_[i] != params[i]->data()->version();
+  }
+  if (!changed) {
+    return;
+  }
+  // BatchNorm computes (x - mean) / sqrt(var + eps) from its stored sums,
+  // which Scale multiplies by gamma and offsets by beta: one multiplier and
+  // one offset per output channel, applied to the filters and bias.
+  const vector<shared_ptr<Blob<Dtype> > >& stats = fused_batch_norm_->blobs();
+  const Dtype scale_factor = stats[2]->cpu_data()[0] == 0 ?
+      0 : 1 / stats[2]->cpu_data()[0];
+  const Dtype eps = fused_batch_norm_->layer_param().batch_norm_param().eps();
+  const Dtype* mean = stats[0]->cpu_data();
+  const Dtype* variance = stats[1]->cpu_data();
+  const Dtype* gamma = fused_scale_ ? fused_scale_->blobs()[0]->cpu_data() :
+      NULL;
+  const Dtype* beta = fused_scale_ && fused_scale_->blobs().size() > 1 ?
+      fused_scale_->blobs()[1]->cpu_data() : NULL;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  fused_weights_.ReshapeLike(*this->blobs_[0]);
+  fused_bias_.Reshape(vector<int>(1, this->num_output_));
+  Dtype* fused_weight = fused_weights_.mutable_cpu_data();
+  Dtype* fused_bias = fused_bias_.mutable_cpu_data();
+  const int kernel_dim = this->blobs_[0]->count(1);
+  for (int o = 0; o < this->num_output_; ++o) {
+    Dtype multiplier =
+        1 / std::sqrt(variance[o] * scale_factor + eps);
+    Dtype offset = (bias ? bias[o] : Dtype(0)) - mean[o] * scale_factor;
+    if (gamma) {
+      multiplier *= gamma[o];
+    }
+    offset *= multiplier;
+    if (beta) {
+      offset += beta[o];
+    }
+    caffe_cpu_scale(kernel_dim, multiplier, weight + o * kernel_dim,
+        fused_weight + o * kernel_dim);
+    fused_bias[o] = offset;
+  }
+  fused_sources_.resize(params.size());
+  fused_versions_.resize(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    fused_sources_[i] = params[i]->data();
+    fused_versions_[i] = params[i]->data()->version();
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_fused(Dtype* output) const {
+  const Dtype* bias = fused_bias_.cpu_data();
+  const int spatial_dim = this->out_spatial_dim_;
+  for (int o = 0; o < this->num_output_; ++o) {
+    Dtype* channel = output + o * spatial_dim;
+    const Dtype offset = bias[o];
+    if (fused_relu_) {
+      for (int p = 0; p < spatial_dim; ++p) {
+        const Dtype x = channel[p] + offset;
+        channel[p] = x > 0 ? x : x * fused_negative_slope_;
+      }
+    } else {
+      for (int p = 0; p < spatial_dim; ++p) {
+        channel[p] += offset;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_relu(Dtype* data, int count) const {
+  if (!fused_relu_) {
+    return;
+  }
+  for (int i = 0; i < count; ++i) {
+    data[i] = data[i] > 0 ? data[i] : data[i] * fused_negative_slope_;
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* weight = this->blobs_[0]->cpu_data();
+  update_fused_params();
+  if (bottom[0]->channel_block() > 1) {
+    forward_blocked_cpu(bottom, top);
+    return;
+  }
+  if (int8_inference()) {
+    forward_int8_cpu(bottom, top);
+    return;
+  }
+  if (depthwise()) {
+    forward_depthwise_cpu(bottom, top);
+    return;
+  }
+  const bool sparse = sparse_inference() && sparse_weights_.Update(
+      forward_weights(), this->num_output_, false,
+      this->layer_param_.convolution_param().max_sparse_density());
+  // Batched GEMMs share one buffer and leave the threading to BLAS.
+  const int num_tasks = this->gemm_batch_ > 1 && !sparse ? 1 :
+      std::min(ThreadPool::Get().num_threads(), this->num_);
+  this->reshape_col_buffers(num_tasks);
+  // Bring the parameters to the CPU before the tasks read them.
+  forward_weights().cpu_data();
+  forward_bias();
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+    ThreadPool::Get().Run(num_tasks, boost::bind(
+        &ConvolutionLayer<Dtype>::forward_cpu_task, this,
+        bottom[i]->cpu_data(), top[i]->mutable_cpu_data(), sparse, num_tasks,
+        _1));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_task(const Dtype* bottom_data,
+      Dtype* top_data, bool sparse, int num_tasks, int task) {
+  const Dtype* weight = forward_weights().cpu_data();
+  const int begin = this->num_ * task / num_tasks;
+  const int end = this->num_ * (task + 1) / num_tasks;
+  const int gemm_batch = sparse ? 1 : this->gemm_batch_;
+  for (int n = begin; n < end; n += gemm_batch) {
+    const int batch = std::min(gemm_batch, end - n);
+    if (sparse) {
+      caffe_cpu_csr_gemm(this->num_output_, this->out_spatial_dim_,
+          sparse_weights_.row_offsets(), sparse_weights_.columns(),
+          sparse_weights_.values(), bottom_data + n * this->bottom_dim_,
           top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    } else if (gemm_batch > 1) {
+      this->forward_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+          batch, weight, top_data + n * this->top_dim_);
+    } else {
+      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+          top_data + n * this->top_dim_, false, task);
+    }
+    for (int b = n; b < n + batch; ++b) {
+      if (fused_batch_norm_) {
+        forward_cpu_fused(top_data + b * this->top_dim_);
+      } else if (this->bias_term_) {
+        this->forward_cpu_bias(top_data + b * this->top_dim_,
+            this->blobs_[1]->cpu_data());
       }
     }
   }
@@ -42,8 +219,12 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* weight = this->blobs_[0]->cpu_data();
+  this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const int weight_count = this->blobs_[0]->count();
+  const int num_tasks = this->gemm_batch_ > 1 ? 1 :
+      std::min(ThreadPool::Get().num_threads(), this->num_);
+  this->reshape_col_buffers(num_tasks);
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -55,20 +236,482 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
+    if (depthwise()) {
+      const int channel_tasks =
+          std::min(ThreadPool::Get().num_threads(), this->channels_);
+      if (this->param_propagate_down_[0] || propagate_down[i]) {
+        ThreadPool::Get().Run(channel_tasks, boost::bind(
+            &ConvolutionLayer<Dtype>::backward_depthwise_cpu_task, this,
+            top_diff, bottom_data, propagate_down[i] ? bottom_diff : NULL,
+            this->param_propagate_down_[0] ? weight_diff : NULL,
+            channel_tasks, _1));
+      }
+      continue;
+    }
+    // gradient w.r.t. weight, for gemm_batch_ images at a time.
+    if (this->param_propagate_down_[0] && this->gemm_batch_ > 1) {
+      for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+        this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            std::min(this->gemm_batch_, this->num_ - n),
+            top_diff + n * this->top_dim_, weight_diff);
+      }
+    }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
+      const bool weight_gradient =
+          this->param_propagate_down_[0] && this->gemm_batch_ == 1;
+      Dtype* task_weight_diffs = NULL;
+      if (weight_gradient && num_tasks > 1) {
+        task_weight_diffs_.Reshape(
+            vector<int>(1, (num_tasks - 1) * weight_count));
+        task_weight_diffs = task_weight_diffs_.mutable_cpu_data();
+      }
+      ThreadPool::Get().Run(num_tasks, boost::bind(
+          &ConvolutionLayer<Dtype>::backward_cpu_task, this, top_diff,
+          bottom_data, propagate_down[i] ? bottom_diff : NULL,
+          weight_gradient ? weight_diff : NULL, task_weight_diffs,
+          num_tasks, _1));
+      // Sum in task order, so the result does not depend on the scheduling.
+      for (int t = 1; t < num_tasks && weight_gradient; ++t) {
+        caffe_axpy(weight_count, Dtype(1),
+            task_weight_diffs + (t - 1) * weight_count, weight_diff);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_task(const Dtype* top_diff,
+      const Dtype* bottom_data, Dtype* bottom_diff, Dtype* weight_diff,
+      Dtype* task_weight_diffs, int num_tasks, int task) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  // The first task accumulates into the weight diff, the others into their
+  // own zeroed buffer.
+  if (weight_diff && task > 0) {
+    const int weight_count = this->blobs_[0]->count();
+    weight_diff = task_weight_diffs + (task - 1) * weight_count;
+    caffe_set(weight_count, Dtype(0), weight_diff);
+  }
+  const int begin = this->num_ * task / num_tasks;
+  const int end = this->num_ * (task + 1) / num_tasks;
+  for (int n = begin; n < end; ++n) {
+    // gradient w.r.t. weight. Note that we will accumulate diffs.
+    if (weight_diff) {
+      this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+          top_diff + n * this->top_dim_, weight_diff, task);
+    }
+    // gradient w.r.t. bottom data, if necessary.
+    if (bottom_diff) {
+      this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+          bottom_diff + n * this->bottom_dim_, task);
+    }
+  }
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::SupportsChannelBlock(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    const int channel_block) const {
+  if (this->num_spatial_axes_ != 2 || this->group_ != 1 ||
+      this->force_nd_im2col_ || int8_inference() ||
+      this->num_output_ % channel_block != 0 ||
+      !this->CanBlockChannels(bottom, channel_block)) {
+    return false;
+  }
+  const int* dilation_data = this->dilation_.cpu_data();
+  return dilation_data[0] == 1 && dilation_data[1] == 1;
+}
+
+template <typename Dtype>
+const Dtype* ConvolutionLayer<Dtype>::blocked_filters(int channel_block) {
+  const Blob<Dtype>& weights = forward_weights();
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (blocked_source_ == source && blocked_version_ == source->version() &&
+      blocked_block_ == channel_block) {
+    return blocked_filters_.cpu_data();
+  }
+  const int kernel_dim = weights.count(1);
+  blocked_filters_.ReshapeLike(weights);
+  const Dtype* weight = weights.cpu_data();
+  Dtype* blocked = blocked_filters_.mutable_cpu_data();
+  for (int o = 0; o < this->num_output_; ++o) {
+    const int ob = o / channel_block;
+    const int lane = o % channel_block;
+    for (int k = 0; k < kernel_dim; ++k) {
+      blocked[(ob * kernel_dim + k) * channel_block + lane] =
+          weight[o * kernel_dim + k];
+    }
+  }
+  blocked_source_ = source;
+  blocked_version_ = source->version();
+  blocked_block_ = channel_block;
+  return blocked_filters_.cpu_data();
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_blocked_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int block = bottom[0]->channel_block();
+  blocked_filters(block);
+  forward_bias();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(),
+      this->num_ * this->num_output_ / block);
+  for (int i = 0; i < bottom.size(); ++i) {
+    CHECK_EQ(bottom[i]->channel_block(), block);
+    ThreadPool::Get().Run(num_tasks, boost::bind(
+        &ConvolutionLayer<Dtype>::forward_blocked_cpu_task, this,
+        bottom[i]->cpu_data(), top[i]->mutable_cpu_data(), num_tasks, _1));
+  }
+}
+
+namespace {
+
+// Convolves the image block by block into the output block ob: every row of
+// the output accumulates B lanes of output channels per column, so the
+// innermost loop is over the B contiguous filters of an input tap.
+template <typename Dtype, int B>
+void conv_blocked_cpu(const Dtype* input, int channels, int height, int width,
+    int kernel_h, int kernel_w, int pad_h, int pad_w, int stride_h,
+    int stride_w, const Dtype* filters, const Dtype* bias, int out_height,
+    int out_width, Dtype* output) {
+  for (int oh = 0; oh < out_height; ++oh) {
+    Dtype* out_row = output + oh * out_width * B;
+    for (int ow = 0; ow < out_width; ++ow) {
+      for (int l = 0; l < B; ++l) {
+        out_row[ow * B + l] = bias ? bias[l] : Dtype(0);
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* in_plane = input + (c / B) * height * width * B + c % B;
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        const int ih = oh * stride_h - pad_h + kh;
+        if (ih < 0 || ih >= height) {
+          continue;
+        }
+        const Dtype* in_row = in_plane + ih * width * B;
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const Dtype* w = filters + ((c * kernel_h + kh) * kernel_w + kw) * B;
+          // The columns whose tap falls inside the image.
+          const int offset = kw - pad_w;
+          const int ow_begin = offset >= 0 ? 0 :
+              (-offset + stride_w - 1) / stride_w;
+          const int ow_end = std::min(out_width,
+              (width - offset + stride_w - 1) / stride_w);
+          for (int ow = ow_begin; ow < ow_end; ++ow) {
+            const Dtype x = in_row[(ow * stride_w + offset) * B];
+            Dtype* out = out_row + ow * B;
+            for (int l = 0; l < B; ++l) {
+              out[l] += x * w[l];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_blocked_cpu_task(
+    const Dtype* bottom_data, Dtype* top_data, int num_tasks, int task) {
+  const int block = blocked_block_;
+  const int out_blocks = this->num_output_ / block;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int out_height = this->output_shape_[0];
+  const int out_width = this->output_shape_[1];
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const Dtype* filters = blocked_filters_.cpu_data();
+  const Dtype* bias = forward_bias();
+  const int total = this->num_ * out_blocks;
+  const int begin = total * task / num_tasks;
+  const int end = total * (task + 1) / num_tasks;
+  for (int i = begin; i < end; ++i) {
+    const int n = i / out_blocks;
+    const int ob = i % out_blocks;
+    const Dtype* input = bottom_data + n * this->bottom_dim_;
+    const Dtype* block_filters = filters + ob * kernel_dim * block;
+    const Dtype* block_bias = bias ? bias + ob * block : NULL;
+    Dtype* output = top_data + n * this->top_dim_ +
+        ob * out_height * out_width * block;
+    switch (block) {
+    case 8:
+      conv_blocked_cpu<Dtype, 8>(input, this->channels_, height, width,
+          kernel_shape_data[0], kernel_shape_data[1], pad_data[0], pad_data[1],
+          stride_data[0], stride_data[1], block_filters, block_bias,
+          out_height, out_width, output);
+      break;
+    case 16:
+      conv_blocked_cpu<Dtype, 16>(input, this->channels_, height, width,
+          kernel_shape_data[0], kernel_shape_data[1], pad_data[0], pad_data[1],
+          stride_data[0], stride_data[1], block_filters, block_bias,
+          out_height, out_width, output);
+      break;
+    default:
+      LOG(FATAL) << "Unsupported channel block " << block;
+    }
+    forward_cpu_relu(output, out_height * out_width * block);
+  }
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::depthwise() const {
+  return this->num_spatial_axes_ == 2 && !this->force_nd_im2col_ &&
+      this->group_ > 1 && this->group_ == this->channels_ &&
+      this->group_ == this->num_output_;
+}
+
+namespace {
+
+// The outputs ow in [*begin, *end) of a row whose input column
+// ow * stride + offset falls inside the width.
+inline void depthwise_columns(int offset, int stride, int width,
+    int out_width, int* begin, int* end) {
+  *begin = offset >= 0 ? 0 : (-offset + stride - 1) / stride;
+  *end = std::min(out_width, (width - offset + stride - 1) / stride);
+}
+
+// Convolves one channel with its filter into the output plane, which starts
+// at the bias; the innermost loops run along the output row, over
+// contiguous inputs when the stride is 1.
+template <typename Dtype>
+void depthwise_forward_plane(const Dtype* input, int height, int width,
+    const Dtype* filter, int kernel_h, int kernel_w, int pad_h, int pad_w,
+    int stride_h, int stride_w, int dilation_h, int dilation_w, Dtype bias,
+    int out_height, int out_width, Dtype* output) {
+  for (int oh = 0; oh < out_height; ++oh) {
+    Dtype* out_row = output + oh * out_width;
+    for (int ow = 0; ow < out_width; ++ow) {
+      out_row[ow] = bias;
+    }
+    for (int kh = 0; kh < kernel_h; ++kh) {
+      const int ih = oh * stride_h - pad_h + kh * dilation_h;
+      if (ih < 0 || ih >= height) {
+        continue;
+      }
+      const Dtype* in_row = input + ih * width;
+      for (int kw = 0; kw < kernel_w; ++kw) {
+        const Dtype w = filter[kh * kernel_w + kw];
+        const int offset = kw * dilation_w - pad_w;
+        int begin, end;
+        depthwise_columns(offset, stride_w, width, out_width, &begin, &end);
+        if (stride_w == 1) {
+          const Dtype* in = in_row + offset;
+          for (int ow = begin; ow < end; ++ow) {
+            out_row[ow] += w * in[ow];
+          }
+        } else {
+          for (int ow = begin; ow < end; ++ow) {
+            out_row[ow] += w * in_row[ow * stride_w + offset];
+          }
         }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
+      }
+    }
+  }
+}
+
+// Adds the gradients w.r.t. one input channel to input_diff, if not NULL,
+// and w.r.t. its filter to filter_diff, if not NULL.
+template <typename Dtype>
+void depthwise_backward_plane(const Dtype* output_diff, const Dtype* input,
+    int height, int width, const Dtype* filter, int kernel_h, int kernel_w,
+    int pad_h, int pad_w, int stride_h, int stride_w, int dilation_h,
+    int dilation_w, int out_height, int out_width, Dtype* input_diff,
+    Dtype* filter_diff) {
+  for (int kh = 0; kh < kernel_h; ++kh) {
+    for (int kw = 0; kw < kernel_w; ++kw) {
+      const Dtype w = filter[kh * kernel_w + kw];
+      const int offset = kw * dilation_w - pad_w;
+      int begin, end;
+      depthwise_columns(offset, stride_w, width, out_width, &begin, &end);
+      Dtype w_diff = 0;
+      for (int oh = 0; oh < out_height; ++oh) {
+        const int ih = oh * stride_h - pad_h + kh * dilation_h;
+        if (ih < 0 || ih >= height) {
+          continue;
+        }
+        const Dtype* out_row = output_diff + oh * out_width;
+        if (filter_diff) {
+          const Dtype* in_row = input + ih * width;
+          for (int ow = begin; ow < end; ++ow) {
+            w_diff += out_row[ow] * in_row[ow * stride_w + offset];
+          }
+        }
+        if (input_diff) {
+          Dtype* in_row = input_diff + ih * width;
+          for (int ow = begin; ow < end; ++ow) {
+            in_row[ow * stride_w + offset] += w * out_row[ow];
+          }
         }
       }
+      if (filter_diff) {
+        filter_diff[kh * kernel_w + kw] += w_diff;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_depthwise_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  forward_weights().cpu_data();
+  forward_bias();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(),
+      this->num_ * this->channels_);
+  for (int i = 0; i < bottom.size(); ++i) {
+    ThreadPool::Get().Run(num_tasks, boost::bind(
+        &ConvolutionLayer<Dtype>::forward_depthwise_cpu_task, this,
+        bottom[i]->cpu_data(), top[i]->mutable_cpu_data(), num_tasks, _1));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_depthwise_cpu_task(
+    const Dtype* bottom_data, Dtype* top_data, int num_tasks, int task) {
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  const int out_height = this->output_shape_[0];
+  const int out_width = this->output_shape_[1];
+  const int filter_dim = kernel_shape_data[0] * kernel_shape_data[1];
+  const Dtype* weight = forward_weights().cpu_data();
+  const Dtype* bias = forward_bias();
+  const int total = this->num_ * this->channels_;
+  const int begin = total * task / num_tasks;
+  const int end = total * (task + 1) / num_tasks;
+  for (int i = begin; i < end; ++i) {
+    const int c = i % this->channels_;
+    Dtype* output = top_data + i * out_height * out_width;
+    depthwise_forward_plane(bottom_data + i * height * width, height, width,
+        weight + c * filter_dim, kernel_shape_data[0], kernel_shape_data[1],
+        pad_data[0], pad_data[1], stride_data[0], stride_data[1],
+        dilation_data[0], dilation_data[1], bias ? bias[c] : Dtype(0),
+        out_height, out_width, output);
+    forward_cpu_relu(output, out_height * out_width);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_depthwise_cpu_task(
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    Dtype* weight_diff, int num_tasks, int task) {
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  const int out_height = this->output_shape_[0];
+  const int out_width = this->output_shape_[1];
+  const int filter_dim = kernel_shape_data[0] * kernel_shape_data[1];
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const int begin = this->channels_ * task / num_tasks;
+  const int end = this->channels_ * (task + 1) / num_tasks;
+  for (int n = 0; n < this->num_; ++n) {
+    for (int c = begin; c < end; ++c) {
+      const int plane = n * this->channels_ + c;
+      Dtype* input_diff = NULL;
+      if (bottom_diff) {
+        input_diff = bottom_diff + plane * height * width;
+        caffe_set(height * width, Dtype(0), input_diff);
+      }
+      depthwise_backward_plane(top_diff + plane * out_height * out_width,
+          bottom_data + plane * height * width, height, width,
+          weight + c * filter_dim, kernel_shape_data[0],
+          kernel_shape_data[1], pad_data[0], pad_data[1], stride_data[0],
+          stride_data[1], dilation_data[0], dilation_data[1], out_height,
+          out_width, input_diff, weight_diff ? weight_diff + c * filter_dim :
+          NULL);
+    }
+  }
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::sparse_inference() const {
+  return this->phase_ == TEST && this->is_1x1_ && this->group_ == 1;
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::int8_inference() const {
+  return this->phase_ == TEST && this->num_spatial_axes_ == 2 &&
+      !this->force_nd_im2col_ &&
+      this->layer_param_.quantization_param().input_scale() > 0;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_int8_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  quantized_weights_.Update(forward_weights(), this->num_output_, false);
+  forward_bias();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(), this->num_);
+  const int rows_dim = this->blobs_[0]->count(1) * this->group_;
+  const int task_bytes =
+      this->bottom_dim_ + this->out_spatial_dim_ * rows_dim;
+  int8_t* buffer = static_cast<int8_t*>(
+      int8_buffer(&int8_buffer_, num_tasks * task_bytes));
+  int8_sums_.Reshape(vector<int>(1, num_tasks * this->top_dim_));
+  int* sums = int8_sums_.mutable_cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    ThreadPool::Get().Run(num_tasks, boost::bind(
+        &ConvolutionLayer<Dtype>::forward_int8_cpu_task, this,
+        bottom[i]->cpu_data(), top[i]->mutable_cpu_data(), buffer, sums,
+        num_tasks, _1));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_int8_cpu_task(const Dtype* bottom_data,
+    Dtype* top_data, int8_t* buffer, int* sums, int num_tasks, int task) {
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int rows_dim = kernel_dim * this->group_;
+  const int spatial_dim = this->out_spatial_dim_;
+  const int group_outputs = this->num_output_ / this->group_;
+  int8_t* image = buffer +
+      task * (this->bottom_dim_ + spatial_dim * rows_dim);
+  int8_t* rows = image + this->bottom_dim_;
+  sums += task * this->top_dim_;
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  const Dtype input_scale =
+      this->layer_param_.quantization_param().input_scale();
+  const int8_t* weights = quantized_weights_.data();
+  const Dtype* weight_scales = quantized_weights_.scales();
+  const Dtype* bias = forward_bias();
+  const int begin = this->num_ * task / num_tasks;
+  const int end = this->num_ * (task + 1) / num_tasks;
+  for (int n = begin; n < end; ++n) {
+    caffe_cpu_quantize(this->bottom_dim_, 1 / input_scale,
+        bottom_data + n * this->bottom_dim_, image);
+    im2row_s8(image, this->channels_, this->input_shape(1),
+        this->input_shape(2), kernel_shape_data[0], kernel_shape_data[1],
+        pad_data[0], pad_data[1], stride_data[0], stride_data[1],
+        dilation_data[0], dilation_data[1], this->output_shape_[0],
+        this->output_shape_[1], rows);
+    for (int g = 0; g < this->group_; ++g) {
+      caffe_cpu_gemm_s8(group_outputs, spatial_dim, kernel_dim,
+          weights + g * group_outputs * kernel_dim, kernel_dim,
+          rows + g * kernel_dim, rows_dim,
+          sums + g * group_outputs * spatial_dim, spatial_dim);
+    }
+    Dtype* output = top_data + n * this->top_dim_;
+    for (int o = 0; o < this->num_output_; ++o) {
+      const Dtype scale = weight_scales[o] * input_scale;
+      const Dtype offset = bias ? bias[o] : Dtype(0);
+      for (int p = o * spatial_dim; p < (o + 1) * spatial_dim; ++p) {
+        output[p] = sums[p] * scale + offset;
+      }
     }
+    forward_cpu_relu(output, this->top_dim_);
   }
 }
 
@@ -75,6 +75,20 @@ void CropLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     src_strides_.mutable_cpu_data()[i] = bottom[0]->count(i + 1, input_dim);
     dest_strides_.mutable_cpu_data()[i] = top[0]->count(i + 1, input_dim);
   }
+  // The crop is contiguous in the bottom if it keeps all of the axes after
+  // the last one it crops, and a single item along those before it.
+  int last_cropped = input_dim - 1;
+  while (last_cropped >= 0 &&
+      new_shape[last_cropped] == bottom[0]->shape(last_cropped)) {
+    --last_cropped;
+  }
+  view_offset_ = -1;
+  if (this->top_views_ &&
+      (last_cropped < 0 || top[0]->count(0, last_cropped) == 1)) {
+    view_offset_ = bottom[0]->offset(
+        vector<int>(offset_data, offset_data + input_dim));
+    top[0]->ShareView(*bottom[0], view_offset_);
+  }
 }
 
 template <typename Dtype>
@@ -121,6 +135,7 @@ void CropLayer<Dtype>::crop_copy(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void CropLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (view_offset_ >= 0) { return; }
   std::vector<int> indices(top[0]->num_axes(), 0);
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
@@ -134,7 +149,13 @@ void CropLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
 
-  if (propagate_down[0]) {
+  if (propagate_down[0] && view_offset_ >= 0) {
+    // The top diff is in place; the rest of the bottom gets no gradient.
+    const int view_end = view_offset_ + top[0]->count();
+    caffe_set(view_offset_, static_cast<Dtype>(0), bottom_diff);
+    caffe_set(bottom[0]->count() - view_end, static_cast<Dtype>(0),
+        bottom_diff + view_end);
+  } else if (propagate_down[0]) {
     caffe_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     std::vector<int> indices(top[0]->num_axes(), 0);
     crop_copy(bottom, top, offsets.cpu_data(), indices, 0, top_diff,
@@ -51,6 +51,7 @@ __global__ void crop_kernel_backward(const int nthreads,
 template <typename Dtype>
 void CropLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (view_offset_ >= 0) { return; }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   int n = top[0]->count();
@@ -70,7 +71,12 @@ void CropLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
   int n = top[0]->count();
 
-  if (propagate_down[0]) {
+  if (propagate_down[0] && view_offset_ >= 0) {
+    const int view_end = view_offset_ + n;
+    caffe_gpu_set(view_offset_, static_cast<Dtype>(0), bottom_diff);
+    caffe_gpu_set(bottom[0]->count() - view_end, static_cast<Dtype>(0),
+        bottom_diff + view_end);
+  } else if (propagate_down[0]) {
     caffe_gpu_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     // NOLINT_NEXT_LINE(whitespace/operators)
     crop_kernel_backward<<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(n,
@@ -2,20 +2,32 @@
 #include <vector>
 
 #include "caffe/layers/elu_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 
 namespace caffe {
 
+namespace {
+
+template <typename Dtype>
+struct ELUOp {
+  explicit ELUOp(Dtype alpha) : alpha(alpha) {}
+  Dtype operator()(Dtype x) const {
+    return std::max(x, Dtype(0))
+        + alpha * (fast_exp(std::min(x, Dtype(0))) - Dtype(1));
+  }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return x > 0 ? dy : dy * (alpha + y);
+  }
+  Dtype alpha;
+};
+
+}  // namespace
+
 template <typename Dtype>
 void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
   Dtype alpha = this->layer_param_.elu_param().alpha();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
-  }
+  this->ForwardElementwise_cpu(ELUOp<Dtype>(alpha), bottom, top);
 }
 
 template <typename Dtype>
@@ -23,16 +35,8 @@ void ELULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    const Dtype* top_data = top[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
     Dtype alpha = this->layer_param_.elu_param().alpha();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + (alpha + top_data[i]) * (bottom_data[i] <= 0));
-    }
+    this->BackwardElementwise_cpu(ELUOp<Dtype>(alpha), top, bottom);
   }
 }
 
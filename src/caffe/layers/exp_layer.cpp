@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/exp_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -27,35 +28,37 @@ void ExpLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
      ( (base != Dtype(-1)) ? pow(base, input_shift) : exp(input_shift) );
 }
 
+namespace {
+
 template <typename Dtype>
-void ExpLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  const int count = bottom[0]->count();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  if (inner_scale_ == Dtype(1)) {
-    caffe_exp(count, bottom_data, top_data);
-  } else {
-    caffe_cpu_scale(count, inner_scale_, bottom_data, top_data);
-    caffe_exp(count, top_data, top_data);
+struct ExpOp {
+  ExpOp(Dtype inner_scale, Dtype outer_scale)
+      : inner_scale(inner_scale), outer_scale(outer_scale) {}
+  Dtype operator()(Dtype x) const {
+    return outer_scale * fast_exp(inner_scale * x);
   }
-  if (outer_scale_ != Dtype(1)) {
-    caffe_scal(count, outer_scale_, top_data);
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return dy * y * inner_scale;
   }
+  Dtype inner_scale;
+  Dtype outer_scale;
+};
+
+}  // namespace
+
+template <typename Dtype>
+void ExpLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  this->ForwardElementwise_cpu(ExpOp<Dtype>(inner_scale_, outer_scale_),
+      bottom, top);
 }
 
 template <typename Dtype>
 void ExpLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
-  const int count = bottom[0]->count();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* top_diff = top[0]->cpu_diff();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  caffe_mul(count, top_data, top_diff, bottom_diff);
-  if (inner_scale_ != Dtype(1)) {
-    caffe_scal(count, inner_scale_, bottom_diff);
-  }
+  this->BackwardElementwise_cpu(ExpOp<Dtype>(inner_scale_, outer_scale_),
+      top, bottom);
 }
 
 #ifdef CPU_ONLY
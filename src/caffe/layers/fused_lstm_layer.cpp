@@ -0,0 +1,365 @@
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/fused_lstm_layer.hpp"
+#include "caffe/util/fast_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// One timestep of LSTMUnitLayer over num streams: turns the gate inputs into
+// the gates (i, f, o, g), in place, and computes c_t and h_t.
+template <typename Dtype>
+static void lstm_gates_forward(const int num, const int dim,
+    const Dtype* cont, const Dtype* c_prev, Dtype* gates, Dtype* c,
+    Dtype* h) {
+  for (int n = 0; n < num; ++n) {
+    Dtype* i = gates;
+    Dtype* f = gates + dim;
+    Dtype* o = gates + 2 * dim;
+    Dtype* g = gates + 3 * dim;
+    const Dtype cont_n = cont[n];
+    for (int d = 0; d < dim; ++d) {
+      i[d] = fast_sigmoid(i[d]);
+      f[d] = cont_n * fast_sigmoid(f[d]);
+      o[d] = fast_sigmoid(o[d]);
+      g[d] = fast_tanh(g[d]);
+      c[d] = f[d] * c_prev[d] + i[d] * g[d];
+      h[d] = o[d] * fast_tanh(c[d]);
+    }
+    gates += 4 * dim;
+    c_prev += dim;
+    c += dim;
+    h += dim;
+  }
+}
+
+// The gradient of lstm_gates_forward w.r.t. the gate inputs and c_{t-1},
+// given those w.r.t. h_t (h_diff and h_next_diff, from the top and from
+// timestep t + 1) and c_t (c_diff, overwritten with that w.r.t. c_{t-1}).
+template <typename Dtype>
+static void lstm_gates_backward(const int num, const int dim,
+    const Dtype* c_prev, const Dtype* gates, const Dtype* c,
+    const Dtype* h_diff, const Dtype* h_next_diff, Dtype* c_diff,
+    Dtype* gates_diff) {
+  for (int n = 0; n < num; ++n) {
+    const Dtype* i = gates;
+    const Dtype* f = gates + dim;
+    const Dtype* o = gates + 2 * dim;
+    const Dtype* g = gates + 3 * dim;
+    for (int d = 0; d < dim; ++d) {
+      const Dtype tanh_c = fast_tanh(c[d]);
+      const Dtype h_term_diff = h_diff[d] + h_next_diff[d];
+      const Dtype c_term_diff =
+          c_diff[d] + h_term_diff * o[d] * (1 - tanh_c * tanh_c);
+      c_diff[d] = c_term_diff * f[d];
+      gates_diff[d] = c_term_diff * g[d] * i[d] * (1 - i[d]);
+      gates_diff[dim + d] = c_term_diff * c_prev[d] * f[d] * (1 - f[d]);
+      gates_diff[2 * dim + d] = h_term_diff * tanh_c * o[d] * (1 - o[d]);
+      gates_diff[3 * dim + d] = c_term_diff * i[d] * (1 - g[d] * g[d]);
+    }
+    gates += 4 * dim;
+    gates_diff += 4 * dim;
+    c_prev += dim;
+    c += dim;
+    h_diff += dim;
+    h_next_diff += dim;
+    c_diff += dim;
+  }
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const RecurrentParameter& param = this->layer_param_.recurrent_param();
+  hidden_dim_ = param.num_output();
+  CHECK_GT(hidden_dim_, 0) << "num_output must be positive";
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  T_ = bottom[0]->shape(0);
+  N_ = bottom[0]->shape(1);
+  input_dim_ = bottom[0]->count(2);
+  LOG(INFO) << "Initializing fused LSTM layer: assuming input batch contains "
+            << T_ << " timesteps of " << N_ << " independent streams.";
+  expose_hidden_ = param.expose_hidden();
+  static_input_ = (bottom.size() > 2 + 2 * expose_hidden_);
+  if (static_input_) {
+    CHECK_GE(bottom[2]->num_axes(), 1);
+    CHECK_EQ(N_, bottom[2]->shape(0));
+  }
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    // W_xc, b_c, W_xc_static and W_hc, shaped and filled in the order of
+    // the InnerProduct layers of LSTMLayer's unrolled net.
+    this->blobs_.resize(3 + static_input_);
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(param.weight_filler()));
+    shared_ptr<Filler<Dtype> > bias_filler(
+        GetFiller<Dtype>(param.bias_filler()));
+    vector<int> weight_shape(2);
+    weight_shape[0] = 4 * hidden_dim_;
+    weight_shape[1] = input_dim_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[0].get());
+    vector<int> bias_shape(1, 4 * hidden_dim_);
+    this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+    bias_filler->Fill(this->blobs_[1].get());
+    if (static_input_) {
+      weight_shape[1] = bottom[2]->count(1);
+      this->blobs_[2].reset(new Blob<Dtype>(weight_shape));
+      weight_filler->Fill(this->blobs_[2].get());
+    }
+    weight_shape[1] = hidden_dim_;
+    this->blobs_[2 + static_input_].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[2 + static_input_].get());
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  T_ = bottom[0]->shape(0);
+  N_ = bottom[0]->shape(1);
+  CHECK_EQ(input_dim_, bottom[0]->count(2)) << "input size changed";
+  CHECK_EQ(bottom[1]->num_axes(), 2)
+      << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+  CHECK_EQ(T_, bottom[1]->shape(0));
+  CHECK_EQ(N_, bottom[1]->shape(1));
+  if (static_input_) {
+    CHECK_EQ(N_, bottom[2]->shape(0));
+    CHECK_EQ(this->blobs_[2]->shape(1), bottom[2]->count(1))
+        << "static input size changed";
+  }
+  vector<int> state_shape(3);
+  state_shape[0] = 1;
+  state_shape[1] = N_;
+  state_shape[2] = hidden_dim_;
+  if (expose_hidden_) {
+    for (int i = 2 + static_input_; i < bottom.size(); ++i) {
+      CHECK(bottom[i]->shape() == state_shape)
+          << "shape mismatch - bottom[" << i << "]: "
+          << bottom[i]->shape_string();
+    }
+    top[1]->Reshape(state_shape);
+    top[2]->Reshape(state_shape);
+  }
+  h_0_.Reshape(state_shape);
+  c_0_.Reshape(state_shape);
+  h_T_.Reshape(state_shape);
+  c_T_.Reshape(state_shape);
+  h_prev_diff_.Reshape(state_shape);
+  c_prev_diff_.Reshape(state_shape);
+  state_shape[0] = T_;
+  top[0]->Reshape(state_shape);
+  cell_.Reshape(state_shape);
+  hidden_conted_.Reshape(state_shape);
+  state_shape[2] = 4 * hidden_dim_;
+  gates_.Reshape(state_shape);
+  if (static_input_) {
+    state_shape.erase(state_shape.begin());
+    static_gates_.Reshape(state_shape);
+  }
+  vector<int> bias_multiplier_shape(1, T_ * N_);
+  bias_multiplier_.Reshape(bias_multiplier_shape);
+  caffe_set(T_ * N_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Reset() {
+  caffe_set(h_T_.count(), Dtype(0), h_T_.mutable_cpu_data());
+  caffe_set(c_T_.count(), Dtype(0), c_T_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::ForwardStreams(const vector<int>& streams,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(1 + static_input_, bottom.size());
+  CHECK_EQ(1, top.size());
+  CHECK_GE(bottom[0]->num_axes(), 2);
+  CHECK_EQ(streams.size(), bottom[0]->shape(1));
+  const int num_timesteps = bottom[0]->shape(0);
+  // Run the layer as with expose_hidden, from and to the stream states.
+  vector<int> state_shape(3);
+  state_shape[0] = 1;
+  state_shape[1] = streams.size();
+  state_shape[2] = hidden_dim_;
+  vector<Blob<Dtype>*> stream_bottom(1, bottom[0]);
+  stream_bottom.push_back(&stream_cont_);
+  if (static_input_) {
+    stream_bottom.push_back(bottom[1]);
+  }
+  vector<Blob<Dtype>*> stream_top(top);
+  vector<Blob<Dtype>*> states_in, states_out;
+  for (int i = 0; i < 2; ++i) {
+    stream_states_[i].Reshape(state_shape);
+    states_in.push_back(&stream_states_[i]);
+    states_out.push_back(&stream_states_[2 + i]);
+  }
+  stream_bottom.insert(stream_bottom.end(), states_in.begin(),
+      states_in.end());
+  stream_top.insert(stream_top.end(), states_out.begin(), states_out.end());
+  this->streams_.Load(streams, num_timesteps, states_in, &stream_cont_);
+  const bool expose_hidden = expose_hidden_;
+  expose_hidden_ = true;
+  this->Forward(stream_bottom, stream_top);
+  expose_hidden_ = expose_hidden;
+  this->streams_.Store(streams, num_timesteps, states_out);
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int dim = hidden_dim_;
+  const int gate_dim = 4 * hidden_dim_;
+  const int state_count = N_ * dim;
+  const Dtype* weight_x = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->blobs_[1]->cpu_data();
+  const Dtype* weight_h = this->blobs_[2 + static_input_]->cpu_data();
+  // Without expose_hidden, the sequences continue from the last timestep of
+  // the previous forward pass.
+  if (!expose_hidden_) {
+    caffe_copy(state_count, h_T_.cpu_data(), h_0_.mutable_cpu_data());
+    caffe_copy(state_count, c_T_.cpu_data(), c_0_.mutable_cpu_data());
+  }
+  const Dtype* h_0 = expose_hidden_ ?
+      bottom[2 + static_input_]->cpu_data() : h_0_.cpu_data();
+  const Dtype* c_0 = expose_hidden_ ?
+      bottom[3 + static_input_]->cpu_data() : c_0_.cpu_data();
+
+  // The gate inputs from x (and x_static) for all the timesteps at once.
+  Dtype* gates = gates_.mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T_ * N_, gate_dim,
+      input_dim_, (Dtype)1., bottom[0]->cpu_data(), weight_x, (Dtype)0.,
+      gates);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T_ * N_, gate_dim, 1,
+      (Dtype)1., bias_multiplier_.cpu_data(), bias, (Dtype)1., gates);
+  if (static_input_) {
+    Dtype* static_gates = static_gates_.mutable_cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N_, gate_dim,
+        bottom[2]->count(1), (Dtype)1., bottom[2]->cpu_data(),
+        this->blobs_[2]->cpu_data(), (Dtype)0., static_gates);
+    for (int t = 0; t < T_; ++t) {
+      caffe_axpy(N_ * gate_dim, Dtype(1), static_gates,
+          gates + t * N_ * gate_dim);
+    }
+  }
+
+  // The recurrence: h_conted_{t-1} := cont_t * h_{t-1}, then
+  // gate_input_t += W_hc * h_conted_{t-1}, then the gates, c_t and h_t.
+  const Dtype* cont = bottom[1]->cpu_data();
+  Dtype* h = top[0]->mutable_cpu_data();
+  Dtype* c = cell_.mutable_cpu_data();
+  Dtype* h_conted = hidden_conted_.mutable_cpu_data();
+  for (int t = 0; t < T_; ++t) {
+    const Dtype* h_prev = t ? h + (t - 1) * state_count : h_0;
+    const Dtype* c_prev = t ? c + (t - 1) * state_count : c_0;
+    Dtype* h_conted_t = h_conted + t * state_count;
+    for (int n = 0; n < N_; ++n) {
+      caffe_cpu_scale(dim, cont[t * N_ + n], h_prev + n * dim,
+          h_conted_t + n * dim);
+    }
+    Dtype* gates_t = gates + t * N_ * gate_dim;
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N_, gate_dim, dim,
+        (Dtype)1., h_conted_t, weight_h, (Dtype)1., gates_t);
+    lstm_gates_forward(N_, dim, cont + t * N_, c_prev, gates_t,
+        c + t * state_count, h + t * state_count);
+  }
+  caffe_copy(state_count, h + (T_ - 1) * state_count, h_T_.mutable_cpu_data());
+  caffe_copy(state_count, c + (T_ - 1) * state_count, c_T_.mutable_cpu_data());
+  if (expose_hidden_) {
+    caffe_copy(state_count, h_T_.cpu_data(), top[1]->mutable_cpu_data());
+    caffe_copy(state_count, c_T_.cpu_data(), top[2]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
+  const int dim = hidden_dim_;
+  const int gate_dim = 4 * hidden_dim_;
+  const int state_count = N_ * dim;
+  const int weight_h_index = 2 + static_input_;
+  const Dtype* weight_h = this->blobs_[weight_h_index]->cpu_data();
+  const Dtype* c_0 = expose_hidden_ ?
+      bottom[3 + static_input_]->cpu_data() : c_0_.cpu_data();
+
+  // The recurrence, from the last timestep back to the first. As in
+  // LSTMLayer, nothing flows in from beyond the last timestep, nor out to
+  // the initial state.
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* gates = gates_.cpu_data();
+  const Dtype* c = cell_.cpu_data();
+  Dtype* gates_diff = gates_.mutable_cpu_diff();
+  Dtype* h_prev_diff = h_prev_diff_.mutable_cpu_data();
+  Dtype* c_prev_diff = c_prev_diff_.mutable_cpu_data();
+  caffe_set(state_count, Dtype(0), h_prev_diff);
+  caffe_set(state_count, Dtype(0), c_prev_diff);
+  for (int t = T_ - 1; t >= 0; --t) {
+    const Dtype* c_prev = t ? c + (t - 1) * state_count : c_0;
+    Dtype* gates_diff_t = gates_diff + t * N_ * gate_dim;
+    lstm_gates_backward(N_, dim, c_prev, gates + t * N_ * gate_dim,
+        c + t * state_count, top_diff + t * state_count, h_prev_diff,
+        c_prev_diff, gates_diff_t);
+    if (t == 0) { break; }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N_, dim, gate_dim,
+        (Dtype)1., gates_diff_t, weight_h, (Dtype)0., h_prev_diff);
+    for (int n = 0; n < N_; ++n) {
+      caffe_scal(dim, cont[t * N_ + n], h_prev_diff + n * dim);
+    }
+  }
+
+  // The gradients w.r.t. the weights and the inputs, for all the timesteps
+  // at once.
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, input_dim_,
+        T_ * N_, (Dtype)1., gates_diff, bottom_data, (Dtype)1.,
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[1]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T_ * N_, gate_dim, (Dtype)1.,
+        gates_diff, bias_multiplier_.cpu_data(), (Dtype)1.,
+        this->blobs_[1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[weight_h_index]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, dim, T_ * N_,
+        (Dtype)1., gates_diff, hidden_conted_.cpu_data(), (Dtype)1.,
+        this->blobs_[weight_h_index]->mutable_cpu_diff());
+  }
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T_ * N_, input_dim_,
+        gate_dim, (Dtype)1., gates_diff, this->blobs_[0]->cpu_data(),
+        (Dtype)0., bottom[0]->mutable_cpu_diff());
+  }
+  if (static_input_ &&
+      (this->param_propagate_down_[2] || propagate_down[2])) {
+    // x_static feeds every timestep: sum their gradients first.
+    const int static_dim = bottom[2]->count(1);
+    Dtype* static_gates_diff = static_gates_.mutable_cpu_diff();
+    caffe_copy(N_ * gate_dim, gates_diff, static_gates_diff);
+    for (int t = 1; t < T_; ++t) {
+      caffe_axpy(N_ * gate_dim, Dtype(1), gates_diff + t * N_ * gate_dim,
+          static_gates_diff);
+    }
+    if (this->param_propagate_down_[2]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, static_dim,
+          N_, (Dtype)1., static_gates_diff, bottom[2]->cpu_data(), (Dtype)1.,
+          this->blobs_[2]->mutable_cpu_diff());
+    }
+    if (propagate_down[2]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N_, static_dim,
+          gate_dim, (Dtype)1., static_gates_diff, this->blobs_[2]->cpu_data(),
+          (Dtype)0., bottom[2]->mutable_cpu_diff());
+    }
+  }
+}
+
+INSTANTIATE_CLASS(FusedLSTMLayer);
+
+}  // namespace caffe
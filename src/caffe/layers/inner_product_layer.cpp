@@ -1,8 +1,13 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -83,6 +88,25 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (this->phase_ == TEST &&
+      this->layer_param_.quantization_param().input_scale() > 0) {
+    forward_int8_cpu(bottom, top);
+    return;
+  }
+  if (this->phase_ == TEST && sparse_weights_.Update(*this->blobs_[0], N_,
+      transpose_,
+      this->layer_param_.inner_product_param().max_sparse_density())) {
+    forward_sparse_cpu(bottom, top);
+    return;
+  }
+  if (this->phase_ == TEST && is_half_storage(this->param_storage(0))) {
+    forward_half_cpu(bottom, top);
+    return;
+  }
+  if (this->phase_ == TEST && PackedWeights<Dtype>::Suits(M_)) {
+    forward_packed_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
@@ -96,6 +120,160 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_int8_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  quantized_weights_.Update(*this->blobs_[0], N_, transpose_);
+  const Dtype input_scale =
+      this->layer_param_.quantization_param().input_scale();
+  int8_t* bottom_data = static_cast<int8_t*>(
+      int8_buffer(&int8_buffer_, M_ * K_));
+  caffe_cpu_quantize(M_ * K_, 1 / input_scale, bottom[0]->cpu_data(),
+      bottom_data);
+  int8_sums_.Reshape(vector<int>(1, M_ * N_));
+  int* sums = int8_sums_.mutable_cpu_data();
+  // At least four outputs per task, for the four-row kernel of the GEMM.
+  const int num_tasks =
+      std::max(1, std::min(ThreadPool::Get().num_threads(), N_ / 4));
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &InnerProductLayer<Dtype>::forward_int8_cpu_task, this, bottom_data,
+      sums, num_tasks, _1));
+  const Dtype* weight_scales = quantized_weights_.scales();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int m = 0; m < M_; ++m) {
+    for (int n = 0; n < N_; ++n) {
+      top_data[m * N_ + n] = sums[m * N_ + n] * weight_scales[n] *
+          input_scale + (bias ? bias[n] : Dtype(0));
+    }
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_int8_cpu_task(
+    const int8_t* bottom_data, int* sums, int num_tasks, int task) {
+  const int begin = N_ * task / num_tasks;
+  const int end = N_ * (task + 1) / num_tasks;
+  caffe_cpu_gemm_s8(M_, end - begin, K_, bottom_data, K_,
+      quantized_weights_.data() + begin * K_, K_, sums + begin, N_);
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_sparse_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  // At least four outputs per task, as for int8.
+  const int num_tasks =
+      std::max(1, std::min(ThreadPool::Get().num_threads(), N_ / 4));
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &InnerProductLayer<Dtype>::forward_sparse_cpu_task, this,
+      bottom[0]->cpu_data(), top_data, num_tasks, _1));
+  if (bias_term_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
+        bias_multiplier_.cpu_data(),
+        this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_sparse_cpu_task(
+    const Dtype* bottom_data, Dtype* top_data, int num_tasks, int task) {
+  const int begin = N_ * task / num_tasks;
+  const int end = N_ * (task + 1) / num_tasks;
+  caffe_cpu_gemm_csr_t(M_, end - begin, K_, bottom_data,
+      sparse_weights_.row_offsets() + begin, sparse_weights_.columns(),
+      sparse_weights_.values(), top_data + begin, N_);
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_packed_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  packed_weights_.Update(*this->blobs_[0], N_, transpose_, M_);
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(),
+      packed_weights_.blocks());
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &InnerProductLayer<Dtype>::forward_packed_cpu_task, this,
+      bottom[0]->cpu_data(), top_data, num_tasks, _1));
+  if (bias_term_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
+        bias_multiplier_.cpu_data(),
+        this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_packed_cpu_task(
+    const Dtype* bottom_data, Dtype* top_data, int num_tasks, int task) {
+  const int blocks = packed_weights_.blocks();
+  packed_weights_.gemm_nt(M_, bottom_data, top_data,
+      blocks * task / num_tasks, blocks * (task + 1) / num_tasks);
+}
+
+// The number of weights widened at a time by forward_half_cpu.
+const int kHalfBlockSize = 1 << 15;
+
+// Widens the 16-bit copy of the weights back into their blob, once freed by
+// forward_half_cpu (see SyncedMemory::ReleaseCpuData).
+template <typename Dtype, StorageType storage>
+static void restore_half_weights(const void* half, void* data, size_t size) {
+  caffe_cpu_from_half(storage, size / sizeof(Dtype),
+      static_cast<const uint16_t*>(half), static_cast<Dtype*>(data));
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_half_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const StorageType storage = this->param_storage(0);
+  const shared_ptr<SyncedMemory>& source = this->blobs_[0]->data();
+  if (half_source_ != source || half_version_ != source->version()) {
+    half_weights_.reset(new SyncedMemory(K_ * N_ * sizeof(uint16_t)));
+    caffe_cpu_to_half(storage, K_ * N_, this->blobs_[0]->cpu_data(),
+        static_cast<uint16_t*>(half_weights_->mutable_cpu_data()));
+    half_source_ = source;
+    half_version_ = source->version();
+  }
+  // Free the Dtype weights unless a blob other than blobs_[0] holds them,
+  // besides the caches of the layer.
+  const int caches = 1 + (sparse_weights_.source() == source);
+  if (source.use_count() == 1 + caches) {
+    source->ReleaseCpuData(half_weights_, storage == FLOAT16 ?
+        &restore_half_weights<Dtype, FLOAT16> :
+        &restore_half_weights<Dtype, BFLOAT16>);
+  }
+  const uint16_t* weights =
+      static_cast<const uint16_t*>(half_weights_->cpu_data());
+  const int block_outputs = std::min(N_, std::max(1, kHalfBlockSize / K_));
+  half_block_.Reshape(vector<int>(1, block_outputs * K_));
+  half_output_.Reshape(vector<int>(1, M_ * block_outputs));
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int begin = 0; begin < N_; begin += block_outputs) {
+    const int outputs = std::min(block_outputs, N_ - begin);
+    // Widen the weights of the block: outputs x K_, or K_ x outputs if
+    // transposed.
+    Dtype* block = half_block_.mutable_cpu_data();
+    if (transpose_) {
+      for (int k = 0; k < K_; ++k) {
+        caffe_cpu_from_half(storage, outputs, weights + k * N_ + begin,
+            block + k * outputs);
+      }
+    } else {
+      caffe_cpu_from_half(storage, outputs * K_, weights + begin * K_, block);
+    }
+    Dtype* output = half_output_.mutable_cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, outputs, K_, (Dtype)1., bottom_data, block, (Dtype)0., output);
+    for (int m = 0; m < M_; ++m) {
+      for (int n = 0; n < outputs; ++n) {
+        top_data[m * N_ + begin + n] = output[m * outputs + n] +
+            (bias ? bias[begin + n] : Dtype(0));
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
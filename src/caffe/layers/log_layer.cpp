@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/log_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -30,49 +31,41 @@ void LogLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   backward_num_scale_ = input_scale_ / log_base;
 }
 
+namespace {
+
 template <typename Dtype>
-void LogLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  const int count = bottom[0]->count();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  if (input_scale_ == Dtype(1) && input_shift_ == Dtype(0)) {
-    caffe_log(count, bottom_data, top_data);
-  } else {
-    caffe_copy(count, bottom_data, top_data);
-    if (input_scale_ != Dtype(1)) {
-      caffe_scal(count, input_scale_, top_data);
-    }
-    if (input_shift_ != Dtype(0)) {
-      caffe_add_scalar(count, input_shift_, top_data);
-    }
-    caffe_log(count, top_data, top_data);
+struct LogOp {
+  LogOp(Dtype input_scale, Dtype input_shift, Dtype base_scale,
+      Dtype backward_num_scale)
+      : input_scale(input_scale), input_shift(input_shift),
+        base_scale(base_scale), backward_num_scale(backward_num_scale) {}
+  Dtype operator()(Dtype x) const {
+    return base_scale * fast_log(input_shift + input_scale * x);
   }
-  if (base_scale_ != Dtype(1)) {
-    caffe_scal(count, base_scale_, top_data);
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return dy * backward_num_scale / (input_shift + input_scale * x);
   }
+  Dtype input_scale;
+  Dtype input_shift;
+  Dtype base_scale;
+  Dtype backward_num_scale;
+};
+
+}  // namespace
+
+template <typename Dtype>
+void LogLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  this->ForwardElementwise_cpu(LogOp<Dtype>(input_scale_, input_shift_,
+      base_scale_, backward_num_scale_), bottom, top);
 }
 
 template <typename Dtype>
 void LogLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) { return; }
-  const int count = bottom[0]->count();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* top_diff = top[0]->cpu_diff();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  caffe_copy(count, bottom_data, bottom_diff);
-  if (input_scale_ != Dtype(1)) {
-    caffe_scal(count, input_scale_, bottom_diff);
-  }
-  if (input_shift_ != Dtype(0)) {
-    caffe_add_scalar(count, input_shift_, bottom_diff);
-  }
-  caffe_powx(count, bottom_diff, Dtype(-1), bottom_diff);
-  if (backward_num_scale_ != Dtype(1)) {
-    caffe_scal(count, backward_num_scale_, bottom_diff);
-  }
-  caffe_mul(count, top_diff, bottom_diff, bottom_diff);
+  this->BackwardElementwise_cpu(LogOp<Dtype>(input_scale_, input_shift_,
+      base_scale_, backward_num_scale_), top, bottom);
 }
 
 #ifdef CPU_ONLY
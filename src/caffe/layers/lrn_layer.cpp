@@ -1,10 +1,18 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+// The pixels of a channel the cross channel forward pass works on at once.
+const int kLRNTile = 256;
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -107,48 +115,77 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+  // The tasks split the images into tiles of kLRNTile pixels.
+  const int tiles = (height_ * width_ + kLRNTile - 1) / kLRNTile;
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(),
+      num_ * tiles);
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &LRNLayer<Dtype>::cross_channel_forward_cpu_task, this,
+      bottom[0]->cpu_data(), top[0]->mutable_cpu_data(),
+      scale_.mutable_cpu_data(), num_tasks, _1));
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::cross_channel_forward_cpu_task(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* scale_data, int num_tasks, int task) {
+  const int spatial_dim = height_ * width_;
+  const int tiles = (spatial_dim + kLRNTile - 1) / kLRNTile;
+  const int begin = num_ * tiles * task / num_tasks;
+  const int end = num_ * tiles * (task + 1) / num_tasks;
+  const Dtype alpha_over_size = alpha_ / size_;
+  const bool beta_three_quarters = beta_ == Dtype(0.75);
+  // The sum of the squares over the window of the current channel.
+  Dtype sum[kLRNTile];
+  for (int item = begin; item < end; ++item) {
+    const int n = item / tiles;
+    const int offset = (item % tiles) * kLRNTile;
+    const int length = std::min(kLRNTile, spatial_dim - offset);
+    const int image_offset = n * channels_ * spatial_dim + offset;
+    const Dtype* in = bottom_data + image_offset;
+    Dtype* out = top_data + image_offset;
+    Dtype* scale = scale_data + image_offset;
+    // The window of channel c is [c - pre_pad_, c + size_ - 1 - pre_pad_];
+    // start it with the channels before the head of channel 0.
+    caffe_set(length, Dtype(0), sum);
+    for (int c = 0; c < std::min(size_ - 1 - pre_pad_, channels_); ++c) {
+      const Dtype* x = in + c * spatial_dim;
+      for (int i = 0; i < length; ++i) {
+        sum[i] += x[i] * x[i];
+      }
     }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+    for (int c = 0; c < channels_; ++c) {
+      const int head = c + size_ - 1 - pre_pad_;
+      if (head < channels_) {
+        const Dtype* x = in + head * spatial_dim;
+        for (int i = 0; i < length; ++i) {
+          sum[i] += x[i] * x[i];
+        }
+      }
+      const int tail = c - pre_pad_ - 1;
+      if (tail >= 0) {
+        const Dtype* x = in + tail * spatial_dim;
+        for (int i = 0; i < length; ++i) {
+          sum[i] -= x[i] * x[i];
+        }
+      }
+      const Dtype* x = in + c * spatial_dim;
+      Dtype* y = out + c * spatial_dim;
+      Dtype* s = scale + c * spatial_dim;
+      for (int i = 0; i < length; ++i) {
+        s[i] = k_ + alpha_over_size * sum[i];
+      }
+      if (beta_three_quarters) {
+        // s^-0.75 = 1 / sqrt(s * sqrt(s)), which vectorizes unlike pow.
+        for (int i = 0; i < length; ++i) {
+          y[i] = x[i] / std::sqrt(s[i] * std::sqrt(s[i]));
+        }
+      } else {
+        for (int i = 0; i < length; ++i) {
+          y[i] = x[i] * std::pow(s[i], -beta_);
+        }
+      }
     }
   }
-
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
 }
 
 template <typename Dtype>
@@ -1,9 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -81,6 +84,7 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
       << "corresponding to (num, channels, height, width)";
+  num_ = bottom[0]->num();
   channels_ = bottom[0]->channels();
   height_ = bottom[0]->height();
   width_ = bottom[0]->width();
@@ -135,107 +139,292 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+namespace {
+
+// The geometry of the pooling windows over one channel.
+struct PoolShape {
+  int height, width;
+  int pooled_height, pooled_width;
+  int kernel_h, kernel_w;
+  int stride_h, stride_w;
+  int pad_h, pad_w;
+};
+
+// Max pools one channel. K and S, when not 0, are the kernel size and stride
+// of both axes; the windows inside the image then run fully unrolled. The
+// output, the mask and the top mask are each skipped when NULL.
+template <typename Dtype, int K, int S>
+void max_pool_plane(const PoolShape& p, const Dtype* in, Dtype* out,
+    int* mask, Dtype* top_mask) {
+  const int kernel_h = K ? K : p.kernel_h;
+  const int kernel_w = K ? K : p.kernel_w;
+  const int stride_h = S ? S : p.stride_h;
+  const int stride_w = S ? S : p.stride_w;
+  const bool use_mask = mask || top_mask;
+  for (int ph = 0; ph < p.pooled_height; ++ph) {
+    for (int pw = 0; pw < p.pooled_width; ++pw) {
+      int hstart = ph * stride_h - p.pad_h;
+      int wstart = pw * stride_w - p.pad_w;
+      const int hend = min(hstart + kernel_h, p.height);
+      const int wend = min(wstart + kernel_w, p.width);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      Dtype value = -FLT_MAX;
+      int index = -1;
+      if (K && !use_mask && hend - hstart == K && wend - wstart == K) {
+        const Dtype* window = in + hstart * p.width + wstart;
+        for (int h = 0; h < K; ++h) {
+          for (int w = 0; w < K; ++w) {
+            value = max(value, window[h * p.width + w]);
+          }
+        }
+      } else {
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int i = h * p.width + w;
+            if (in[i] > value) {
+              value = in[i];
+              index = i;
+            }
+          }
+        }
+      }
+      const int pool_index = ph * p.pooled_width + pw;
+      if (out) {
+        out[pool_index] = value;
+      }
+      if (mask) {
+        mask[pool_index] = index;
+      }
+      if (top_mask) {
+        top_mask[pool_index] = static_cast<Dtype>(index);
+      }
+    }
+  }
+}
+
+// Average pools one channel; the windows count the padding they overlap.
+template <typename Dtype, int K, int S>
+void ave_pool_plane(const PoolShape& p, const Dtype* in, Dtype* out) {
+  const int kernel_h = K ? K : p.kernel_h;
+  const int kernel_w = K ? K : p.kernel_w;
+  const int stride_h = S ? S : p.stride_h;
+  const int stride_w = S ? S : p.stride_w;
+  for (int ph = 0; ph < p.pooled_height; ++ph) {
+    for (int pw = 0; pw < p.pooled_width; ++pw) {
+      int hstart = ph * stride_h - p.pad_h;
+      int wstart = pw * stride_w - p.pad_w;
+      int hend = min(hstart + kernel_h, p.height + p.pad_h);
+      int wend = min(wstart + kernel_w, p.width + p.pad_w);
+      const int pool_size = (hend - hstart) * (wend - wstart);
+      Dtype sum = 0;
+      if (K && hstart >= 0 && wstart >= 0 &&
+          hstart + K <= p.height && wstart + K <= p.width) {
+        const Dtype* window = in + hstart * p.width + wstart;
+        for (int h = 0; h < K; ++h) {
+          for (int w = 0; w < K; ++w) {
+            sum += window[h * p.width + w];
+          }
+        }
+      } else {
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, p.height);
+        wend = min(wend, p.width);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            sum += in[h * p.width + w];
+          }
+        }
+      }
+      out[ph * p.pooled_width + pw] = sum / pool_size;
+    }
+  }
+}
+
+// Global pooling reduces the whole channel, which is contiguous.
+template <typename Dtype>
+void global_max_pool_plane(int size, const Dtype* in, Dtype* out, int* mask,
+    Dtype* top_mask) {
+  Dtype value = -FLT_MAX;
+  int index = -1;
+  if (!mask && !top_mask) {
+    for (int i = 0; i < size; ++i) {
+      value = max(value, in[i]);
+    }
+  } else {
+    for (int i = 0; i < size; ++i) {
+      if (in[i] > value) {
+        value = in[i];
+        index = i;
+      }
+    }
+  }
+  if (out) {
+    out[0] = value;
+  }
+  if (mask) {
+    mask[0] = index;
+  }
+  if (top_mask) {
+    top_mask[0] = static_cast<Dtype>(index);
+  }
+}
+
+template <typename Dtype>
+void global_ave_pool_plane(int size, const Dtype* in, Dtype* out) {
+  Dtype sum = 0;
+  for (int i = 0; i < size; ++i) {
+    sum += in[i];
+  }
+  out[0] = sum / size;
+}
+
+}  // namespace
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
-  // We'll output the mask to top[1] if it's of size >1.
-  const bool use_top_mask = top.size() > 1;
-  int* mask = NULL;  // suppress warnings about uninitialized variables
+  if (bottom[0]->channel_block() > 1) {
+    Forward_blocked_cpu(bottom, top);
+    return;
+  }
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  if (pool == PoolingParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  }
+  CHECK(pool == PoolingParameter_PoolMethod_MAX ||
+        pool == PoolingParameter_PoolMethod_AVE) << "Unknown pooling method.";
+  // We'll output the mask to top[1] if it's of size >1. Otherwise max pooling
+  // keeps its own mask for the backward pass, which is not needed in TEST;
+  // should a backward pass come anyway, it rebuilds the mask first.
+  int* mask = NULL;
   Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
-  switch (this->layer_param_.pooling_param().pool()) {
-  case PoolingParameter_PoolMethod_MAX:
-    // Initialize
-    if (use_top_mask) {
+  mask_skipped_ = false;
+  if (pool == PoolingParameter_PoolMethod_MAX) {
+    if (top.size() > 1) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
-    } else {
+    } else if (this->phase_ == TRAIN) {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
+    } else {
+      mask_skipped_ = true;
     }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+  }
+  const int num_planes = bottom[0]->num() * channels_;
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(), num_planes);
+  ThreadPool::Get().Run(num_tasks, boost::bind(
+      &PoolingLayer<Dtype>::forward_cpu_task, this, bottom[0]->cpu_data(),
+      top[0]->mutable_cpu_data(), mask, top_mask, num_tasks, _1));
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_task(const Dtype* bottom_data,
+    Dtype* top_data, int* mask, Dtype* top_mask, int num_tasks, int task) {
+  PoolShape p;
+  p.height = height_;
+  p.width = width_;
+  p.pooled_height = pooled_height_;
+  p.pooled_width = pooled_width_;
+  p.kernel_h = kernel_h_;
+  p.kernel_w = kernel_w_;
+  p.stride_h = stride_h_;
+  p.stride_w = stride_w_;
+  p.pad_h = pad_h_;
+  p.pad_w = pad_w_;
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const bool global = global_pooling_ ||
+      (kernel_h_ == height_ && kernel_w_ == width_ && pad_h_ == 0 &&
+       pad_w_ == 0 && pooled_height_ == 1 && pooled_width_ == 1);
+  const bool square = kernel_h_ == kernel_w_ && stride_h_ == stride_w_;
+  const int kernel = square && stride_h_ == 2 &&
+      (kernel_h_ == 2 || kernel_h_ == 3) ? kernel_h_ : 0;
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
+  const int num_planes = num_ * channels_;
+  const int begin = num_planes * task / num_tasks;
+  const int end = num_planes * (task + 1) / num_tasks;
+  for (int i = begin; i < end; ++i) {
+    const Dtype* in = bottom_data + i * bottom_dim;
+    Dtype* out = top_data ? top_data + i * top_dim : NULL;
+    int* plane_mask = mask ? mask + i * top_dim : NULL;
+    Dtype* plane_top_mask = top_mask ? top_mask + i * top_dim : NULL;
+    if (max_pool) {
+      if (global) {
+        global_max_pool_plane(bottom_dim, in, out, plane_mask,
+            plane_top_mask);
+      } else if (kernel == 2) {
+        max_pool_plane<Dtype, 2, 2>(p, in, out, plane_mask, plane_top_mask);
+      } else if (kernel == 3) {
+        max_pool_plane<Dtype, 3, 2>(p, in, out, plane_mask, plane_top_mask);
+      } else {
+        max_pool_plane<Dtype, 0, 0>(p, in, out, plane_mask, plane_top_mask);
+      }
+    } else {
+      if (global) {
+        global_ave_pool_plane(bottom_dim, in, out);
+      } else if (kernel == 2) {
+        ave_pool_plane<Dtype, 2, 2>(p, in, out);
+      } else if (kernel == 3) {
+        ave_pool_plane<Dtype, 3, 2>(p, in, out);
+      } else {
+        ave_pool_plane<Dtype, 0, 0>(p, in, out);
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
+  }
+}
+
+// Pools a [N][C/b][H][W][b] bottom into a top of the same layout.  The
+// windows are the same as in Forward_cpu; the innermost loop runs over the
+// b channels of a block, which are contiguous.
+template <typename Dtype>
+void PoolingLayer<Dtype>::Forward_blocked_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int block = bottom[0]->channel_block();
+  CHECK_EQ(channels_ % block, 0);
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const int num_blocks = bottom[0]->num() * channels_ / block;
+  const int bottom_block_size = height_ * width_ * block;
+  const int top_block_size = pooled_height_ * pooled_width_ * block;
+  for (int nb = 0; nb < num_blocks; ++nb) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        Dtype* out = top_data + (ph * pooled_width_ + pw) * block;
+        caffe_set(block, max_pool ? Dtype(-FLT_MAX) : Dtype(0), out);
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype* in = bottom_data + (h * width_ + w) * block;
+            if (max_pool) {
+              for (int i = 0; i < block; ++i) {
+                out[i] = max(out[i], in[i]);
+              }
+            } else {
+              for (int i = 0; i < block; ++i) {
+                out[i] += in[i];
               }
             }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+        if (!max_pool) {
+          caffe_scal(block, Dtype(1) / pool_size, out);
+        }
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
-    break;
-  default:
-    LOG(FATAL) << "Unknown pooling method.";
+    bottom_data += bottom_block_size;
+    top_data += top_block_size;
   }
 }
 
@@ -260,6 +449,18 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
     } else {
+      if (mask_skipped_) {
+        // Forward_cpu skipped the mask in TEST; rebuild it without touching
+        // the top, which in-place layers may have changed since.
+        const int num_tasks = std::min(ThreadPool::Get().num_threads(),
+            bottom[0]->num() * channels_);
+        ThreadPool::Get().Run(num_tasks, boost::bind(
+            &PoolingLayer<Dtype>::forward_cpu_task, this,
+            bottom[0]->cpu_data(), static_cast<Dtype*>(NULL),
+            max_idx_.mutable_cpu_data(), static_cast<Dtype*>(NULL),
+            num_tasks, _1));
+        mask_skipped_ = false;
+      }
       mask = max_idx_.cpu_data();
     }
     for (int n = 0; n < top[0]->num(); ++n) {
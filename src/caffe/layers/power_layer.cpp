@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/power_layer.hpp"
@@ -15,7 +16,48 @@ void PowerLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   diff_scale_ = power_  * scale_;
 }
 
-// Compute y = (shift + scale * x)^power
+namespace {
+
+// y = (shift + scale * x)^power, for the powers with cheap forms and the
+// rest.
+template <typename Dtype>
+struct AffineOp {
+  AffineOp(Dtype scale, Dtype shift) : scale(scale), shift(shift) {}
+  Dtype operator()(Dtype x) const { return shift + scale * x; }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const { return dy * scale; }
+  Dtype scale;
+  Dtype shift;
+};
+
+template <typename Dtype>
+struct SquareOp : public AffineOp<Dtype> {
+  SquareOp(Dtype scale, Dtype shift) : AffineOp<Dtype>(scale, shift) {}
+  Dtype operator()(Dtype x) const {
+    const Dtype v = this->shift + this->scale * x;
+    return v * v;
+  }
+};
+
+template <typename Dtype>
+struct SqrtOp : public AffineOp<Dtype> {
+  SqrtOp(Dtype scale, Dtype shift) : AffineOp<Dtype>(scale, shift) {}
+  Dtype operator()(Dtype x) const {
+    return std::sqrt(this->shift + this->scale * x);
+  }
+};
+
+template <typename Dtype>
+struct PowOp : public AffineOp<Dtype> {
+  PowOp(Dtype scale, Dtype shift, Dtype power)
+      : AffineOp<Dtype>(scale, shift), power(power) {}
+  Dtype operator()(Dtype x) const {
+    return std::pow(this->shift + this->scale * x, power);
+  }
+  Dtype power;
+};
+
+}  // namespace
+
 template <typename Dtype>
 void PowerLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -27,16 +69,15 @@ void PowerLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     caffe_set(count, value, top_data);
     return;
   }
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  caffe_copy(count, bottom_data, top_data);
-  if (scale_ != Dtype(1)) {
-    caffe_scal(count, scale_, top_data);
-  }
-  if (shift_ != Dtype(0)) {
-    caffe_add_scalar(count, shift_, top_data);
-  }
-  if (power_ != Dtype(1)) {
-    caffe_powx(count, top_data, power_, top_data);
+  if (power_ == Dtype(1)) {
+    this->ForwardElementwise_cpu(AffineOp<Dtype>(scale_, shift_), bottom, top);
+  } else if (power_ == Dtype(2)) {
+    this->ForwardElementwise_cpu(SquareOp<Dtype>(scale_, shift_), bottom, top);
+  } else if (power_ == Dtype(0.5)) {
+    this->ForwardElementwise_cpu(SqrtOp<Dtype>(scale_, shift_), bottom, top);
+  } else {
+    this->ForwardElementwise_cpu(PowOp<Dtype>(scale_, shift_, power_),
+        bottom, top);
   }
 }
 
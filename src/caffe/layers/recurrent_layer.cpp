@@ -10,6 +10,96 @@
 
 namespace caffe {
 
+template <typename Dtype>
+int RecurrentStreamStates<Dtype>::Open() {
+  int stream;
+  if (free_streams_.size()) {
+    stream = free_streams_.back();
+    free_streams_.pop_back();
+  } else {
+    stream = positions_.size();
+    positions_.push_back(-1);
+    states_.push_back(vector<Dtype>());
+  }
+  positions_[stream] = 0;
+  return stream;
+}
+
+template <typename Dtype>
+void RecurrentStreamStates<Dtype>::Close(const int stream) {
+  CheckOpen(stream);
+  positions_[stream] = -1;
+  vector<Dtype>().swap(states_[stream]);
+  free_streams_.push_back(stream);
+}
+
+template <typename Dtype>
+int RecurrentStreamStates<Dtype>::position(const int stream) const {
+  CheckOpen(stream);
+  return positions_[stream];
+}
+
+template <typename Dtype>
+void RecurrentStreamStates<Dtype>::CheckOpen(const int stream) const {
+  CHECK_GE(stream, 0) << "invalid stream " << stream;
+  CHECK_LT(stream, positions_.size()) << "invalid stream " << stream;
+  CHECK_GE(positions_[stream], 0) << "stream " << stream << " is closed";
+}
+
+template <typename Dtype>
+void RecurrentStreamStates<Dtype>::Load(const vector<int>& streams,
+    const int num_timesteps, const vector<Blob<Dtype>*>& states,
+    Blob<Dtype>* cont) const {
+  const int num = streams.size();
+  vector<int> cont_shape(2);
+  cont_shape[0] = num_timesteps;
+  cont_shape[1] = num;
+  cont->Reshape(cont_shape);
+  Dtype* cont_data = cont->mutable_cpu_data();
+  caffe_set(cont->count(), Dtype(1), cont_data);
+  for (int n = 0; n < num; ++n) {
+    CheckOpen(streams[n]);
+    const vector<Dtype>& stream_states = states_[streams[n]];
+    if (positions_[streams[n]] == 0) {
+      cont_data[n] = 0;
+    }
+    for (int i = 0, offset = 0; i < states.size(); ++i) {
+      CHECK_EQ(num, states[i]->shape(1));
+      const int dim = states[i]->count(2);
+      Dtype* state = states[i]->mutable_cpu_data() + n * dim;
+      if (stream_states.size()) {
+        caffe_copy(dim, &stream_states[offset], state);
+      } else {
+        caffe_set(dim, Dtype(0), state);
+      }
+      offset += dim;
+    }
+  }
+}
+
+template <typename Dtype>
+void RecurrentStreamStates<Dtype>::Store(const vector<int>& streams,
+    const int num_timesteps, const vector<Blob<Dtype>*>& states) {
+  const int num = streams.size();
+  int stream_dim = 0;
+  for (int i = 0; i < states.size(); ++i) {
+    CHECK_EQ(num, states[i]->shape(1));
+    stream_dim += states[i]->count(2);
+  }
+  for (int n = 0; n < num; ++n) {
+    CheckOpen(streams[n]);
+    vector<Dtype>& stream_states = states_[streams[n]];
+    stream_states.resize(stream_dim);
+    for (int i = 0, offset = 0; i < states.size(); ++i) {
+      const int dim = states[i]->count(2);
+      caffe_copy(dim, states[i]->cpu_data() + n * dim,
+          &stream_states[offset]);
+      offset += dim;
+    }
+    positions_[streams[n]] += num_timesteps;
+  }
+}
+
 template <typename Dtype>
 void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -242,6 +332,48 @@ void RecurrentLayer<Dtype>::Reset() {
   }
 }
 
+template <typename Dtype>
+void RecurrentLayer<Dtype>::ForwardStreams(const vector<int>& streams,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(1 + static_input_, bottom.size());
+  CHECK_EQ(1, top.size());
+  CHECK_GE(bottom[0]->num_axes(), 2);
+  CHECK_EQ(T_, bottom[0]->shape(0))
+      << "the unrolled net runs " << T_ << " timesteps at a time";
+  CHECK_EQ(streams.size(), bottom[0]->shape(1));
+  // Run the layer as with expose_hidden, from and to the stream states.
+  N_ = streams.size();
+  vector<BlobShape> state_shapes;
+  RecurrentInputShapes(&state_shapes);
+  const int num_recur_blobs = state_shapes.size();
+  stream_states_.resize(2 * num_recur_blobs);
+  vector<Blob<Dtype>*> stream_bottom(1, bottom[0]);
+  stream_bottom.push_back(&stream_cont_);
+  if (static_input_) {
+    stream_bottom.push_back(bottom[1]);
+  }
+  vector<Blob<Dtype>*> stream_top(top);
+  vector<Blob<Dtype>*> states_in, states_out;
+  for (int i = 0; i < num_recur_blobs; ++i) {
+    if (!stream_states_[i]) {
+      stream_states_[i].reset(new Blob<Dtype>());
+      stream_states_[num_recur_blobs + i].reset(new Blob<Dtype>());
+    }
+    stream_states_[i]->Reshape(state_shapes[i]);
+    states_in.push_back(stream_states_[i].get());
+    states_out.push_back(stream_states_[num_recur_blobs + i].get());
+  }
+  stream_bottom.insert(stream_bottom.end(), states_in.begin(),
+      states_in.end());
+  stream_top.insert(stream_top.end(), states_out.begin(), states_out.end());
+  this->streams_.Load(streams, T_, states_in, &stream_cont_);
+  const bool expose_hidden = expose_hidden_;
+  expose_hidden_ = true;
+  this->Forward(stream_bottom, stream_top);
+  expose_hidden_ = expose_hidden;
+  this->streams_.Store(streams, T_, states_out);
+}
+
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -291,6 +423,7 @@ void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 STUB_GPU_FORWARD(RecurrentLayer, Forward);
 #endif
 
+INSTANTIATE_CLASS(RecurrentStreamStates);
 INSTANTIATE_CLASS(RecurrentLayer);
 
 }  // namespace caffe
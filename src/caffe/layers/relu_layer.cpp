@@ -5,17 +5,27 @@
 
 namespace caffe {
 
+namespace {
+
+template <typename Dtype>
+struct ReLUOp {
+  explicit ReLUOp(Dtype negative_slope) : negative_slope(negative_slope) {}
+  Dtype operator()(Dtype x) const {
+    return std::max(x, Dtype(0)) + negative_slope * std::min(x, Dtype(0));
+  }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return x > 0 ? dy : dy * negative_slope;
+  }
+  Dtype negative_slope;
+};
+
+}  // namespace
+
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + negative_slope * std::min(bottom_data[i], Dtype(0));
-  }
+  this->ForwardElementwise_cpu(ReLUOp<Dtype>(negative_slope), bottom, top);
 }
 
 template <typename Dtype>
@@ -23,15 +33,8 @@ void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
     Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + negative_slope * (bottom_data[i] <= 0));
-    }
+    this->BackwardElementwise_cpu(ReLUOp<Dtype>(negative_slope), top, bottom);
   }
 }
 
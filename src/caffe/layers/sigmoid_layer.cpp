@@ -1,24 +1,26 @@
-#include <cmath>
 #include <vector>
 
 #include "caffe/layers/sigmoid_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 
 namespace caffe {
 
+namespace {
+
 template <typename Dtype>
-inline Dtype sigmoid(Dtype x) {
-  return 0.5 * tanh(0.5 * x) + 0.5;
-}
+struct SigmoidOp {
+  Dtype operator()(Dtype x) const { return fast_sigmoid(x); }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return dy * y * (Dtype(1) - y);
+  }
+};
+
+}  // namespace
 
 template <typename Dtype>
 void SigmoidLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = sigmoid(bottom_data[i]);
-  }
+  this->ForwardElementwise_cpu(SigmoidOp<Dtype>(), bottom, top);
 }
 
 template <typename Dtype>
@@ -26,14 +28,7 @@ void SigmoidLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* top_data = top[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
-    for (int i = 0; i < count; ++i) {
-      const Dtype sigmoid_x = top_data[i];
-      bottom_diff[i] = top_diff[i] * sigmoid_x * (1. - sigmoid_x);
-    }
+    this->BackwardElementwise_cpu(SigmoidOp<Dtype>(), top, bottom);
   }
 }
 
@@ -31,6 +31,14 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* scale_data = scale_.mutable_cpu_data();
   int channels = bottom[0]->shape(softmax_axis_);
   int dim = bottom[0]->count() / outer_num_;
+  if (inner_num_ == 1) {
+    // Each softmax is contiguous, as for classifiers: take the two pass
+    // kernel rather than the GEMM based passes below.
+    for (int i = 0; i < outer_num_; ++i) {
+      caffe_cpu_softmax(channels, bottom_data + i * dim, top_data + i * dim);
+    }
+    return;
+  }
   caffe_copy(bottom[0]->count(), bottom_data, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
   // and then normalize.
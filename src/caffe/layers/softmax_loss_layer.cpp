@@ -88,25 +88,46 @@ Dtype SoftmaxWithLossLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
   int dim = prob_.count() / outer_num_;
   int count = 0;
   Dtype loss = 0;
-  for (int i = 0; i < outer_num_; ++i) {
-    for (int j = 0; j < inner_num_; j++) {
-      const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+  if (inner_num_ == 1) {
+    // Fused path: each softmax is contiguous, and its log normalizer gives
+    // the loss as log(sum(exp(x))) - x[label] with no pass over the probs.
+    const Dtype* bottom_data = bottom[0]->cpu_data();
+    Dtype* prob_data = prob_.mutable_cpu_data();
+    const Dtype max_loss = -log(Dtype(FLT_MIN));
+    for (int i = 0; i < outer_num_; ++i) {
+      const Dtype log_sum = caffe_cpu_softmax(dim, bottom_data + i * dim,
+          prob_data + i * dim);
+      const int label_value = static_cast<int>(label[i]);
       if (has_ignore_label_ && label_value == ignore_label_) {
         continue;
       }
       DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-      loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                           Dtype(FLT_MIN)));
+      DCHECK_LT(label_value, dim);
+      loss += std::min(log_sum - bottom_data[i * dim + label_value],
+                       max_loss);
       ++count;
     }
+  } else {
+    // The forward pass computes the softmax prob values.
+    softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
+    const Dtype* prob_data = prob_.cpu_data();
+    for (int i = 0; i < outer_num_; ++i) {
+      for (int j = 0; j < inner_num_; j++) {
+        const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+        if (has_ignore_label_ && label_value == ignore_label_) {
+          continue;
+        }
+        DCHECK_GE(label_value, 0);
+        DCHECK_LT(label_value, prob_.shape(softmax_axis_));
+        loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
+                             Dtype(FLT_MIN)));
+        ++count;
+      }
+    }
   }
   top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);
   if (top.size() == 2) {
@@ -124,27 +145,39 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (propagate_down[0]) {
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const Dtype* prob_data = prob_.cpu_data();
-    caffe_copy(prob_.count(), prob_data, bottom_diff);
     const Dtype* label = bottom[1]->cpu_data();
     int dim = prob_.count() / outer_num_;
+    int channels = bottom[0]->shape(softmax_axis_);
+    // The normalizer counts the labels that are not ignored, so that the
+    // gradient (prob - 1{label}) * loss_weight takes a single pass.
     int count = 0;
+    for (int i = 0; i < outer_num_ * inner_num_; ++i) {
+      if (!has_ignore_label_ || static_cast<int>(label[i]) != ignore_label_) {
+        ++count;
+      }
+    }
+    const Dtype loss_weight = top[0]->cpu_diff()[0] /
+                              get_normalizer(normalization_, count);
     for (int i = 0; i < outer_num_; ++i) {
+      const Dtype* label_i = label + i * inner_num_;
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* prob = prob_data + i * dim + c * inner_num_;
+        Dtype* diff = bottom_diff + i * dim + c * inner_num_;
+        for (int j = 0; j < inner_num_; ++j) {
+          diff[j] = prob[j] * loss_weight;
+        }
+      }
       for (int j = 0; j < inner_num_; ++j) {
-        const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+        const int label_value = static_cast<int>(label_i[j]);
         if (has_ignore_label_ && label_value == ignore_label_) {
-          for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
+          for (int c = 0; c < channels; ++c) {
             bottom_diff[i * dim + c * inner_num_ + j] = 0;
           }
         } else {
-          bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
-          ++count;
+          bottom_diff[i * dim + label_value * inner_num_ + j] -= loss_weight;
         }
       }
     }
-    // Scale gradient
-    Dtype loss_weight = top[0]->cpu_diff()[0] /
-                        get_normalizer(normalization_, count);
-    caffe_scal(prob_.count(), loss_weight, bottom_diff);
   }
 }
 
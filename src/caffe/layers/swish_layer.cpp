@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "caffe/layers/swish_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -25,18 +26,34 @@ void SwishLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   sigmoid_layer_->Reshape(sigmoid_bottom_vec_, sigmoid_top_vec_);
 }
 
+namespace {
+
+// Forward computes the sigmoid of beta * x, which the top is x times.
+// Backward takes that sigmoid in place of x: with s = sigmoid(beta * x),
+// dy/dx = beta * y + s * (1 - beta * y).
+template <typename Dtype>
+struct SwishSigmoidOp {
+  explicit SwishSigmoidOp(Dtype beta) : beta(beta) {}
+  Dtype operator()(Dtype x) const { return fast_sigmoid(beta * x); }
+  Dtype backward(Dtype s, Dtype y, Dtype dy) const {
+    return dy * (beta * y + s * (Dtype(1) - beta * y));
+  }
+  Dtype beta;
+};
+
+}  // namespace
+
 template <typename Dtype>
 void SwishLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* sigmoid_input_data = sigmoid_input_->mutable_cpu_data();
+  Dtype* sigmoid_output_data = sigmoid_output_->mutable_cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype beta = this->layer_param_.swish_param().beta();
-  caffe_copy(count, bottom_data, sigmoid_input_data);
-  caffe_scal(count, beta, sigmoid_input_data);
-  sigmoid_layer_->Forward(sigmoid_bottom_vec_, sigmoid_top_vec_);
-  caffe_mul(count, bottom_data, sigmoid_output_->cpu_data(), top_data);
+  caffe_cpu_elementwise(count, SwishSigmoidOp<Dtype>(beta), bottom_data,
+      sigmoid_output_data);
+  caffe_mul(count, bottom_data, sigmoid_output_data, top_data);
 }
 
 template <typename Dtype>
@@ -44,17 +61,11 @@ void SwishLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* top_data = top[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    const Dtype* sigmoid_output_data = sigmoid_output_->cpu_data();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
     Dtype beta = this->layer_param_.swish_param().beta();
-    for (int i = 0; i < count; ++i) {
-      const Dtype swish_x = top_data[i];
-      bottom_diff[i] = top_diff[i] * (beta * swish_x + sigmoid_output_data[i]
-          * (1. - beta * swish_x));
-    }
+    caffe_cpu_elementwise_backward(bottom[0]->count(),
+        SwishSigmoidOp<Dtype>(beta), sigmoid_output_->cpu_data(),
+        top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->mutable_cpu_diff());
   }
 }
 
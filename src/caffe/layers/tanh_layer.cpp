@@ -4,18 +4,26 @@
 #include <vector>
 
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/util/fast_math.hpp"
 
 namespace caffe {
 
+namespace {
+
+template <typename Dtype>
+struct TanHOp {
+  Dtype operator()(Dtype x) const { return fast_tanh(x); }
+  Dtype backward(Dtype x, Dtype y, Dtype dy) const {
+    return dy * (Dtype(1) - y * y);
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void TanHLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = tanh(bottom_data[i]);
-  }
+  this->ForwardElementwise_cpu(TanHOp<Dtype>(), bottom, top);
 }
 
 template <typename Dtype>
@@ -23,15 +31,7 @@ void TanHLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* top_data = top[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
-    Dtype tanhx;
-    for (int i = 0; i < count; ++i) {
-      tanhx = top_data[i];
-      bottom_diff[i] = top_diff[i] * (1 - tanhx * tanhx);
-    }
+    this->BackwardElementwise_cpu(TanHOp<Dtype>(), top, bottom);
   }
 }
 
@@ -11,15 +11,21 @@ void ThresholdLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   threshold_ = this->layer_param_.threshold_param().threshold();
 }
 
+namespace {
+
+template <typename Dtype>
+struct ThresholdOp {
+  explicit ThresholdOp(Dtype threshold) : threshold(threshold) {}
+  Dtype operator()(Dtype x) const { return x > threshold ? 1 : 0; }
+  Dtype threshold;
+};
+
+}  // namespace
+
 template <typename Dtype>
 void ThresholdLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = (bottom_data[i] > threshold_) ? Dtype(1) : Dtype(0);
-  }
+  this->ForwardElementwise_cpu(ThresholdOp<Dtype>(threshold_), bottom, top);
 }
 
 #ifdef CPU_ONLY
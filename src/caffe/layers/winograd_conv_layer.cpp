@@ -0,0 +1,426 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// The transforms of F(2x2, 3x3) and F(4x4, 3x3), from Lavin and Gray, "Fast
+// Algorithms for Convolutional Neural Networks": for a filter g and an input
+// tile d, the output tile is A^T [(G g G^T) .* (B^T d B)] A.
+static const double kBT2[4 * 4] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1
+};
+static const double kG2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+static const double kAT2[2 * 4] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1
+};
+static const double kBT4[6 * 6] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1
+};
+static const double kG4[6 * 3] = {
+  1. / 4,       0,      0,
+  -1. / 6,  -1. / 6, -1. / 6,
+  -1. / 6,   1. / 6, -1. / 6,
+  1. / 24,  1. / 12,  1. / 6,
+  1. / 24, -1. / 12,  1. / 6,
+  0,            0,      1
+};
+static const double kAT4[4 * 6] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1
+};
+
+// The largest tile, F(4x4, 3x3), transforms 6x6 input tiles.
+static const int kMaxAlpha = 6;
+
+// Output tiles of 4x4 pay off once there are a few of them per dimension.
+static int winograd_tile(int out_height, int out_width) {
+  return (out_height >= 8 && out_width >= 8) ? 4 : 2;
+}
+
+// out = L x L^T, for a rows x cols matrix L and a cols x cols matrix x.
+template <typename Dtype>
+static void transform_tile(const double* L, int rows, int cols,
+    const Dtype* x, Dtype* out) {
+  Dtype temp[kMaxAlpha * kMaxAlpha];
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < cols; ++k) {
+        sum += static_cast<Dtype>(L[i * cols + k]) * x[k * cols + j];
+      }
+      temp[i * cols + j] = sum;
+    }
+  }
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < rows; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < cols; ++k) {
+        sum += temp[i * cols + k] * static_cast<Dtype>(L[j * cols + k]);
+      }
+      out[i * rows + j] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+bool WinogradConvolutionLayer<Dtype>::IsSupported(
+    const ConvolutionParameter& param) {
+  if (param.force_nd_im2col()) {
+    return false;
+  }
+  if (param.has_kernel_h() || param.has_kernel_w()) {
+    if (param.kernel_h() != 3 || param.kernel_w() != 3) { return false; }
+  } else {
+    if (param.kernel_size_size() == 0 || param.kernel_size_size() > 2) {
+      return false;
+    }
+    for (int i = 0; i < param.kernel_size_size(); ++i) {
+      if (param.kernel_size(i) != 3) { return false; }
+    }
+  }
+  if (param.has_stride_h() || param.has_stride_w()) {
+    if (param.stride_h() != 1 || param.stride_w() != 1) { return false; }
+  } else {
+    for (int i = 0; i < param.stride_size(); ++i) {
+      if (param.stride(i) != 1) { return false; }
+    }
+  }
+  for (int i = 0; i < param.dilation_size(); ++i) {
+    if (param.dilation(i) != 1) { return false; }
+  }
+  if (param.has_pad_h() || param.has_pad_w()) {
+    if (param.pad_h() > 2 || param.pad_w() > 2) { return false; }
+  } else {
+    for (int i = 0; i < param.pad_size(); ++i) {
+      if (param.pad(i) > 2) { return false; }
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  // The gradient w.r.t. the bottom is padded by 2 - pad.
+  use_winograd_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_;
+  for (int i = 0; use_winograd_ && i < this->num_spatial_axes_; ++i) {
+    use_winograd_ = kernel_shape_data[i] == 3 && stride_data[i] == 1 &&
+        dilation_data[i] == 1 && pad_data[i] <= 2;
+  }
+  if (!use_winograd_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " falls back to "
+        << "im2col: Winograd needs 2D 3x3 filters with stride 1, no "
+        << "dilation and padding of at most 2.";
+  }
+  for (int i = 0; i < 2; ++i) {
+    transformed_source_[i].reset();
+  }
+}
+
+template <typename Dtype>
+const Dtype* WinogradConvolutionLayer<Dtype>::transformed_filters(
+    const Blob<Dtype>& weights, int tile, bool flip) {
+  const int index = flip ? 1 : 0;
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (transformed_source_[index] == source &&
+      transformed_version_[index] == source->version() &&
+      transformed_tile_[index] == tile) {
+    return transformed_filters_[index].cpu_data();
+  }
+  const double* G = tile == 4 ? kG4 : kG2;
+  const int alpha = tile + 2;
+  const int group = this->group_;
+  const int group_out = this->num_output_ / group;
+  const int group_in = this->channels_ / group;
+  // The gradient w.r.t. the bottom maps the outputs to the inputs.
+  const int rows = flip ? group_in : group_out;
+  const int cols = flip ? group_out : group_in;
+  transformed_filters_[index].Reshape(
+      vector<int>(1, alpha * alpha * group * rows * cols));
+  const Dtype* weight = weights.cpu_data();
+  Dtype* transformed = transformed_filters_[index].mutable_cpu_data();
+  Dtype filter[9];
+  Dtype transformed_filter[kMaxAlpha * kMaxAlpha];
+  for (int g = 0; g < group; ++g) {
+    for (int o = 0; o < group_out; ++o) {
+      for (int c = 0; c < group_in; ++c) {
+        const Dtype* source_filter =
+            weight + ((g * group_out + o) * group_in + c) * 9;
+        for (int i = 0; i < 9; ++i) {
+          filter[i] = source_filter[flip ? 8 - i : i];
+        }
+        transform_tile(G, alpha, 3, filter, transformed_filter);
+        const int row = flip ? c : o;
+        const int col = flip ? o : c;
+        for (int xi = 0; xi < alpha * alpha; ++xi) {
+          transformed[((xi * group + g) * rows + row) * cols + col] =
+              transformed_filter[xi];
+        }
+      }
+    }
+  }
+  transformed_source_[index] = source;
+  transformed_version_[index] = source->version();
+  transformed_tile_[index] = tile;
+  return transformed_filters_[index].cpu_data();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::winograd_cpu(const Dtype* input,
+    int in_channels, int height, int width, int pad_h, int pad_w, int tile,
+    const Dtype* filters, int out_channels, int out_height, int out_width,
+    Dtype* output, int task) {
+  const double* BT = tile == 4 ? kBT4 : kBT2;
+  const double* AT = tile == 4 ? kAT4 : kAT2;
+  const int alpha = tile + 2;
+  const int tiles_h = (out_height + tile - 1) / tile;
+  const int tiles_w = (out_width + tile - 1) / tile;
+  const int num_tiles = tiles_h * tiles_w;
+  const int group = this->group_;
+  const int group_in = in_channels / group;
+  const int group_out = out_channels / group;
+  Blob<Dtype>* input_tiles_blob = input_tiles_[task].get();
+  Blob<Dtype>* output_tiles_blob = output_tiles_[task].get();
+  input_tiles_blob->Reshape(
+      vector<int>(1, alpha * alpha * group_in * num_tiles));
+  output_tiles_blob->Reshape(
+      vector<int>(1, alpha * alpha * group_out * num_tiles));
+  Dtype* input_tiles = input_tiles_blob->mutable_cpu_data();
+  Dtype* output_tiles = output_tiles_blob->mutable_cpu_data();
+  Dtype in_tile[kMaxAlpha * kMaxAlpha];
+  Dtype out_tile[kMaxAlpha * kMaxAlpha];
+  for (int g = 0; g < group; ++g) {
+    // Transform the input tiles, padding with zeros.
+    for (int c = 0; c < group_in; ++c) {
+      const Dtype* channel = input + (g * group_in + c) * height * width;
+      for (int t = 0; t < num_tiles; ++t) {
+        const int y0 = (t / tiles_w) * tile - pad_h;
+        const int x0 = (t % tiles_w) * tile - pad_w;
+        if (y0 >= 0 && x0 >= 0 && y0 + alpha <= height &&
+            x0 + alpha <= width) {
+          for (int i = 0; i < alpha; ++i) {
+            for (int j = 0; j < alpha; ++j) {
+              in_tile[i * alpha + j] = channel[(y0 + i) * width + x0 + j];
+            }
+          }
+        } else {
+          for (int i = 0; i < alpha; ++i) {
+            const int y = y0 + i;
+            for (int j = 0; j < alpha; ++j) {
+              const int x = x0 + j;
+              in_tile[i * alpha + j] =
+                  (y >= 0 && y < height && x >= 0 && x < width) ?
+                  channel[y * width + x] : Dtype(0);
+            }
+          }
+        }
+        transform_tile(BT, alpha, alpha, in_tile, out_tile);
+        for (int xi = 0; xi < alpha * alpha; ++xi) {
+          input_tiles[(xi * group_in + c) * num_tiles + t] = out_tile[xi];
+        }
+      }
+    }
+    // Multiply elementwise in the transformed domain, summing over the input
+    // channels.
+    for (int xi = 0; xi < alpha * alpha; ++xi) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_out, num_tiles,
+          group_in, (Dtype)1.,
+          filters + (xi * group + g) * group_out * group_in,
+          input_tiles + xi * group_in * num_tiles,
+          (Dtype)0., output_tiles + xi * group_out * num_tiles);
+    }
+    // Transform back to the output tiles, dropping those past the border.
+    for (int o = 0; o < group_out; ++o) {
+      Dtype* channel = output + (g * group_out + o) * out_height * out_width;
+      for (int t = 0; t < num_tiles; ++t) {
+        for (int xi = 0; xi < alpha * alpha; ++xi) {
+          in_tile[xi] = output_tiles[(xi * group_out + o) * num_tiles + t];
+        }
+        transform_tile(AT, tile, alpha, in_tile, out_tile);
+        const int y0 = (t / tiles_w) * tile;
+        const int x0 = (t % tiles_w) * tile;
+        for (int i = 0; i < tile && y0 + i < out_height; ++i) {
+          for (int j = 0; j < tile && x0 + j < out_width; ++j) {
+            channel[(y0 + i) * out_width + x0 + j] = out_tile[i * tile + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::reshape_tile_buffers(int num_tasks) {
+  while (static_cast<int>(input_tiles_.size()) < num_tasks) {
+    input_tiles_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    output_tiles_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int tile = winograd_tile(this->output_shape_[0],
+      this->output_shape_[1]);
+  this->update_fused_params();
+  const Dtype* filters = transformed_filters(this->forward_weights(), tile,
+      false);
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(), this->num_);
+  reshape_tile_buffers(num_tasks);
+  // Bring the bias to the CPU before the tasks read it.
+  this->forward_bias();
+  for (int i = 0; i < bottom.size(); ++i) {
+    ThreadPool::Get().Run(num_tasks, boost::bind(
+        &WinogradConvolutionLayer<Dtype>::forward_winograd_task, this,
+        bottom[i]->cpu_data(), top[i]->mutable_cpu_data(), tile, filters,
+        num_tasks, _1));
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::forward_winograd_task(
+    const Dtype* bottom_data, Dtype* top_data, int tile, const Dtype* filters,
+    int num_tasks, int task) {
+  const int* pad_data = this->pad_.cpu_data();
+  const int begin = this->num_ * task / num_tasks;
+  const int end = this->num_ * (task + 1) / num_tasks;
+  for (int n = begin; n < end; ++n) {
+    winograd_cpu(bottom_data + n * this->bottom_dim_, this->channels_,
+        this->input_shape(1), this->input_shape(2), pad_data[0], pad_data[1],
+        tile, filters, this->num_output_, this->output_shape_[0],
+        this->output_shape_[1], top_data + n * this->top_dim_, task);
+    if (this->fused_batch_norm_) {
+      this->forward_cpu_fused(top_data + n * this->top_dim_);
+    } else if (this->bias_term_) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_,
+          this->blobs_[1]->cpu_data());
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  const int tile = winograd_tile(this->input_shape(1), this->input_shape(2));
+  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const int weight_count = this->blobs_[0]->count();
+  const int num_tasks = std::min(ThreadPool::Get().num_threads(), this->num_);
+  this->reshape_col_buffers(num_tasks);
+  reshape_tile_buffers(num_tasks);
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_diff = top[i]->cpu_diff();
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    // Bias gradient, if necessary.
+    if (this->bias_term_ && this->param_propagate_down_[1]) {
+      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+      for (int n = 0; n < this->num_; ++n) {
+        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+      }
+    }
+    // Gradient w.r.t. weight, for gemm_batch_ images at a time.
+    if (this->param_propagate_down_[0] && this->gemm_batch_ > 1) {
+      for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+        this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            std::min(this->gemm_batch_, this->num_ - n),
+            top_diff + n * this->top_dim_, weight_diff);
+      }
+    }
+    const bool weight_gradient =
+        this->param_propagate_down_[0] && this->gemm_batch_ == 1;
+    if (!weight_gradient && !propagate_down[i]) {
+      continue;
+    }
+    // The gradient w.r.t. the bottom is the top diff convolved with the
+    // flipped filters, padded to the size of the bottom.
+    const Dtype* filters = propagate_down[i] ?
+        transformed_filters(*this->blobs_[0], tile, true) : NULL;
+    Dtype* task_weight_diffs = NULL;
+    if (weight_gradient && num_tasks > 1) {
+      this->task_weight_diffs_.Reshape(
+          vector<int>(1, (num_tasks - 1) * weight_count));
+      task_weight_diffs = this->task_weight_diffs_.mutable_cpu_data();
+    }
+    ThreadPool::Get().Run(num_tasks, boost::bind(
+        &WinogradConvolutionLayer<Dtype>::backward_winograd_task, this,
+        top_diff, bottom_data,
+        propagate_down[i] ? bottom[i]->mutable_cpu_diff() : NULL,
+        weight_gradient ? weight_diff : NULL, task_weight_diffs, filters,
+        num_tasks, _1));
+    // Sum in task order, so the result does not depend on the scheduling.
+    for (int t = 1; t < num_tasks && weight_gradient; ++t) {
+      caffe_axpy(weight_count, Dtype(1),
+          task_weight_diffs + (t - 1) * weight_count, weight_diff);
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::backward_winograd_task(
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    Dtype* weight_diff, Dtype* task_weight_diffs, const Dtype* filters,
+    int num_tasks, int task) {
+  // The first task accumulates into the weight diff, the others into their
+  // own zeroed buffer.
+  if (weight_diff && task > 0) {
+    const int weight_count = this->blobs_[0]->count();
+    weight_diff = task_weight_diffs + (task - 1) * weight_count;
+    caffe_set(weight_count, Dtype(0), weight_diff);
+  }
+  const int tile = winograd_tile(this->input_shape(1), this->input_shape(2));
+  const int* pad_data = this->pad_.cpu_data();
+  const int begin = this->num_ * task / num_tasks;
+  const int end = this->num_ * (task + 1) / num_tasks;
+  for (int n = begin; n < end; ++n) {
+    if (weight_diff) {
+      this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+          top_diff + n * this->top_dim_, weight_diff, task);
+    }
+    if (bottom_diff) {
+      winograd_cpu(top_diff + n * this->top_dim_, this->num_output_,
+          this->output_shape_[0], this->output_shape_[1], 2 - pad_data[0],
+          2 - pad_data[1], tile, filters, this->channels_,
+          this->input_shape(1), this->input_shape(2),
+          bottom_diff + n * this->bottom_dim_, task);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
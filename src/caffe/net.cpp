@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <set>
 #include <string>
@@ -11,9 +12,13 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/concat_layer.hpp"
+#include "caffe/layers/conv_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocked_layout.hpp"
+#include "caffe/util/flat_weights.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -22,13 +27,34 @@
 namespace caffe {
 
 template <typename Dtype>
-Net<Dtype>::Net(const NetParameter& param) {
+Net<Dtype>::Net(const NetParameter& param)
+    : weights_source_(NULL) {
   Init(param);
 }
 
+template <typename Dtype>
+Net<Dtype>::Net(const NetParameter& param, const Net& weights_source)
+    : weights_source_(&weights_source) {
+  Init(param);
+  // Settle the state of the shared weights now, so that concurrent Forward
+  // calls of the executors only ever read them.
+  for (int i = 0; i < params_.size(); ++i) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      params_[i]->cpu_data();
+      break;
+    case Caffe::GPU:
+      params_[i]->gpu_data();
+      break;
+    }
+  }
+  weights_source_ = NULL;
+}
+
 template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
-    const int level, const vector<string>* stages) {
+    const int level, const vector<string>* stages)
+    : weights_source_(NULL) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
@@ -56,6 +82,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   // Create a copy of filtered_param with splits added where necessary.
   NetParameter param;
   InsertSplits(filtered_param, &param);
+  vector<bool> top_views;
+  FindTopViews(param, &top_views);
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -82,7 +110,14 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
           << "either 0 or bottom_size times ";
     }
     layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
+    layers_[layer_id]->set_top_views(top_views[layer_id]);
     layer_names_.push_back(layer_param.name());
+    if (weights_source_ && weights_source_->has_layer(layer_param.name())) {
+      // Hand the layer the shared parameters before its setup, so that it
+      // skips allocating and filling its own.
+      layers_[layer_id]->blobs() =
+          weights_source_->layer_by_name(layer_param.name())->blobs();
+    }
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating Layer " << layer_param.name();
     bool need_backward = false;
@@ -252,11 +287,392 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  if (weights_source_) {
+    // Catch layers which rebuild their parameters during setup.
+    ShareTrainedLayersWith(weights_source_);
+  }
   ShareWeights();
+  concat_view_top_.assign(blobs_.size(), -1);
+  if (param.zero_copy_concat()) {
+    if (Caffe::mode() == Caffe::CPU) {
+      FindConcatViews();
+    } else {
+      LOG_IF(WARNING, Caffe::root_solver()) << "Ignoring zero_copy_concat: "
+          << "it requires CPU mode.";
+    }
+  }
+  if (param.memory_optimize()) {
+    if (phase_ == TEST && !param.force_backward()) {
+      PlanMemory();
+    } else {
+      LOG_IF(WARNING, Caffe::root_solver()) << "Ignoring memory_optimize: "
+          << "it requires the TEST phase without force_backward.";
+    }
+  }
+  ShareConcatViews();
+  channel_block_ = 1;
+  if (param.cpu_layout() != NetParameter_Layout_NCHW) {
+    if (phase_ == TEST && !param.force_backward()) {
+      channel_block_ =
+          param.cpu_layout() == NetParameter_Layout_NCHW8C ? 8 : 16;
+      reordered_bottoms_.resize(layers_.size());
+    } else {
+      LOG_IF(WARNING, Caffe::root_solver()) << "Ignoring cpu_layout: "
+          << "it requires the TEST phase without force_backward.";
+    }
+  }
+  fused_layers_.assign(layers_.size(), false);
+  if (param.fuse_batch_norm()) {
+    if (phase_ == TEST && !param.force_backward()) {
+      FuseBatchNorm();
+    } else {
+      LOG_IF(WARNING, Caffe::root_solver()) << "Ignoring fuse_batch_norm: "
+          << "it requires the TEST phase without force_backward.";
+    }
+  }
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+bool Net<Dtype>::RunsInPlace(const int layer_id, const Blob<Dtype>* blob,
+    const string& type) const {
+  return layer_id < layers_.size() && layers_[layer_id]->type() == type &&
+      bottom_vecs_[layer_id].size() == 1 && top_vecs_[layer_id].size() == 1 &&
+      bottom_vecs_[layer_id][0] == blob && top_vecs_[layer_id][0] == blob;
+}
+
+// Helper for Net::Init: the layers running in place on the output of a
+// convolution see nothing but its output, so Convolution -> BatchNorm
+// [-> Scale] [-> ReLU] can run as the one convolution, with BatchNorm using
+// its stored statistics and Scale scaling the channels.
+template <typename Dtype>
+void Net<Dtype>::FuseBatchNorm() {
+  for (int i = 0; i < layers_.size(); ++i) {
+    ConvolutionLayer<Dtype>* conv =
+        dynamic_cast<ConvolutionLayer<Dtype>*>(layers_[i].get());
+    if (!conv || top_vecs_[i].size() != 1) {
+      continue;
+    }
+    const Blob<Dtype>* blob = top_vecs_[i][0];
+    int next = i + 1;
+    if (!RunsInPlace(next, blob, "BatchNorm")) {
+      continue;
+    }
+    const BatchNormParameter& batch_norm_param =
+        layers_[next]->layer_param().batch_norm_param();
+    if (batch_norm_param.has_use_global_stats() &&
+        !batch_norm_param.use_global_stats()) {
+      continue;
+    }
+    shared_ptr<Layer<Dtype> > batch_norm = layers_[next++];
+    shared_ptr<Layer<Dtype> > scale;
+    if (RunsInPlace(next, blob, "Scale")) {
+      const ScaleParameter& scale_param =
+          layers_[next]->layer_param().scale_param();
+      if (scale_param.axis() == 1 && scale_param.num_axes() == 1) {
+        scale = layers_[next++];
+      }
+    }
+    const bool relu = RunsInPlace(next, blob, "ReLU");
+    const Dtype negative_slope = relu ?
+        layers_[next]->layer_param().relu_param().negative_slope() : 0;
+    if (relu) {
+      ++next;
+    }
+    conv->FuseBatchNorm(batch_norm, scale, relu, negative_slope);
+    for (int j = i + 1; j < next; ++j) {
+      fused_layers_[j] = true;
+      LOG_IF(INFO, Caffe::root_solver()) << "Fusing " << layer_names_[j]
+          << " into " << layer_names_[i];
+    }
+    i = next - 1;
+  }
+}
+
+// Helper for Net::Init: a layer may make its tops views of its bottom, so that
+// they share its data and diff, unless
+// - a layer changes one of the tops in place, and so the bottom, which the
+//   backward pass of the layer producing it may still need,
+// - a layer after it changes the bottom in place, and so the tops, or
+// - the bottom has other readers.
+// The tops of Split, Reshape and Flatten layers always share the data of
+// their bottom, so a layer running in place on any of them changes them all.
+template <typename Dtype>
+void Net<Dtype>::FindTopViews(const NetParameter& param,
+    vector<bool>* top_views) {
+  const int num_layers = param.layer_size();
+  // The blobs sharing their data are told apart by the first of them.
+  map<string, string> storage;
+  map<string, int> readers;
+  map<string, int> last_write;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const LayerParameter& layer_param = param.layer(layer_id);
+    const string& type = layer_param.type();
+    const bool shares = layer_param.bottom_size() > 0 &&
+        (type == "Split" || type == "Reshape" || type == "Flatten");
+    for (int i = 0; i < layer_param.bottom_size(); ++i) {
+      const string& name = layer_param.bottom(i);
+      if (!storage.count(name)) {
+        storage[name] = name;
+      }
+      bool in_place = false;
+      for (int j = 0; j < layer_param.top_size(); ++j) {
+        in_place |= layer_param.top(j) == name;
+      }
+      if (in_place) {
+        last_write[storage[name]] = layer_id;
+      } else {
+        ++readers[name];
+      }
+    }
+    for (int i = 0; i < layer_param.top_size(); ++i) {
+      const string& name = layer_param.top(i);
+      if (!storage.count(name)) {
+        storage[name] = shares ? storage[layer_param.bottom(0)] : name;
+      }
+    }
+  }
+  top_views->assign(num_layers, true);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const LayerParameter& layer_param = param.layer(layer_id);
+    if (layer_param.bottom_size() == 0) {
+      continue;
+    }
+    const string& bottom = storage[layer_param.bottom(0)];
+    bool views = readers[layer_param.bottom(0)] == 1 &&
+        !(last_write.count(bottom) && last_write[bottom] > layer_id);
+    for (int i = 0; i < layer_param.top_size(); ++i) {
+      views = views && !last_write.count(storage[layer_param.top(i)]);
+    }
+    (*top_views)[layer_id] = views;
+  }
+}
+
+// Helper for Net::Init: a Concat whose bottoms are contiguous in its top needs
+// no copy if they are views of their place in it, which the layers producing
+// them then write. That holds for a bottom
+// - produced in Forward, not by a source layer or as a view of another blob,
+// - read by the Concat alone, and touched by no layer after it, and
+// - whose data the backward pass does not need after a layer running in
+//   place on the concatenation (or one it is in turn a view of) changed it.
+// Concat layers are visited last first so that a Concat top may itself be a
+// view of a later concatenation.
+template <typename Dtype>
+void Net<Dtype>::FindConcatViews() {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  vector<int> readers(num_blobs, 0);
+  vector<int> last_use(num_blobs, -1);
+  vector<int> last_write(num_blobs, -1);
+  vector<bool> viewable(num_blobs, true);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    const bool shares = layers_[layer_id]->SharesBottomData();
+    for (int i = 0; i < bottom_ids.size(); ++i) {
+      const int blob_id = bottom_ids[i];
+      if (std::find(top_ids.begin(), top_ids.end(), blob_id) ==
+          top_ids.end()) {
+        ++readers[blob_id];
+      }
+      last_use[blob_id] = layer_id;
+      viewable[blob_id] = viewable[blob_id] && !shares;
+    }
+    for (int i = 0; i < top_ids.size(); ++i) {
+      const int blob_id = top_ids[i];
+      last_use[blob_id] = layer_id;
+      last_write[blob_id] = layer_id;
+      viewable[blob_id] =
+          viewable[blob_id] && !shares && !bottom_ids.empty();
+    }
+  }
+  // Whether a layer may change a Concat top, and so its views, in place
+  // after the Concat.
+  vector<bool> clobbered(num_blobs, false);
+  int num_views = 0;
+  for (int layer_id = num_layers - 1; layer_id >= 0; --layer_id) {
+    const ConcatLayer<Dtype>* concat =
+        dynamic_cast<ConcatLayer<Dtype>*>(layers_[layer_id].get());
+    if (!concat || concat->SharesBottomData() || concat->num_concats() != 1) {
+      continue;
+    }
+    const int top_id = top_id_vecs_[layer_id][0];
+    clobbered[top_id] = clobbered[top_id] || last_write[top_id] > layer_id;
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    for (int i = 0; i < bottom_ids.size(); ++i) {
+      const int blob_id = bottom_ids[i];
+      if (viewable[blob_id] && readers[blob_id] == 1 &&
+          last_use[blob_id] == layer_id && blobs_[blob_id]->count() > 0 &&
+          !(bottom_need_backward_[layer_id][i] && clobbered[top_id])) {
+        concat_view_top_[blob_id] = top_id;
+        clobbered[blob_id] = clobbered[top_id];
+        ++num_views;
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Concat bottoms written in place: " << num_views;
+}
+
+// Helper for Net::Init and Net::Reshape: the views are placed at the offsets
+// of the current shapes once the tops have their storage, for concatenated
+// concatenations the later Concat first. The bottoms of a Concat reshaped to
+// several items, which are no longer contiguous in its top, get storage of
+// their own until it is reshaped back.
+template <typename Dtype>
+void Net<Dtype>::ShareConcatViews() {
+  concat_storage_.clear();
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    const ConcatLayer<Dtype>* concat =
+        dynamic_cast<ConcatLayer<Dtype>*>(layers_[layer_id].get());
+    if (!concat) {
+      continue;
+    }
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    int offset = 0;
+    for (int i = 0; i < bottom_ids.size(); ++i) {
+      const int blob_id = bottom_ids[i];
+      Blob<Dtype>* bottom = blobs_[blob_id].get();
+      const int top_id = concat_view_top_[blob_id];
+      if (top_id >= 0 && concat->num_concats() == 1) {
+        Blob<Dtype>* top = blobs_[top_id].get();
+        bottom->set_cpu_data(top->mutable_cpu_data() + offset);
+        concat_storage_.push_back(top->data());
+        if (bottom_need_backward_[layer_id][i]) {
+          bottom->set_cpu_diff(top->mutable_cpu_diff() + offset);
+          concat_storage_.push_back(top->diff());
+        }
+      } else if (top_id >= 0) {
+        Blob<Dtype> storage(bottom->shape());
+        bottom->ShareData(storage);
+        bottom->ShareDiff(storage);
+      }
+      offset += bottom->count();
+    }
+  }
+}
+
+// Helper for Net::Init: find the first and last layer touching each blob and
+// place the blobs in one arena such that blobs alive at the same time never
+// overlap. Tops of source layers (data, inputs) keep their own memory since
+// they may be filled outside of Forward.
+template <typename Dtype>
+void Net<Dtype>::PlanMemory() {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  // Tops that are views of their bottom take their storage from it, so their
+  // lifetime extends the one of the blob owning that storage.
+  vector<int> owner(num_blobs);
+  vector<bool> planned(num_blobs, true);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    owner[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    if (bottom_id_vecs_[layer_id].empty()) {
+      for (int top_id = 0; top_id < top_ids.size(); ++top_id) {
+        planned[top_ids[top_id]] = false;
+      }
+    } else if (layers_[layer_id]->SharesBottomData()) {
+      const int bottom_owner = owner[bottom_id_vecs_[layer_id][0]];
+      for (int top_id = 0; top_id < top_ids.size(); ++top_id) {
+        owner[top_ids[top_id]] = bottom_owner;
+        planned[top_ids[top_id]] = false;
+      }
+    }
+  }
+  // Bottoms of Concat layers that are views of the top take their storage
+  // from it in turn; the later Concat first, for concatenated concatenations.
+  for (int layer_id = num_layers - 1; layer_id >= 0; --layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    for (int bottom_id = 0; bottom_id < bottom_ids.size(); ++bottom_id) {
+      const int blob_id = bottom_ids[bottom_id];
+      if (concat_view_top_[blob_id] >= 0) {
+        owner[blob_id] = owner[concat_view_top_[blob_id]];
+        planned[blob_id] = false;
+      }
+    }
+  }
+  vector<int> first_use(num_blobs, num_layers);
+  vector<int> last_use(num_blobs, -1);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int i = 0; i < 2; ++i) {
+      const vector<int>& blob_ids =
+          i ? top_id_vecs_[layer_id] : bottom_id_vecs_[layer_id];
+      for (int j = 0; j < blob_ids.size(); ++j) {
+        const int blob_owner = owner[blob_ids[j]];
+        first_use[blob_owner] = std::min(first_use[blob_owner], layer_id);
+        last_use[blob_owner] = std::max(last_use[blob_owner], layer_id);
+      }
+    }
+  }
+  // The outputs are read after Forward returns.
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    last_use[owner[net_output_blob_indices_[i]]] = num_layers;
+  }
+  // Place the largest blobs first, each at the lowest offset not overlapping
+  // a placed blob of intersecting lifetime.
+  const size_t kAlignment = 64;
+  vector<pair<size_t, int> > order;
+  vector<size_t> sizes(num_blobs, 0);
+  size_t naive_bytes = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (!planned[blob_id] || blobs_[blob_id]->count() == 0) { continue; }
+    const size_t bytes = blobs_[blob_id]->count() * sizeof(Dtype);
+    sizes[blob_id] = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    naive_bytes += bytes;
+    order.push_back(make_pair(sizes[blob_id], blob_id));
+  }
+  std::stable_sort(order.begin(), order.end(),
+      std::greater<pair<size_t, int> >());
+  vector<size_t> offsets(num_blobs, 0);
+  vector<int> placed;
+  size_t arena_bytes = 0;
+  for (int i = 0; i < order.size(); ++i) {
+    const int blob_id = order[i].second;
+    vector<pair<size_t, size_t> > busy;
+    for (int j = 0; j < placed.size(); ++j) {
+      if (first_use[placed[j]] <= last_use[blob_id] &&
+          first_use[blob_id] <= last_use[placed[j]]) {
+        busy.push_back(make_pair(offsets[placed[j]],
+            offsets[placed[j]] + sizes[placed[j]]));
+      }
+    }
+    std::sort(busy.begin(), busy.end());
+    size_t offset = 0;
+    for (int j = 0; j < busy.size(); ++j) {
+      if (offset + sizes[blob_id] <= busy[j].first) { break; }
+      offset = std::max(offset, busy[j].second);
+    }
+    offsets[blob_id] = offset;
+    placed.push_back(blob_id);
+    arena_bytes = std::max(arena_bytes, offset + sizes[blob_id]);
+  }
+  if (placed.empty()) { return; }
+  activation_arena_.reset(new SyncedMemory(arena_bytes));
+  char* arena = NULL;
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    arena = static_cast<char*>(activation_arena_->mutable_cpu_data());
+    break;
+  case Caffe::GPU:
+    arena = static_cast<char*>(activation_arena_->mutable_gpu_data());
+    break;
+  }
+  for (int i = 0; i < placed.size(); ++i) {
+    Dtype* data = reinterpret_cast<Dtype*>(arena + offsets[placed[i]]);
+    if (Caffe::mode() == Caffe::CPU) {
+      blobs_[placed[i]]->set_cpu_data(data);
+    } else {
+      blobs_[placed[i]]->set_gpu_data(data);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory planned for " << placed.size() << " blobs: " << arena_bytes
+      << " bytes (unplanned: " << naive_bytes << " bytes)";
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -518,18 +934,68 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  const bool blocked = channel_block_ > 1 && Caffe::mode() == Caffe::CPU;
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
+    if (fused_layers_[i] && Caffe::mode() == Caffe::CPU) {
+      continue;
+    }
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    Dtype layer_loss = blocked ? ForwardBlocked(i) :
+        layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
       after_forward_[c]->run(i);
     }
   }
+  if (blocked) {
+    for (int i = 0; i < net_output_blobs_.size(); ++i) {
+      Blob<Dtype>* blob = net_output_blobs_[i];
+      if (blob->channel_block() > 1) {
+        ReorderChannelBlock(*blob, 1, &plain_output_);
+        blob->CopyFrom(plain_output_);
+        blob->set_channel_block(1);
+      }
+    }
+  }
+  return loss;
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardBlocked(const int layer_id) {
+  Layer<Dtype>* layer = layers_[layer_id].get();
+  const vector<Blob<Dtype>*>& bottom = bottom_vecs_[layer_id];
+  const vector<Blob<Dtype>*>& top = top_vecs_[layer_id];
+  // Layers that support the blocked layout take it on from a blocked bottom;
+  // layers like convolution, whose blocked kernels pay for the reorder, also
+  // start it from plain bottoms.
+  bool block = false;
+  if (layer->SupportsChannelBlock(bottom, top, channel_block_)) {
+    block = layer->StartsChannelBlock();
+    for (int i = 0; i < bottom.size() && !block; ++i) {
+      block = bottom[i]->channel_block() == channel_block_;
+    }
+  }
+  const int channel_block = block ? channel_block_ : 1;
+  vector<Blob<Dtype>*> layer_bottom(bottom);
+  vector<shared_ptr<Blob<Dtype> > >& reordered = reordered_bottoms_[layer_id];
+  reordered.resize(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (bottom[i]->channel_block() != channel_block) {
+      if (!reordered[i]) {
+        reordered[i].reset(new Blob<Dtype>());
+      }
+      ReorderChannelBlock(*bottom[i], channel_block, reordered[i].get());
+      layer_bottom[i] = reordered[i].get();
+    }
+  }
+  const Dtype loss = layer->Forward(layer_bottom, top);
+  for (int i = 0; i < top.size(); ++i) {
+    top[i]->set_channel_block(channel_block);
+  }
   return loss;
 }
 
@@ -729,6 +1195,8 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  // The Concat bottoms in their top move with the shapes.
+  ShareConcatViews();
 }
 
 template <typename Dtype>
@@ -771,7 +1239,9 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string& trained_filename) {
-  if (H5Fis_hdf5(trained_filename.c_str())) {
+  if (IsFlatWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromFlat(trained_filename);
+  } else if (H5Fis_hdf5(trained_filename.c_str())) {
     CopyTrainedLayersFromHDF5(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
@@ -786,6 +1256,58 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
   CopyTrainedLayersFrom(param);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromFlat(const string& trained_filename) {
+  shared_ptr<MappedFile> file(new MappedFile(trained_filename));
+  FlatWeightsIndex index;
+  char* data = ReadFlatWeightsIndex(*file, &index);
+  const FlatWeightsIndex::DataType data_type = sizeof(Dtype) == sizeof(float)
+      ? FlatWeightsIndex_DataType_FLOAT : FlatWeightsIndex_DataType_DOUBLE;
+  const bool map_data = index.data_type() == data_type;
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const FlatLayerWeights& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    int target_layer_id = layer_names_index_[source_layer_name];
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const FlatBlob& source_blob = source_layer.blobs(j);
+      const vector<int> source_shape(source_blob.shape().dim().begin(),
+          source_blob.shape().dim().end());
+      if (source_shape != target_blobs[j]->shape()) {
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << Blob<Dtype>(source_shape).shape_string()
+            << "; target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      char* source_data = data + source_blob.offset();
+      const int count = target_blobs[j]->count();
+      if (map_data) {
+        // The blob, and any sharing it, keeps the file mapped.
+        target_blobs[j]->data()->set_cpu_data(source_data, file);
+      } else if (index.data_type() == FlatWeightsIndex_DataType_FLOAT) {
+        const float* source_values = reinterpret_cast<float*>(source_data);
+        std::copy(source_values, source_values + count,
+            target_blobs[j]->mutable_cpu_data());
+      } else {
+        const double* source_values = reinterpret_cast<double*>(source_data);
+        std::copy(source_values, source_values + count,
+            target_blobs[j]->mutable_cpu_data());
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string& trained_filename) {
 #ifdef USE_HDF5
@@ -892,7 +1414,8 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       if (param_owners_[net_param_id] == -1) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *params_[net_param_id], false,
+            layers_[layer_id]->param_storage(param_id));
       }
       if (write_diff) {
         // Write diffs regardless of weight-sharing
@@ -916,6 +1439,32 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 #endif  // USE_HDF5
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToFlatWeights(const string& filename) const {
+  FlatWeightsIndex index;
+  index.set_data_type(sizeof(Dtype) == sizeof(float)
+      ? FlatWeightsIndex_DataType_FLOAT : FlatWeightsIndex_DataType_DOUBLE);
+  // Weight-shared params have the same data, so they are stored once.
+  vector<const void*> data;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        layers_[layer_id]->blobs();
+    if (blobs.empty()) {
+      continue;
+    }
+    FlatLayerWeights* layer = index.add_layer();
+    layer->set_name(layer_names_[layer_id]);
+    for (int param_id = 0; param_id < blobs.size(); ++param_id) {
+      BlobShape* shape = layer->add_blobs()->mutable_shape();
+      for (int i = 0; i < blobs[param_id]->num_axes(); ++i) {
+        shape->add_dim(blobs[param_id]->shape(i));
+      }
+      data.push_back(blobs[param_id]->cpu_data());
+    }
+  }
+  WriteFlatWeightsFile(filename, &index, data);
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
@@ -926,26 +1475,25 @@ void Net<Dtype>::Update() {
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    Blob<Dtype>* blob = learnable_params_[i];
-    switch (Caffe::mode()) {
-    case Caffe::CPU:
-      caffe_set(blob->count(), static_cast<Dtype>(0),
-                blob->mutable_cpu_diff());
-      break;
-    case Caffe::GPU:
-#ifndef CPU_ONLY
-      caffe_gpu_set(blob->count(), static_cast<Dtype>(0),
-                    blob->mutable_gpu_diff());
-#else
-      NO_GPU;
-#endif
-      break;
-    }
+    learnable_params_[i]->ClearDiff();
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
+  // A row-sparse diff (see Blob::set_row_sparse_diff) stays so only if every
+  // layer sharing it reports the rows it writes.
+  for (int i = 0; i < params_.size(); ++i) {
+    if (param_owners_[i] < 0) { continue; }
+    Blob<Dtype>* owner = params_[param_owners_[i]].get();
+    if (owner->has_diff_rows() && !params_[i]->has_diff_rows()) {
+      LOG_IF(INFO, Caffe::root_solver()) << "Updating parameter '"
+          << param_display_names_[i] << "' densely: layer '"
+          << layer_names_[param_layer_indices_[i].first]
+          << "' shares it without reporting the rows of its gradient.";
+      owner->set_row_sparse_diff(false);
+    }
+  }
   for (int i = 0; i < params_.size(); ++i) {
     if (param_owners_[i] < 0) { continue; }
     params_[i]->ShareData(*params_[param_owners_[i]]);
@@ -427,6 +427,9 @@ void Solver<Dtype>::Snapshot() {
   case caffe::SolverParameter_SnapshotFormat_HDF5:
     model_filename = SnapshotToHDF5();
     break;
+  case caffe::SolverParameter_SnapshotFormat_FLAT:
+    model_filename = SnapshotToFlat();
+    break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
@@ -476,6 +479,16 @@ string Solver<Dtype>::SnapshotToHDF5() {
   return model_filename;
 }
 
+template <typename Dtype>
+string Solver<Dtype>::SnapshotToFlat() {
+  string model_filename = SnapshotFilename(".caffemodel.flat");
+  LOG(INFO) << "Snapshotting to flat weights file " << model_filename;
+  LOG_IF(WARNING, param_.snapshot_diff())
+      << "Flat weights files do not store diffs.";
+  net_->ToFlatWeights(model_filename);
+  return model_filename;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   string state_filename(state_file);
@@ -44,6 +44,28 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 
   switch (Caffe::mode()) {
     case Caffe::CPU: {
+    if (net_params[param_id]->row_sparse_diff()) {
+      // Update only the rows in the diff, as below.
+      this->DecayLazyRows(param_id);
+      const int dim = net_params[param_id]->count(1);
+      const vector<int>& rows = net_params[param_id]->diff_rows();
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* m = val_m->mutable_cpu_data();
+      Dtype* v = val_v->mutable_cpu_data();
+      Dtype* tmp = val_t->mutable_cpu_data();
+      for (int i = 0; i < rows.size(); ++i) {
+        const int offset = rows[i] * dim;
+        caffe_cpu_axpby(dim, Dtype(1)-beta1, diff + offset, beta1, m + offset);
+        caffe_mul(dim, diff + offset, diff + offset, tmp + offset);
+        caffe_cpu_axpby(dim, Dtype(1)-beta2, tmp + offset, beta2, v + offset);
+        caffe_powx(dim, v + offset, Dtype(0.5), tmp + offset);
+        caffe_add_scalar(dim, eps_hat, tmp + offset);
+        caffe_div(dim, m + offset, tmp + offset, tmp + offset);
+        caffe_cpu_scale(dim, local_rate*correction, tmp + offset,
+            diff + offset);
+      }
+      break;
+    }
     // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
     caffe_cpu_axpby(N, Dtype(1)-beta1,
         net_params[param_id]->cpu_diff(), beta1,
@@ -88,6 +110,17 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::DecayHistoryRow(int param_id, int row, int steps) {
+  const size_t update_history_offset = this->net_->learnable_params().size();
+  const int dim = this->history_[param_id]->count(1);
+  caffe_scal(dim, Dtype(pow(this->param_.momentum(), steps)),
+      this->history_[param_id]->mutable_cpu_data() + row * dim);
+  caffe_scal(dim, Dtype(pow(this->param_.momentum2(), steps)),
+      this->history_[param_id + update_history_offset]->mutable_cpu_data()
+      + row * dim);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
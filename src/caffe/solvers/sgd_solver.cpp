@@ -76,6 +76,8 @@ void SGDSolver<Dtype>::PreSolve() {
   history_.clear();
   update_.clear();
   temp_.clear();
+  history_iter_.clear();
+  history_iter_.resize(net_params.size());
   for (int i = 0; i < net_params.size(); ++i) {
     const vector<int>& shape = net_params[i]->shape();
     history_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
@@ -115,6 +117,15 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   ClipGradients();
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
+    Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+    if (!LazyUpdate() || Caffe::mode() != Caffe::CPU) {
+      param->set_diff_dense();
+    }
+    if (!param->row_sparse_diff() && !history_iter_[param_id].empty()) {
+      // Catch up on the decay of the rows left out of the lazy updates.
+      DecayLazyHistory(param_id);
+      history_iter_[param_id].clear();
+    }
     Normalize(param_id);
     Regularize(param_id);
     ComputeUpdateValue(param_id, rate);
@@ -134,6 +145,10 @@ void SGDSolver<Dtype>::Normalize(int param_id) {
   const Dtype accum_normalization = Dtype(1.) / this->param_.iter_size();
   switch (Caffe::mode()) {
   case Caffe::CPU: {
+    if (net_params[param_id]->row_sparse_diff()) {
+      net_params[param_id]->scale_diff(accum_normalization);
+      break;
+    }
     caffe_scal(net_params[param_id]->count(), accum_normalization,
         net_params[param_id]->mutable_cpu_diff());
     break;
@@ -162,7 +177,26 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    if (local_decay) {
+    if (local_decay && net_params[param_id]->row_sparse_diff()) {
+      // Decay only the rows in the diff.
+      Blob<Dtype>* param = net_params[param_id];
+      const int dim = param->count(1);
+      const vector<int>& rows = param->diff_rows();
+      const Dtype* data = param->cpu_data();
+      Dtype* diff = param->mutable_cpu_diff();
+      Dtype* sign = temp_[param_id]->mutable_cpu_data();
+      for (int i = 0; i < rows.size(); ++i) {
+        const int offset = rows[i] * dim;
+        if (regularization_type == "L2") {
+          caffe_axpy(dim, local_decay, data + offset, diff + offset);
+        } else if (regularization_type == "L1") {
+          caffe_cpu_sign(dim, data + offset, sign + offset);
+          caffe_axpy(dim, local_decay, sign + offset, diff + offset);
+        } else {
+          LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+        }
+      }
+    } else if (local_decay) {
       if (regularization_type == "L2") {
         // add weight decay
         caffe_axpy(net_params[param_id]->count(),
@@ -229,6 +263,20 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
   case Caffe::CPU: {
+    if (net_params[param_id]->row_sparse_diff()) {
+      DecayLazyRows(param_id);
+      const int dim = net_params[param_id]->count(1);
+      const vector<int>& rows = net_params[param_id]->diff_rows();
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* history = history_[param_id]->mutable_cpu_data();
+      for (int i = 0; i < rows.size(); ++i) {
+        const int offset = rows[i] * dim;
+        caffe_cpu_axpby(dim, local_rate, diff + offset, momentum,
+            history + offset);
+        caffe_copy(dim, history + offset, diff + offset);
+      }
+      break;
+    }
     caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
               net_params[param_id]->cpu_diff(), momentum,
               history_[param_id]->mutable_cpu_data());
@@ -253,10 +301,52 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::DecayHistoryRow(int param_id, int row, int steps) {
+  const int dim = history_[param_id]->count(1);
+  caffe_scal(dim, Dtype(pow(this->param_.momentum(), steps)),
+      history_[param_id]->mutable_cpu_data() + row * dim);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::DecayLazyRows(int param_id) {
+  const Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  vector<int>& row_iter = history_iter_[param_id];
+  if (row_iter.size() != param->shape(0)) {
+    // First lazy update, or first since a restore: the history of every row
+    // is current.
+    row_iter.assign(param->shape(0), this->iter_);
+  }
+  const vector<int>& rows = param->diff_rows();
+  for (int i = 0; i < rows.size(); ++i) {
+    const int row = rows[i];
+    if (row_iter[row] < this->iter_) {
+      DecayHistoryRow(param_id, row, this->iter_ - row_iter[row]);
+    }
+    row_iter[row] = this->iter_ + 1;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::DecayLazyHistory(int param_id) {
+  vector<int>& row_iter = history_iter_[param_id];
+  for (int row = 0; row < row_iter.size(); ++row) {
+    if (row_iter[row] < this->iter_) {
+      DecayHistoryRow(param_id, row, this->iter_ - row_iter[row]);
+      row_iter[row] = this->iter_;
+    }
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
+  // Snapshot the history as a dense update would have left it.
+  for (int param_id = 0; param_id < history_iter_.size(); ++param_id) {
+    DecayLazyHistory(param_id);
+  }
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    case caffe::SolverParameter_SnapshotFormat_FLAT:
       SnapshotSolverStateToBinaryProto(model_filename);
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
@@ -325,10 +415,11 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
   SolverState state;
   ReadProtoFromBinaryFile(state_file, &state);
   this->iter_ = state.iter();
+  for (int i = 0; i < history_iter_.size(); ++i) {
+    history_iter_[i].clear();
+  }
   if (state.has_learned_net()) {
-    NetParameter net_param;
-    ReadNetParamsFromBinaryFileOrDie(state.learned_net().c_str(), &net_param);
-    this->net_->CopyTrainedLayersFrom(net_param);
+    this->net_->CopyTrainedLayersFrom(state.learned_net());
   }
   this->current_step_ = state.current_step();
   CHECK_EQ(state.history_size(), history_.size())
@@ -345,6 +436,9 @@ void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
+  for (int i = 0; i < history_iter_.size(); ++i) {
+    history_iter_[i].clear();
+  }
   if (H5LTfind_dataset(file_hid, "learned_net")) {
     string learned_net = hdf5_load_string(file_hid, "learned_net");
     this->net_->CopyTrainedLayersFrom(learned_net);
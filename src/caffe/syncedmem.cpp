@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), restore_(NULL), cpu_malloc_use_cuda_(false),
+    own_gpu_data_(false), version_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,8 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), restore_(NULL), cpu_malloc_use_cuda_(false),
+    own_gpu_data_(false), version_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -26,7 +28,7 @@ SyncedMemory::SyncedMemory(size_t size)
 SyncedMemory::~SyncedMemory() {
   check_device();
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_);
   }
 
 #ifndef CPU_ONLY
@@ -36,8 +38,17 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+inline void SyncedMemory::restore_cpu_data() {
+  if (compact_) {
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    restore_(compact_->cpu_data(), cpu_ptr_, size_);
+    compact_.reset();
+  }
+}
+
 inline void SyncedMemory::to_cpu() {
   check_device();
+  restore_cpu_data();
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
@@ -66,6 +77,7 @@ inline void SyncedMemory::to_cpu() {
 inline void SyncedMemory::to_gpu() {
   check_device();
 #ifndef CPU_ONLY
+  restore_cpu_data();
   switch (head_) {
   case UNINITIALIZED:
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
@@ -99,12 +111,20 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   check_device();
   CHECK(data);
-  if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+  if (own_cpu_data_ && cpu_ptr_) {
+    CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  cpu_data_owner_.reset();
+  compact_.reset();
+  ++version_;
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
+  set_cpu_data(data);
+  cpu_data_owner_ = owner;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -128,6 +148,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  ++version_;
 #else
   NO_GPU;
 #endif
@@ -137,6 +158,7 @@ void* SyncedMemory::mutable_cpu_data() {
   check_device();
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -145,6 +167,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -152,9 +175,29 @@ void* SyncedMemory::mutable_gpu_data() {
 #endif
 }
 
+void SyncedMemory::ReleaseCpuData(const shared_ptr<SyncedMemory>& compact,
+    void (*restore)(const void*, void*, size_t)) {
+  check_device();
+  if (head_ != HEAD_AT_CPU || !own_cpu_data_ || compact_) {
+    return;
+  }
+  CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_);
+  cpu_ptr_ = NULL;
+  compact_ = compact;
+  restore_ = restore;
+}
+
+size_t SyncedMemory::cpu_bytes() const {
+  if (compact_) {
+    return compact_->size();
+  }
+  return cpu_ptr_ ? size_ : 0;
+}
+
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   check_device();
+  restore_cpu_data();
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
@@ -8,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -130,4 +131,75 @@ namespace caffe {
         this->blob_top_vec_);
   }
 
+  TYPED_TEST(BatchNormLayerTest, TestForwardLargeMean) {
+    typedef typename TypeParam::Dtype Dtype;
+    // The variance of values far from 0 is lost to cancellation when taken
+    // as E(X^2) - E(X)^2.
+    const int count = this->blob_bottom_->count();
+    caffe_add_scalar(count, Dtype(1000),
+        this->blob_bottom_->mutable_cpu_data());
+    LayerParameter layer_param;
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int channels = this->blob_bottom_->channels();
+    const int spatial_dim = this->blob_bottom_->count(2);
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    for (int j = 0; j < channels; ++j) {
+      Dtype sum = 0, var = 0;
+      for (int i = 0; i < this->blob_bottom_->num(); ++i) {
+        for (int k = 0; k < spatial_dim; ++k) {
+          Dtype data = top_data[(i * channels + j) * spatial_dim + k];
+          sum += data;
+          var += data * data;
+        }
+      }
+      sum /= count / channels;
+      var /= count / channels;
+      EXPECT_NEAR(0, sum, 0.001);
+      EXPECT_NEAR(1, var, 0.01);
+    }
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestThreads) {
+    typedef typename TypeParam::Dtype Dtype;
+    if (Caffe::mode() != Caffe::CPU) {
+      return;
+    }
+    const int count = this->blob_bottom_->count();
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_bottom_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&top_diff);
+    vector<bool> propagate_down(1, true);
+    // Train with one thread for the reference, then with three, both apart
+    // and in-place.
+    Blob<Dtype> top_data, bottom_diff, inplace;
+    for (int run = 0; run < 3; ++run) {
+      ThreadPool::Get().set_num_threads(run == 0 ? 1 : 3);
+      LayerParameter layer_param;
+      BatchNormLayer<Dtype> layer(layer_param);
+      vector<Blob<Dtype>*> bottom_vec, top_vec;
+      inplace.CopyFrom(*this->blob_bottom_, false, true);
+      bottom_vec.push_back(run == 2 ? &inplace : this->blob_bottom_);
+      top_vec.push_back(run == 2 ? &inplace : this->blob_top_);
+      layer.SetUp(bottom_vec, top_vec);
+      layer.Forward(bottom_vec, top_vec);
+      caffe_copy(count, top_diff.cpu_data(), top_vec[0]->mutable_cpu_diff());
+      layer.Backward(top_vec, propagate_down, bottom_vec);
+      if (run == 0) {
+        top_data.CopyFrom(*top_vec[0], false, true);
+        bottom_diff.CopyFrom(*bottom_vec[0], true, true);
+        continue;
+      }
+      for (int i = 0; i < count; ++i) {
+        EXPECT_NEAR(top_data.cpu_data()[i], top_vec[0]->cpu_data()[i], 1e-5);
+        EXPECT_NEAR(bottom_diff.cpu_diff()[i], bottom_vec[0]->cpu_diff()[i],
+            1e-5);
+      }
+    }
+    ThreadPool::Get().set_num_threads(1);
+  }
+
 }  // namespace caffe
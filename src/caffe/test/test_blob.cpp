@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -59,6 +60,73 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShareView) {
+  typedef TypeParam Dtype;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  // The second item of the preshaped 2 x 3 x 4 x 5 blob.
+  Blob<Dtype> view(1, 3, 4, 5);
+  view.ShareView(*this->blob_preshaped_, 60);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data() + 60, view.cpu_data());
+  EXPECT_EQ(this->blob_preshaped_->mutable_cpu_diff() + 60,
+      view.mutable_cpu_diff());
+  EXPECT_EQ(this->blob_preshaped_->data_at(1, 2, 3, 4),
+      view.data_at(0, 2, 3, 4));
+  view.mutable_cpu_data()[0] = 7;
+  EXPECT_EQ(7, this->blob_preshaped_->data_at(1, 0, 0, 0));
+  // A view of a view starts at the sum of the offsets.
+  Blob<Dtype> inner(1, 1, 4, 5);
+  inner.ShareView(view, 20);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data() + 80, inner.cpu_data());
+  // Reshaping a view to as many values keeps it, to more gives it its own
+  // storage.
+  view.Reshape(3, 1, 4, 5);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data() + 60, view.cpu_data());
+  view.Reshape(2, 3, 4, 5);
+  view.mutable_cpu_data()[0] = 8;
+  EXPECT_NE(this->blob_preshaped_->cpu_data() + 60, view.cpu_data());
+  EXPECT_EQ(7, this->blob_preshaped_->data_at(1, 0, 0, 0));
+}
+
+TYPED_TEST(BlobSimpleTest, TestRowSparseDiff) {
+  typedef TypeParam Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  Blob<Dtype>* blob = this->blob_preshaped_;
+  const int dim = blob->count(1);
+  caffe_set(blob->count(), Dtype(1), blob->mutable_cpu_diff());
+  caffe_set(blob->count(), Dtype(0), blob->mutable_cpu_data());
+  blob->set_row_sparse_diff(true);
+  // The diff is dense until it is first cleared.
+  EXPECT_FALSE(blob->row_sparse_diff());
+  blob->ClearDiff();
+  EXPECT_TRUE(blob->row_sparse_diff());
+  EXPECT_EQ(0, blob->asum_diff());
+  EXPECT_EQ(0, blob->diff_rows().size());
+  caffe_set(dim, Dtype(2), blob->mutable_cpu_diff() + dim);
+  blob->add_diff_row(1);
+  blob->add_diff_row(1);
+  ASSERT_EQ(1, blob->diff_rows().size());
+  EXPECT_EQ(1, blob->diff_rows()[0]);
+  EXPECT_EQ(4 * dim, blob->sumsq_diff());
+  blob->scale_diff(Dtype(0.5));
+  blob->Update();
+  for (int i = 0; i < dim; ++i) {
+    EXPECT_EQ(0, blob->cpu_data()[i]);
+    EXPECT_EQ(-1, blob->cpu_data()[dim + i]);
+  }
+  blob->ClearDiff();
+  EXPECT_EQ(0, blob->asum_diff());
+  EXPECT_EQ(0, blob->diff_rows().size());
+  // A dense diff is cleared whole.
+  caffe_set(blob->count(), Dtype(1), blob->mutable_cpu_diff());
+  blob->set_diff_dense();
+  EXPECT_FALSE(blob->row_sparse_diff());
+  blob->ClearDiff();
+  EXPECT_EQ(0, blob->asum_diff());
+  EXPECT_TRUE(blob->row_sparse_diff());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
@@ -112,6 +180,67 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestToFromProtoHalf) {
+  // The data written in 16 bits reads back within the precision of the
+  // format, while the diff stays in the Dtype.
+  FillerParameter filler_param;
+  filler_param.set_std(100);
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  TypeParam* diff = this->blob_preshaped_->mutable_cpu_diff();
+  for (int i = 0; i < this->blob_preshaped_->count(); ++i) {
+    diff[i] = i;
+  }
+  const StorageType storages[] = {FLOAT16, BFLOAT16};
+  const TypeParam precisions[] = {1. / 2048, 1. / 256};
+  for (int s = 0; s < 2; ++s) {
+    BlobProto proto;
+    this->blob_preshaped_->ToProto(&proto, true, storages[s]);
+    EXPECT_EQ(0, proto.data_size() + proto.double_data_size());
+    EXPECT_EQ(2 * this->blob_preshaped_->count(), proto.half_data().size());
+    Blob<TypeParam> blob;
+    blob.FromProto(proto);
+    EXPECT_EQ(this->blob_preshaped_->shape(), blob.shape());
+    for (int i = 0; i < blob.count(); ++i) {
+      const TypeParam expected = this->blob_preshaped_->cpu_data()[i];
+      EXPECT_NEAR(expected, blob.cpu_data()[i],
+          precisions[s] * std::fabs(expected));
+      EXPECT_EQ(i, blob.cpu_diff()[i]);
+    }
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestToFromProtoCSR) {
+  // Only the nonzeros are written, in rows over the first axis, and read
+  // back exactly.
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  int nonzeros = 0;
+  for (int i = 0; i < this->blob_preshaped_->count(); ++i) {
+    data[i] = std::fabs(data[i]) < 1 ? TypeParam(0) : data[i];
+    nonzeros += data[i] != 0;
+  }
+  // An empty row.
+  for (int i = 0; i < this->blob_preshaped_->count(1); ++i) {
+    nonzeros -= data[i] != 0;
+    data[i] = 0;
+  }
+  BlobProto proto;
+  this->blob_preshaped_->ToProto(&proto, false, CSR);
+  EXPECT_EQ(nonzeros, proto.data_size() + proto.double_data_size());
+  EXPECT_EQ(nonzeros, proto.csr_columns_size());
+  EXPECT_EQ(this->blob_preshaped_->shape(0) + 1,
+      proto.csr_row_offsets_size());
+  Blob<TypeParam> blob;
+  blob.FromProto(proto);
+  EXPECT_EQ(this->blob_preshaped_->shape(), blob.shape());
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(this->blob_preshaped_->cpu_data()[i], blob.cpu_data()[i]);
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,7 +7,11 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -467,6 +473,38 @@ TYPED_TEST(ConvolutionLayerTest, Test1x1Convolution) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestSparse1x1Convolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // In the TEST phase, pruned 1x1 filters are multiplied in CSR.
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(1);
+  convolution_param->add_stride(1);
+  convolution_param->set_num_output(16);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Keep the filters of magnitude 1.5 and up, about one in eight.
+  Blob<Dtype>* weights = layer->blobs()[0].get();
+  Dtype* weight_data = weights->mutable_cpu_data();
+  for (int i = 0; i < weights->count(); ++i) {
+    weight_data[i] = std::fabs(weight_data[i]) < 1.5 ? Dtype(0) :
+        weight_data[i];
+  }
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -495,6 +533,46 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Padded, dilated and strided depthwise convolutions, split over threads.
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 6;
+  bottom_shape[2] = 9;
+  bottom_shape[3] = 8;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_->Reshape(bottom_shape);
+  filler.Fill(this->blob_bottom_);
+  ThreadPool::Get().set_num_threads(3);
+  for (int c = 0; c < 3; ++c) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(c == 1 ? 2 : 1);
+    convolution_param->add_stride(c == 2 ? 2 : 1);
+    convolution_param->add_dilation(c == 1 ? 2 : 1);
+    convolution_param->set_num_output(6);
+    convolution_param->set_group(6);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    shared_ptr<Layer<Dtype> > layer(
+        new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+  ThreadPool::Get().set_num_threads(1);
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
@@ -811,6 +889,527 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestGradientDepthwise) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(2);
+  convolution_param->add_stride(2);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ThreadPool::Get().set_num_threads(2);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  ThreadPool::Get().set_num_threads(1);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedGemm) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 6;
+  bottom_shape[2] = 7;
+  bottom_shape[3] = 5;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_->Reshape(bottom_shape);
+  filler.Fill(this->blob_bottom_);
+  vector<bool> propagate_down(1, true);
+  for (int kernel_size = 1; kernel_size <= 3; kernel_size += 2) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kernel_size);
+    convolution_param->add_pad(kernel_size / 2);
+    convolution_param->set_num_output(4);
+    convolution_param->set_group(2);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    // Forward and Backward one image at a time.
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> top;
+    top.CopyFrom(*this->blob_top_, false, true);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(top);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    Blob<Dtype> bottom_diff;
+    bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+    // The columns of two images fit in the budget: the five images take
+    // three GEMMs per group.
+    const int image_bytes = sizeof(Dtype) * bottom_shape[2] *
+        bottom_shape[3] * (bottom_shape[1] * kernel_size * kernel_size + 4);
+    convolution_param->set_batched_col_buffer_bytes(2 * image_bytes + 1);
+    ConvolutionLayer<Dtype> batched_layer(layer_param);
+    batched_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      batched_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    batched_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_NEAR(top.cpu_data()[i], this->blob_top_->cpu_data()[i], 1e-4);
+    }
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    batched_layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    for (int i = 0; i < bottom_diff.count(); ++i) {
+      EXPECT_NEAR(bottom_diff.cpu_diff()[i],
+          this->blob_bottom_->cpu_diff()[i], 1e-4);
+    }
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      const Blob<Dtype>& param = *layer.blobs()[i];
+      const Blob<Dtype>& batched_param = *batched_layer.blobs()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_NEAR(param.cpu_diff()[j], batched_param.cpu_diff()[j], 1e-3);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientBatchedGemm) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->set_batched_col_buffer_bytes(1 << 20);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestThreadPool) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 6;
+  bottom_shape[3] = 5;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_->Reshape(bottom_shape);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  vector<bool> propagate_down(1, true);
+  shared_ptr<Blob<Dtype> > top_diff;
+  vector<shared_ptr<Layer<Dtype> > > layers;
+  vector<shared_ptr<Blob<Dtype> > > tops;
+  vector<shared_ptr<Blob<Dtype> > > bottom_diffs;
+  // One thread, then three threads twice.
+  for (int i = 0; i < 3; ++i) {
+    ThreadPool::Get().set_num_threads(i == 0 ? 1 : 3);
+    layers.push_back(shared_ptr<Layer<Dtype> >(
+        new ConvolutionLayer<Dtype>(layer_param)));
+    layers[i]->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (i == 0) {
+      top_diff.reset(new Blob<Dtype>());
+      top_diff->ReshapeLike(*this->blob_top_);
+      filler.Fill(top_diff.get());
+    } else {
+      for (int j = 0; j < layers[0]->blobs().size(); ++j) {
+        layers[i]->blobs()[j]->CopyFrom(*layers[0]->blobs()[j]);
+      }
+    }
+    layers[i]->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    tops.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    tops[i]->CopyFrom(*this->blob_top_, false, true);
+    caffe_copy(top_diff->count(), top_diff->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layers[i]->Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    bottom_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    bottom_diffs[i]->CopyFrom(*this->blob_bottom_, true, true);
+  }
+  ThreadPool::Get().set_num_threads(1);
+  // Each image goes through the same computation on any thread; only the
+  // weight gradient is summed in another order.
+  for (int i = 1; i < 3; ++i) {
+    for (int j = 0; j < tops[0]->count(); ++j) {
+      EXPECT_EQ(tops[0]->cpu_data()[j], tops[i]->cpu_data()[j]);
+    }
+    for (int j = 0; j < bottom_diffs[0]->count(); ++j) {
+      EXPECT_EQ(bottom_diffs[0]->cpu_diff()[j],
+          bottom_diffs[i]->cpu_diff()[j]);
+    }
+    for (int j = 0; j < layers[0]->blobs().size(); ++j) {
+      const Blob<Dtype>& param = *layers[0]->blobs()[j];
+      const Blob<Dtype>& threaded_param = *layers[i]->blobs()[j];
+      for (int k = 0; k < param.count(); ++k) {
+        EXPECT_NEAR(param.cpu_diff()[k], threaded_param.cpu_diff()[k], 1e-3);
+      }
+    }
+  }
+  // The same number of threads gives the same sums.
+  for (int j = 0; j < layers[1]->blobs().size(); ++j) {
+    const Blob<Dtype>& param = *layers[1]->blobs()[j];
+    const Blob<Dtype>& same_param = *layers[2]->blobs()[j];
+    for (int k = 0; k < param.count(); ++k) {
+      EXPECT_EQ(param.cpu_diff()[k], same_param.cpu_diff()[k]);
+    }
+  }
+}
+
+// Rounds each of the rows of the blob to the int8 grid of the int8 inference:
+// with the given scale, or with max |x| / 127 of the row for scale 0.
+template <typename Dtype>
+void fake_quantize(Blob<Dtype>* blob, int rows, Dtype scale) {
+  const int cols = blob->count() / rows;
+  vector<int8_t> quantized(cols);
+  for (int r = 0; r < rows; ++r) {
+    Dtype* row = blob->mutable_cpu_data() + r * cols;
+    Dtype row_scale = scale;
+    if (scale == 0) {
+      for (int c = 0; c < cols; ++c) {
+        row_scale = std::max(row_scale, std::fabs(row[c]) / 127);
+      }
+    }
+    caffe_cpu_quantize(cols, 1 / row_scale, row, &quantized[0]);
+    for (int c = 0; c < cols; ++c) {
+      row[c] = quantized[c] * row_scale;
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestInt8Forward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Padded, strided, dilated and grouped 2D convolutions in int8 compute the
+  // float convolution of the input and filters rounded to their int8 grids.
+  for (int c = 0; c < 3; ++c) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(c == 0 ? 1 : 2);
+    convolution_param->add_stride(c == 1 ? 2 : 1);
+    convolution_param->add_dilation(c == 1 ? 2 : 1);
+    convolution_param->set_num_output(6);
+    convolution_param->set_group(c == 2 ? 3 : 1);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    // Clip the largest inputs.
+    const Dtype input_scale = 2.5 / 127;
+    layer_param.mutable_quantization_param()->set_input_scale(input_scale);
+    shared_ptr<Layer<Dtype> > layer(new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> bottom;
+    bottom.CopyFrom(*this->blob_bottom_, false, true);
+    vector<shared_ptr<Blob<Dtype> > > weights(2);
+    for (int i = 0; i < 2; ++i) {
+      weights[i].reset(new Blob<Dtype>());
+      weights[i]->CopyFrom(*layer->blobs()[i], false, true);
+    }
+    // The GPU runs in float.
+    if (Caffe::mode() == Caffe::CPU) {
+      fake_quantize(&bottom, 1, input_scale);
+      fake_quantize(weights[0].get(), 6, Dtype(0));
+    }
+    caffe_conv(&bottom, convolution_param, weights,
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
+template <typename Dtype>
+class WinogradConvolutionLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  WinogradConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()),
+        ref_blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~WinogradConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete ref_blob_top_;
+  }
+
+  void FillBottom(int num, int channels, int height, int width) {
+    blob_bottom_->Reshape(num, channels, height, width);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_);
+  }
+
+  // Checks the top of layer against the reference convolution.
+  void CheckTop(ConvolutionParameter* convolution_param, Layer<Dtype>* layer,
+      const Dtype tolerance) {
+    ref_blob_top_->ReshapeLike(*blob_top_);
+    // caffe_conv accumulates into its output.
+    caffe_set(ref_blob_top_->count(), Dtype(0),
+        ref_blob_top_->mutable_cpu_data());
+    caffe_conv(blob_bottom_, convolution_param, layer->blobs(),
+        ref_blob_top_);
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      EXPECT_NEAR(blob_top_->cpu_data()[i], ref_blob_top_->cpu_data()[i],
+          tolerance);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const ref_blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WinogradConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestSimpleConvolutionWinograd) {
+  // Small outputs use F(2x2, 3x3) tiles, large ones F(4x4, 3x3).
+  const int kHeights[] = { 6, 10 };
+  const int kWidths[] = { 4, 13 };
+  for (int shape = 0; shape < 2; ++shape) {
+    for (int pad = 0; pad <= 2; ++pad) {
+      this->FillBottom(2, 3, kHeights[shape], kWidths[shape]);
+      LayerParameter layer_param;
+      ConvolutionParameter* convolution_param =
+          layer_param.mutable_convolution_param();
+      convolution_param->add_kernel_size(3);
+      convolution_param->add_pad(pad);
+      convolution_param->set_num_output(4);
+      convolution_param->mutable_weight_filler()->set_type("gaussian");
+      convolution_param->mutable_bias_filler()->set_type("constant");
+      convolution_param->mutable_bias_filler()->set_value(0.1);
+      WinogradConvolutionLayer<TypeParam> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      EXPECT_EQ(this->blob_top_->height(), kHeights[shape] + 2 * pad - 2);
+      EXPECT_EQ(this->blob_top_->width(), kWidths[shape] + 2 * pad - 2);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      this->CheckTop(convolution_param, &layer, 1e-3);
+    }
+  }
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestConvolutionGroupWinograd) {
+  this->FillBottom(2, 6, 9, 8);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckTop(convolution_param, &layer, 1e-3);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestFilterChangeWinograd) {
+  this->FillBottom(1, 3, 8, 8);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The transformed filters must follow the filters.
+  caffe_scal(layer.blobs()[0]->count(), TypeParam(-2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckTop(convolution_param, &layer, 1e-3);
+  Blob<TypeParam> filters;
+  filters.CopyFrom(*layer.blobs()[0], false, true);
+  layer.blobs()[0]->ShareData(filters);
+  caffe_scal(filters.count(), TypeParam(0.5), filters.mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckTop(convolution_param, &layer, 1e-3);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestFallbackWinograd) {
+  this->FillBottom(2, 3, 7, 6);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  EXPECT_FALSE(
+      WinogradConvolutionLayer<TypeParam>::IsSupported(*convolution_param));
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckTop(convolution_param, &layer, 1e-4);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestEngineSelection) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  EXPECT_TRUE(
+      WinogradConvolutionLayer<TypeParam>::IsSupported(*convolution_param));
+#ifndef USE_CUDNN
+  shared_ptr<Layer<TypeParam> > layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<WinogradConvolutionLayer<TypeParam>*>(
+      layer.get()));
+  // Depthwise convolutions keep to their own kernel.
+  convolution_param->set_group(4);
+  shared_ptr<Layer<TypeParam> > depthwise_layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  EXPECT_FALSE(dynamic_cast<WinogradConvolutionLayer<TypeParam>*>(
+      depthwise_layer.get()));
+  convolution_param->set_group(1);
+#endif
+  convolution_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+  shared_ptr<Layer<TypeParam> > caffe_layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  EXPECT_FALSE(dynamic_cast<WinogradConvolutionLayer<TypeParam>*>(
+      caffe_layer.get()));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGradientWinograd) {
+  this->FillBottom(2, 3, 6, 5);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGradientLargeTilesWinograd) {
+  this->FillBottom(1, 2, 9, 8);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(2);
+  convolution_param->set_num_output(2);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  // F(4x4, 3x3) rounds more than F(2x2, 3x3): the finite differences of float
+  // outputs are off by a few 1e-3.
+  GradientChecker<TypeParam> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestThreadPoolWinograd) {
+  typedef TypeParam Dtype;
+  this->FillBottom(5, 4, 10, 9);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  vector<bool> propagate_down(1, true);
+  Blob<Dtype> top_diff;
+  vector<shared_ptr<Layer<Dtype> > > layers;
+  vector<shared_ptr<Blob<Dtype> > > tops;
+  vector<shared_ptr<Blob<Dtype> > > bottom_diffs;
+  // One thread, then three threads twice.
+  for (int i = 0; i < 3; ++i) {
+    ThreadPool::Get().set_num_threads(i == 0 ? 1 : 3);
+    layers.push_back(shared_ptr<Layer<Dtype> >(
+        new WinogradConvolutionLayer<Dtype>(layer_param)));
+    layers[i]->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (i == 0) {
+      top_diff.ReshapeLike(*this->blob_top_);
+      filler.Fill(&top_diff);
+    } else {
+      for (int j = 0; j < layers[0]->blobs().size(); ++j) {
+        layers[i]->blobs()[j]->CopyFrom(*layers[0]->blobs()[j]);
+      }
+    }
+    layers[i]->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    tops.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    tops[i]->CopyFrom(*this->blob_top_, false, true);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layers[i]->Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    bottom_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    bottom_diffs[i]->CopyFrom(*this->blob_bottom_, true, true);
+  }
+  ThreadPool::Get().set_num_threads(1);
+  // Each image goes through the same computation on any thread; only the
+  // weight gradient is summed in another order.
+  for (int i = 1; i < 3; ++i) {
+    for (int j = 0; j < tops[0]->count(); ++j) {
+      EXPECT_EQ(tops[0]->cpu_data()[j], tops[i]->cpu_data()[j]);
+    }
+    for (int j = 0; j < bottom_diffs[0]->count(); ++j) {
+      EXPECT_EQ(bottom_diffs[0]->cpu_diff()[j],
+          bottom_diffs[i]->cpu_diff()[j]);
+    }
+    for (int j = 0; j < layers[0]->blobs().size(); ++j) {
+      const Blob<Dtype>& param = *layers[0]->blobs()[j];
+      const Blob<Dtype>& threaded_param = *layers[i]->blobs()[j];
+      for (int k = 0; k < param.count(); ++k) {
+        EXPECT_NEAR(param.cpu_diff()[k], threaded_param.cpu_diff()[k], 1e-3);
+      }
+    }
+  }
+  // The same number of threads gives the same sums.
+  for (int j = 0; j < layers[1]->blobs().size(); ++j) {
+    const Blob<Dtype>& param = *layers[1]->blobs()[j];
+    const Blob<Dtype>& same_param = *layers[2]->blobs()[j];
+    for (int k = 0; k < param.count(); ++k) {
+      EXPECT_EQ(param.cpu_diff()[k], same_param.cpu_diff()[k]);
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -161,6 +161,35 @@ TYPED_TEST(CropLayerTest, TestCropAllOffset) {
   }
 }
 
+TYPED_TEST(CropLayerTest, TestCropView) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_crop_param()->set_axis(0);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(1);
+  layer_param.mutable_crop_param()->add_offset(0);
+  layer_param.mutable_crop_param()->add_offset(0);
+  // Channels 1 and 2 of the second image are contiguous in the bottom.
+  this->blob_bottom_1_->Reshape(1, 2, 5, 4);
+  CropLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(layer.SharesBottomData());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_bottom_0_->cpu_data() +
+      this->blob_bottom_0_->offset(1, 1), this->blob_top_->cpu_data());
+  for (int c = 0; c < 2; ++c) {
+    for (int h = 0; h < 5; ++h) {
+      for (int w = 0; w < 4; ++w) {
+        EXPECT_EQ(this->blob_bottom_0_->data_at(1, c + 1, h, w),
+            this->blob_top_->data_at(0, c, h, w));
+      }
+    }
+  }
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
 TYPED_TEST(CropLayerTest, TestCropHW) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
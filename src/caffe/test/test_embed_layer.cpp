@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -175,4 +176,40 @@ TYPED_TEST(EmbedLayerTest, TestGradientWithBias) {
       this->blob_top_vec_, -2);
 }
 
+TYPED_TEST(EmbedLayerTest, TestSparseGradientRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  LayerParameter layer_param;
+  EmbedParameter* embed_param = layer_param.mutable_embed_param();
+  const int kNumOutput = 10;
+  embed_param->set_num_output(kNumOutput);
+  embed_param->set_input_dim(5);
+  embed_param->set_sparse_gradient(true);
+  EmbedLayer<Dtype> layer(layer_param);
+  this->blob_bottom_->mutable_cpu_data()[0] = 4;
+  this->blob_bottom_->mutable_cpu_data()[1] = 2;
+  this->blob_bottom_->mutable_cpu_data()[2] = 2;
+  this->blob_bottom_->mutable_cpu_data()[3] = 0;
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weight = layer.blobs()[0].get();
+  weight->ClearDiff();
+  caffe_set(this->blob_top_->count(), Dtype(1),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, false);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  ASSERT_TRUE(weight->row_sparse_diff());
+  vector<int> rows = weight->diff_rows();
+  std::sort(rows.begin(), rows.end());
+  ASSERT_EQ(3, rows.size());
+  EXPECT_EQ(0, rows[0]);
+  EXPECT_EQ(2, rows[1]);
+  EXPECT_EQ(4, rows[2]);
+  for (int j = 0; j < kNumOutput; ++j) {
+    EXPECT_EQ(1, weight->diff_at(0, j, 0, 0));
+    EXPECT_EQ(0, weight->diff_at(1, j, 0, 0));
+    EXPECT_EQ(2, weight->diff_at(2, j, 0, 0));
+  }
+}
+
 }  // namespace caffe
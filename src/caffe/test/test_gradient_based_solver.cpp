@@ -11,6 +11,7 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/solver_factory.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -1286,4 +1287,107 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+// Embeddings of 3 rows of 2 updated by a net whose loss is the sum of the
+// embeddings of its 2 indices, with sparse or dense gradients.
+template <typename Dtype>
+class LazySolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  void InitSolver(const string& type, const bool sparse_gradient) {
+    ostringstream proto;
+    proto <<
+       "type: '" << type << "' "
+       "base_lr: 0.1 "
+       "lr_policy: 'fixed' "
+       "momentum: 0.9 "
+       "momentum2: 0.99 "
+       "weight_decay: 0.01 "
+       "solver_mode: CPU "
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'Input' "
+       "    top: 'data' "
+       "    input_param { shape { dim: 2 } } "
+       "  } "
+       "  layer { "
+       "    name: 'embed' "
+       "    type: 'Embed' "
+       "    bottom: 'data' "
+       "    top: 'embed' "
+       "    embed_param { "
+       "      num_output: 2 "
+       "      input_dim: 3 "
+       "      bias_term: false "
+       "      weight_filler { type: 'constant' value: 1 } "
+       "      sparse_gradient: " << sparse_gradient << " "
+       "    } "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'Reduction' "
+       "    bottom: 'embed' "
+       "    top: 'loss' "
+       "    loss_weight: 1 "
+       "  } "
+       "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    solver_.reset(SolverRegistry<Dtype>::CreateSolver(param));
+  }
+
+  void Step(const int index0, const int index1) {
+    Blob<Dtype>* data = solver_->net()->blob_by_name("data").get();
+    data->mutable_cpu_data()[0] = index0;
+    data->mutable_cpu_data()[1] = index1;
+    solver_->Step(1);
+  }
+
+  const Dtype* weights() {
+    return solver_->net()->learnable_params()[0]->cpu_data();
+  }
+
+  // Updates rows 0 and 1 for an iteration and row 0 alone for two: the lazy
+  // updates match the dense ones for the rows updated at every iteration,
+  // and leave the others untouched until they are updated again.
+  void TestLazyUpdate(const string& type) {
+    InitSolver(type, false);
+    Step(0, 1);
+    Step(0, 0);
+    Step(0, 0);
+    vector<Dtype> dense(weights(), weights() + 6);
+    InitSolver(type, true);
+    Step(0, 1);
+    const Dtype row1 = weights()[2];
+    Step(0, 0);
+    Step(0, 0);
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_NEAR(dense[i], weights()[i], 1e-6);
+      EXPECT_EQ(row1, weights()[2 + i]);
+      EXPECT_EQ(1, weights()[4 + i]);
+    }
+    EXPECT_GT(row1, dense[2]);
+  }
+
+  shared_ptr<Solver<Dtype> > solver_;
+};
+
+TYPED_TEST_CASE(LazySolverTest, TestDtypes);
+
+TYPED_TEST(LazySolverTest, TestSGDLazyUpdate) {
+  typedef TypeParam Dtype;
+  this->TestLazyUpdate("SGD");
+  // Row 1 catches up on the decay of its history over the two iterations it
+  // was left out of: w = 1 - 0.101, h = 0.1 * (1 + 0.01 w) + 0.9^3 * 0.101.
+  this->Step(1, 2);
+  const Dtype w = 1 - 0.101;
+  const Dtype h = 0.1 * (1 + 0.01 * w) + 0.9 * 0.9 * 0.9 * 0.101;
+  EXPECT_NEAR(w - h, this->weights()[2], 1e-6);
+  EXPECT_NEAR(w - h, this->weights()[3], 1e-6);
+}
+
+TYPED_TEST(LazySolverTest, TestAdamLazyUpdate) {
+  this->TestLazyUpdate("Adam");
+}
+
 }  // namespace caffe
@@ -0,0 +1,156 @@
+#include <stdint.h>
+
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  HostAllocatorTest() : allocator_(HostAllocator::Get()) {}
+  virtual void SetUp() {
+    allocator_.Trim();
+    allocator_.ResetCounters();
+  }
+
+  HostAllocator& allocator_;
+};
+
+TEST_F(HostAllocatorTest, TestRoundSize) {
+  int index;
+  EXPECT_EQ(HostAllocator::RoundSize(0, &index), 64);
+  EXPECT_EQ(index, 0);
+  EXPECT_EQ(HostAllocator::RoundSize(64, &index), 64);
+  EXPECT_EQ(index, 0);
+  EXPECT_EQ(HostAllocator::RoundSize(65, &index), 80);
+  EXPECT_EQ(index, 1);
+  EXPECT_EQ(HostAllocator::RoundSize(128, &index), 128);
+  EXPECT_EQ(index, 4);
+  EXPECT_EQ(HostAllocator::RoundSize(129, &index), 160);
+  EXPECT_EQ(index, 5);
+  EXPECT_EQ(HostAllocator::RoundSize(1000000), 1048576);
+  // A class never wastes more than a quarter of the block.
+  for (size_t size = 65; size < 100000; size += 97) {
+    const size_t rounded = HostAllocator::RoundSize(size);
+    EXPECT_GE(rounded, size);
+    EXPECT_LT(rounded - size, rounded / 4);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestAlignment) {
+  const size_t sizes[] = { 1, 13, 64, 100, 4096, 12345 };
+  for (int i = 0; i < 6; ++i) {
+    void* ptr = allocator_.Allocate(sizes[i]);
+    ASSERT_TRUE(ptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % HostAllocator::kAlignment, 0);
+    allocator_.Free(ptr, sizes[i]);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestReuse) {
+  void* ptr = allocator_.Allocate(1000);
+  EXPECT_EQ(allocator_.misses(), 1);
+  EXPECT_EQ(allocator_.hits(), 0);
+  allocator_.Free(ptr, 1000);
+  EXPECT_EQ(allocator_.cached_bytes(), HostAllocator::RoundSize(1000));
+  // Any size of the same class gets the cached block back.
+  void* other_ptr = allocator_.Allocate(990);
+  EXPECT_EQ(other_ptr, ptr);
+  EXPECT_EQ(allocator_.hits(), 1);
+  EXPECT_EQ(allocator_.cached_bytes(), 0);
+  // Other classes do not.
+  void* large_ptr = allocator_.Allocate(2000);
+  EXPECT_EQ(allocator_.misses(), 2);
+  allocator_.Free(other_ptr, 990);
+  allocator_.Free(large_ptr, 2000);
+}
+
+TEST_F(HostAllocatorTest, TestTrim) {
+  vector<void*> ptrs;
+  for (int i = 1; i <= 10; ++i) {
+    ptrs.push_back(allocator_.Allocate(i * 100));
+  }
+  for (int i = 1; i <= 10; ++i) {
+    allocator_.Free(ptrs[i - 1], i * 100);
+  }
+  EXPECT_GT(allocator_.cached_bytes(), 0);
+  allocator_.Trim();
+  EXPECT_EQ(allocator_.cached_bytes(), 0);
+  allocator_.Free(allocator_.Allocate(100), 100);
+  EXPECT_EQ(allocator_.hits(), 0);
+}
+
+TEST_F(HostAllocatorTest, TestMaxCachedBytes) {
+  allocator_.set_max_cached_bytes(1024);
+  void* small_ptr = allocator_.Allocate(512);
+  void* large_ptr = allocator_.Allocate(4096);
+  allocator_.Free(small_ptr, 512);
+  allocator_.Free(large_ptr, 4096);
+  EXPECT_EQ(allocator_.cached_bytes(), 512);
+  allocator_.set_max_cached_bytes(0);
+  EXPECT_EQ(allocator_.cached_bytes(), 0);
+  allocator_.set_max_cached_bytes(HostAllocator::kDefaultMaxCachedBytes);
+}
+
+TEST_F(HostAllocatorTest, TestLowerMaxCachedBytes) {
+  // Lowering the limit releases the largest blocks until the cache fits.
+  EXPECT_EQ(allocator_.max_cached_bytes(),
+      HostAllocator::kDefaultMaxCachedBytes);
+  const size_t sizes[] = { 64, 100, 1000, 5000 };
+  vector<void*> ptrs;
+  for (int i = 0; i < 4; ++i) {
+    ptrs.push_back(allocator_.Allocate(sizes[i]));
+  }
+  for (int i = 0; i < 4; ++i) {
+    allocator_.Free(ptrs[i], sizes[i]);
+  }
+  const size_t small_bytes = HostAllocator::RoundSize(64) +
+      HostAllocator::RoundSize(100);
+  allocator_.set_max_cached_bytes(small_bytes + 100);
+  EXPECT_EQ(allocator_.cached_bytes(), small_bytes);
+  EXPECT_EQ(allocator_.Allocate(100), ptrs[1]);
+  allocator_.Free(ptrs[1], 100);
+  allocator_.set_max_cached_bytes(HostAllocator::kDefaultMaxCachedBytes);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  {
+    SyncedMemory mem(3000);
+    EXPECT_TRUE(mem.mutable_cpu_data());
+  }
+  EXPECT_EQ(allocator_.cached_bytes(), HostAllocator::RoundSize(3000));
+  SyncedMemory mem(3000);
+  EXPECT_TRUE(mem.cpu_data());
+  EXPECT_EQ(allocator_.hits(), 1);
+}
+
+static void AllocateAndFree(HostAllocator* allocator, int seed) {
+  for (int i = 0; i < 1000; ++i) {
+    const size_t size = 64 + ((i * 7919 + seed * 104729) % 10000);
+    char* ptr = static_cast<char*>(allocator->Allocate(size));
+    ptr[0] = ptr[size - 1] = static_cast<char>(i);
+    allocator->Free(ptr, size);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestThreads) {
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&AllocateAndFree, &allocator_, i)));
+  }
+  for (int i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+  }
+  EXPECT_EQ(allocator_.hits() + allocator_.misses(), 4000);
+}
+
+}  // namespace caffe
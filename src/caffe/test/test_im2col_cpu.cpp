@@ -0,0 +1,85 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/im2col.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Checks im2col_cpu and col2im_cpu, whose fast paths handle stride_w 1 and 2
+// without dilation, against the generic kernels.
+template <typename Dtype>
+class Im2colCPUTest : public CPUDeviceTest<Dtype> {
+ protected:
+  void Check(int channels, int height, int width, int kernel, int pad,
+      int stride_h, int stride_w, int dilation) {
+    const int output_h =
+        (height + 2 * pad - (dilation * (kernel - 1) + 1)) / stride_h + 1;
+    const int output_w =
+        (width + 2 * pad - (dilation * (kernel - 1) + 1)) / stride_w + 1;
+    if (output_h <= 0 || output_w <= 0) {
+      return;
+    }
+    Blob<Dtype> im(1, channels, height, width);
+    Blob<Dtype> col(1, channels * kernel * kernel, output_h, output_w);
+    Blob<Dtype> ref_col(col.shape());
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&im);
+    im2col_cpu(im.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride_h, stride_w, dilation, dilation,
+        col.mutable_cpu_data());
+    im2col_generic_cpu(im.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride_h, stride_w, dilation, dilation,
+        ref_col.mutable_cpu_data());
+    for (int i = 0; i < col.count(); ++i) {
+      ASSERT_EQ(ref_col.cpu_data()[i], col.cpu_data()[i])
+          << "im2col " << height << "x" << width << " kernel " << kernel
+          << " pad " << pad << " stride " << stride_h << "x" << stride_w;
+    }
+    Blob<Dtype> ref_im(im.shape());
+    filler.Fill(&col);
+    col2im_cpu(col.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride_h, stride_w, dilation, dilation,
+        im.mutable_cpu_data());
+    col2im_generic_cpu(col.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride_h, stride_w, dilation, dilation,
+        ref_im.mutable_cpu_data());
+    for (int i = 0; i < im.count(); ++i) {
+      ASSERT_EQ(ref_im.cpu_data()[i], im.cpu_data()[i])
+          << "col2im " << height << "x" << width << " kernel " << kernel
+          << " pad " << pad << " stride " << stride_h << "x" << stride_w;
+    }
+  }
+};
+
+TYPED_TEST_CASE(Im2colCPUTest, TestDtypes);
+
+TYPED_TEST(Im2colCPUTest, TestFastPaths) {
+  const int widths[] = { 1, 4, 7, 19, 34 };
+  for (int w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+    for (int kernel = 1; kernel <= 5; ++kernel) {
+      for (int pad = 0; pad <= 2; ++pad) {
+        for (int stride_h = 1; stride_h <= 3; ++stride_h) {
+          for (int stride_w = 1; stride_w <= 2; ++stride_w) {
+            this->Check(2, 6, widths[w], kernel, pad, stride_h, stride_w, 1);
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Im2colCPUTest, TestGenericPaths) {
+  // Stride 3 and dilation keep to the generic kernels.
+  this->Check(3, 10, 11, 3, 1, 3, 3, 1);
+  this->Check(3, 10, 11, 3, 2, 1, 1, 2);
+  this->Check(3, 10, 11, 2, 0, 2, 2, 3);
+}
+
+}  // namespace caffe
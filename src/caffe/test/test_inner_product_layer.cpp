@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/half.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -239,6 +242,236 @@ TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestInt8Forward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With and without transposed weights, the int8 layer computes the inner
+  // products of the input and weights rounded to their int8 grids.
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  const int M = 2, K = 60, N = 10;
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(N);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    // The uniform bottom is in [0, 1].
+    const Dtype input_scale = Dtype(1) / 127;
+    layer_param.mutable_quantization_param()->set_input_scale(input_scale);
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype* bottom = this->blob_bottom_->cpu_data();
+    const Dtype* weights = layer.blobs()[0]->cpu_data();
+    const Dtype* bias = layer.blobs()[1]->cpu_data();
+    for (int n = 0; n < N; ++n) {
+      // The weights of output n are at n * row_stride + k * col_stride.
+      const int row_stride = transpose ? 1 : K;
+      const int col_stride = transpose ? N : 1;
+      Dtype max_abs = 0;
+      for (int k = 0; k < K; ++k) {
+        max_abs = std::max(max_abs,
+            std::fabs(weights[n * row_stride + k * col_stride]));
+      }
+      for (int m = 0; m < M; ++m) {
+        Dtype expected = bias[n];
+        for (int k = 0; k < K; ++k) {
+          // The GPU runs in float.
+          Dtype x = bottom[m * K + k];
+          Dtype w = weights[n * row_stride + k * col_stride];
+          if (Caffe::mode() == Caffe::CPU) {
+            x = std::floor(x * (1 / input_scale) + Dtype(0.5)) * input_scale;
+            w = std::floor(std::fabs(w) * (127 / max_abs) + Dtype(0.5)) *
+                (max_abs / 127) * (w < 0 ? -1 : 1);
+          }
+          expected += x * w;
+        }
+        EXPECT_NEAR(expected, this->blob_top_->cpu_data()[m * N + n], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  // In the TEST phase, weights stored in 16 bits give the products of the
+  // weights rounded to 16 bits, over several blocks of widened weights.
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  const int M = 2, K = 60, N = 1000;
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    for (int storage = FLOAT16; storage <= BFLOAT16; ++storage) {
+      LayerParameter layer_param;
+      layer_param.set_phase(TEST);
+      layer_param.add_param()->set_storage(StorageType(storage));
+      InnerProductParameter* inner_product_param =
+          layer_param.mutable_inner_product_param();
+      inner_product_param->set_num_output(N);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->mutable_weight_filler()->set_type("gaussian");
+      inner_product_param->mutable_bias_filler()->set_type("gaussian");
+      InnerProductLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      // The GPU runs in the Dtype.
+      Blob<Dtype> weights;
+      weights.CopyFrom(*layer.blobs()[0], false, true);
+      if (Caffe::mode() == Caffe::CPU) {
+        vector<uint16_t> half(weights.count());
+        caffe_cpu_to_half(StorageType(storage), weights.count(),
+            weights.cpu_data(), &half[0]);
+        caffe_cpu_from_half(StorageType(storage), weights.count(), &half[0],
+            weights.mutable_cpu_data());
+      }
+      const Dtype* bottom = this->blob_bottom_->cpu_data();
+      const Dtype* bias = layer.blobs()[1]->cpu_data();
+      for (int m = 0; m < M; ++m) {
+        for (int n = 0; n < N; ++n) {
+          Dtype expected = bias[n];
+          for (int k = 0; k < K; ++k) {
+            expected += bottom[m * K + k] *
+                weights.cpu_data()[transpose ? k * N + n : n * K + k];
+          }
+          EXPECT_NEAR(expected, this->blob_top_->cpu_data()[m * N + n], 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestHalfStorageMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // In the TEST phase, FLOAT16 weights no other blob shares are held in 16
+  // bits only, and widened back to the rounded weights when read.
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  layer_param.add_param()->set_storage(FLOAT16);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(100);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int count = layer.blobs()[0]->count();
+  vector<uint16_t> half(count);
+  caffe_cpu_to_half(FLOAT16, count, layer.blobs()[0]->cpu_data(), &half[0]);
+  Blob<Dtype> rounded(layer.blobs()[0]->shape());
+  caffe_cpu_from_half(FLOAT16, count, &half[0], rounded.mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top;
+  top.CopyFrom(*this->blob_top_, false, true);
+  const SyncedMemory* weights = layer.blobs()[0]->data().get();
+  EXPECT_EQ(count * sizeof(uint16_t), weights->cpu_bytes());
+  EXPECT_LE(2 * weights->cpu_bytes(), count * sizeof(Dtype));
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(rounded.cpu_data()[i], layer.blobs()[0]->cpu_data()[i]);
+  }
+  EXPECT_EQ(count * sizeof(Dtype), weights->cpu_bytes());
+  // The next pass frees them again, with the same products.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(count * sizeof(uint16_t), weights->cpu_bytes());
+  for (int i = 0; i < top.count(); ++i) {
+    EXPECT_EQ(top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+  // Weights shared with another blob, e.g. of a training net, are kept.
+  Blob<Dtype> shared(layer.blobs()[0]->shape());
+  shared.ShareData(*layer.blobs()[0]);
+  shared.cpu_data();
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(count * sizeof(Dtype), weights->cpu_bytes());
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  // In the TEST phase, pruned weights are multiplied in CSR, over six rows
+  // of the bottom, so both the four-row kernel and the remainder run.
+  const int M = 6, K = 60, N = 10;
+  Blob<Dtype> bottom(M, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  this->blob_bottom_vec_.push_back(&bottom);
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(N);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Keep the weights of magnitude 1.5 and up, about one in eight.
+    Dtype* weights = layer.blobs()[0]->mutable_cpu_data();
+    for (int i = 0; i < K * N; ++i) {
+      weights[i] = std::fabs(weights[i]) < 1.5 ? Dtype(0) : weights[i];
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype* bias = layer.blobs()[1]->cpu_data();
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        Dtype expected = bias[n];
+        for (int k = 0; k < K; ++k) {
+          expected += bottom.cpu_data()[m * K + k] *
+              weights[transpose ? k * N + n : n * K + k];
+        }
+        EXPECT_NEAR(expected, this->blob_top_->cpu_data()[m * N + n], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardPacked) {
+  typedef typename TypeParam::Dtype Dtype;
+  // In the TEST phase, single inputs are multiplied with packed weights: 20
+  // outputs, so the last panel is padded. Weights changed after the first
+  // pass are repacked.
+  const int M = 1, K = 60, N = 20;
+  Blob<Dtype> bottom(M, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  this->blob_bottom_vec_.push_back(&bottom);
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(N);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int pass = 0; pass < 2; ++pass) {
+      if (pass > 0) {
+        filler.Fill(layer.blobs()[0].get());
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      const Dtype* weights = layer.blobs()[0]->cpu_data();
+      const Dtype* bias = layer.blobs()[1]->cpu_data();
+      for (int m = 0; m < M; ++m) {
+        for (int n = 0; n < N; ++n) {
+          Dtype expected = bias[n];
+          for (int k = 0; k < K; ++k) {
+            expected += bottom.cpu_data()[m * K + k] *
+                weights[transpose ? k * N + n : n * K + k];
+          }
+          EXPECT_NEAR(expected, this->blob_top_->cpu_data()[m * N + n],
+              1e-4);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_);
@@ -158,6 +158,31 @@ TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsLargeRegion) {
   }
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsTiles) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Images over several tiles of pixels, and a beta off the 0.75 fast path.
+  this->blob_bottom_->Reshape(2, 7, 23, 25);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int i = 0; i < 2; ++i) {
+    LayerParameter layer_param;
+    if (i == 1) {
+      layer_param.mutable_lrn_param()->set_beta(0.6);
+    }
+    LRNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> top_reference;
+    this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+        &top_reference);
+    for (int j = 0; j < this->blob_bottom_->count(); ++j) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[j],
+          top_reference.cpu_data()[j], this->epsilon_);
+    }
+  }
+}
+
 TYPED_TEST(LRNLayerTest, TestGradientAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
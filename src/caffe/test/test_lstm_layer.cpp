@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/fused_lstm_layer.hpp"
 #include "caffe/layers/lstm_layer.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -69,6 +70,58 @@ class LSTMLayerTest : public MultiDeviceTest<TypeParam> {
     filler.Fill(&unit_blob_bottom_x_);
   }
 
+  // Runs streams 0 and 1 of input (T x 2 x ...) through layer k timesteps at
+  // a time, stream 1 starting k timesteps after stream 0, and checks their
+  // outputs against output, from a forward pass over the whole sequences.
+  void CheckForwardStreams(RecurrentStreams<Dtype>* layer, const int k,
+      const Blob<Dtype>& input, const Blob<Dtype>& output) {
+    const int num_timesteps = input.shape(0);
+    const int input_dim = input.count(2);
+    const int output_dim = output.count(2);
+    const int handles[2] = { layer->OpenStream(), layer->OpenStream() };
+    vector<int> shape = input.shape();
+    shape[0] = k;
+    Blob<Dtype> x, h;
+    vector<Blob<Dtype>*> x_vec(1, &x);
+    vector<Blob<Dtype>*> h_vec(1, &h);
+    for (int step = 0; step <= num_timesteps / k; ++step) {
+      vector<int> streams, inputs, first_timesteps;
+      for (int n = 1; n >= 0; --n) {
+        const int t = (step - n) * k;
+        if (t >= 0 && t < num_timesteps) {
+          streams.push_back(handles[n]);
+          inputs.push_back(n);
+          first_timesteps.push_back(t);
+        }
+      }
+      const int num = streams.size();
+      shape[1] = num;
+      x.Reshape(shape);
+      for (int t = 0; t < k; ++t) {
+        for (int s = 0; s < num; ++s) {
+          caffe_copy(input_dim, input.cpu_data() +
+              ((first_timesteps[s] + t) * 2 + inputs[s]) * input_dim,
+              x.mutable_cpu_data() + (t * num + s) * input_dim);
+        }
+      }
+      layer->ForwardStreams(streams, x_vec, h_vec);
+      for (int t = 0; t < k; ++t) {
+        for (int s = 0; s < num; ++s) {
+          const Dtype* expected = output.cpu_data() +
+              ((first_timesteps[s] + t) * 2 + inputs[s]) * output_dim;
+          const Dtype* actual = h.cpu_data() + (t * num + s) * output_dim;
+          for (int i = 0; i < output_dim; ++i) {
+            EXPECT_NEAR(expected[i], actual[i], 1e-4)
+                << "stream " << inputs[s] << "; t = "
+                << first_timesteps[s] + t << "; i = " << i;
+          }
+        }
+      }
+    }
+    layer->CloseStream(handles[0]);
+    layer->CloseStream(handles[1]);
+  }
+
   int num_output_;
   LayerParameter layer_param_;
   Blob<Dtype> blob_bottom_;
@@ -185,6 +238,41 @@ TYPED_TEST(LSTMLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(LSTMLayerTest, TestForwardStreams) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 4;
+  this->ReshapeBlobs(kNumTimesteps, 2);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i >= 2;
+  }
+  Caffe::set_random_seed(1701);
+  LSTMLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> input, output;
+  input.CopyFrom(this->blob_bottom_, false, true);
+  output.CopyFrom(this->blob_top_, false, true);
+
+  // The unrolled net runs one timestep at a time, the fused layer two, both
+  // through the RecurrentStreams interface.
+  this->ReshapeBlobs(1, 2);
+  Caffe::set_random_seed(1701);
+  LSTMLayer<Dtype> unrolled(this->layer_param_);
+  unrolled.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Layer<Dtype>* stream_layer = &unrolled;
+  RecurrentStreams<Dtype>* streams =
+      dynamic_cast<RecurrentStreams<Dtype>*>(stream_layer);
+  ASSERT_TRUE(streams);
+  this->CheckForwardStreams(streams, 1, input, output);
+  Caffe::set_random_seed(1701);
+  FusedLSTMLayer<Dtype> fused(this->layer_param_);
+  fused.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  stream_layer = &fused;
+  streams = dynamic_cast<RecurrentStreams<Dtype>*>(stream_layer);
+  ASSERT_TRUE(streams);
+  this->CheckForwardStreams(streams, 2, input, output);
+}
+
 TYPED_TEST(LSTMLayerTest, TestLSTMUnitSetUp) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -284,5 +372,124 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
       this->blob_top_vec_, 2);
 }
 
+TYPED_TEST(LSTMLayerTest, TestFusedMatchesUnrolled) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 4;
+  const int num = 3;
+  this->ReshapeBlobs(kNumTimesteps, num);
+  FillerParameter filler_param;
+  filler_param.set_min(-1);
+  filler_param.set_max(1);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  // Sequences of every stream begin at a different timestep.
+  for (int t = 0; t < kNumTimesteps; ++t) {
+    for (int n = 0; n < num; ++n) {
+      this->blob_bottom_cont_.mutable_cpu_data()[t * num + n] = t != n;
+    }
+  }
+  Caffe::set_random_seed(1701);
+  LSTMLayer<Dtype> unrolled(this->layer_param_);
+  unrolled.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> fused_top;
+  vector<Blob<Dtype>*> fused_top_vec(1, &fused_top);
+  Caffe::set_random_seed(1701);
+  FusedLSTMLayer<Dtype> fused(this->layer_param_);
+  fused.SetUp(this->blob_bottom_vec_, fused_top_vec);
+  ASSERT_EQ(unrolled.blobs().size(), fused.blobs().size());
+  for (int i = 0; i < fused.blobs().size(); ++i) {
+    ASSERT_TRUE(unrolled.blobs()[i]->shape() == fused.blobs()[i]->shape());
+    for (int j = 0; j < fused.blobs()[i]->count(); ++j) {
+      ASSERT_EQ(unrolled.blobs()[i]->cpu_data()[j],
+                fused.blobs()[i]->cpu_data()[j]);
+    }
+  }
+
+  // Run two batches, so that the second continues from the first.
+  const Dtype kEpsilon = 1e-4;
+  vector<bool> propagate_down(3, true);
+  propagate_down[1] = false;
+  for (int batch = 0; batch < 2; ++batch) {
+    filler.Fill(&this->blob_bottom_);
+    unrolled.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    fused.Forward(this->blob_bottom_vec_, fused_top_vec);
+    ASSERT_TRUE(this->blob_top_.shape() == fused_top.shape());
+    for (int i = 0; i < fused_top.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_.cpu_data()[i], fused_top.cpu_data()[i],
+                  kEpsilon) << "batch " << batch << "; i = " << i;
+    }
+  }
+
+  Blob<Dtype> top_diff(fused_top.shape());
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             this->blob_top_.mutable_cpu_diff());
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             fused_top.mutable_cpu_diff());
+  for (int i = 0; i < fused.blobs().size(); ++i) {
+    caffe_set(unrolled.blobs()[i]->count(), Dtype(0),
+              unrolled.blobs()[i]->mutable_cpu_diff());
+    caffe_set(fused.blobs()[i]->count(), Dtype(0),
+              fused.blobs()[i]->mutable_cpu_diff());
+  }
+  unrolled.Backward(this->blob_top_vec_, propagate_down,
+                    this->blob_bottom_vec_);
+  vector<shared_ptr<Blob<Dtype> > > diffs;
+  for (int i = 0; i < this->blob_bottom_vec_.size(); i += 2) {
+    diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    diffs.back()->CopyFrom(*this->blob_bottom_vec_[i], true, true);
+  }
+  fused.Backward(fused_top_vec, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); i += 2) {
+    const Blob<Dtype>& expected = *diffs[i / 2];
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_diff()[j],
+                  this->blob_bottom_vec_[i]->cpu_diff()[j], kEpsilon)
+          << "bottom " << i << "; j = " << j;
+    }
+  }
+  for (int i = 0; i < fused.blobs().size(); ++i) {
+    for (int j = 0; j < fused.blobs()[i]->count(); ++j) {
+      EXPECT_NEAR(unrolled.blobs()[i]->cpu_diff()[j],
+                  fused.blobs()[i]->cpu_diff()[j], kEpsilon)
+          << "param " << i << "; j = " << j;
+    }
+  }
+}
+
+TYPED_TEST(LSTMLayerTest, TestFusedGradientNonZeroCont) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(3, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  FusedLSTMLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(LSTMLayerTest, TestFusedGradientNonZeroContWithStaticInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(2, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  FusedLSTMLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 2);
+}
 
 }  // namespace caffe
@@ -1,12 +1,16 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <limits>
 
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/fast_math.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -119,6 +123,90 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestFastExp) {
+  // Within the documented 2e-7 relative error across the clamped range.
+  for (double x = -87; x <= 88; x += 0.0137) {
+    const TypeParam value = static_cast<TypeParam>(x);
+    const double expected = std::exp(static_cast<double>(value));
+    EXPECT_NEAR(1, fast_exp(value) / expected, 2e-7) << "x = " << x;
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestHalfConversions) {
+  EXPECT_EQ(0x3c00, float_to_half(1));
+  EXPECT_EQ(0xc000, float_to_half(-2));
+  EXPECT_EQ(0x7bff, float_to_half(65504));  // the largest half
+  EXPECT_EQ(0x7c00, float_to_half(65520));  // rounds to inf
+  EXPECT_EQ(0x0001, float_to_half(std::ldexp(1.f, -24)));  // subnormal
+  EXPECT_EQ(0x0000, float_to_half(std::ldexp(1.f, -26)));
+  EXPECT_EQ(0x3c00, float_to_half(1 + std::ldexp(1.f, -11)));  // to even
+  EXPECT_EQ(0x3c02, float_to_half(1 + 3 * std::ldexp(1.f, -11)));
+  EXPECT_EQ(0x3f80, float_to_bfloat16(1));
+  EXPECT_EQ(0x3f80, float_to_bfloat16(1 + std::ldexp(1.f, -8)));  // to even
+  EXPECT_EQ(0x3f82, float_to_bfloat16(1 + 3 * std::ldexp(1.f, -8)));
+  EXPECT_TRUE(std::isnan(half_to_float(float_to_half(NAN))));
+  EXPECT_TRUE(std::isnan(bfloat16_to_float(float_to_bfloat16(NAN))));
+  EXPECT_TRUE(std::isinf(half_to_float(float_to_half(INFINITY))));
+  // Every half, and every bfloat16, converts to float and back.
+  for (int h = 0; h < 0x10000; ++h) {
+    const float value = half_to_float(h);
+    if (!std::isnan(value)) {
+      EXPECT_EQ(h, float_to_half(value));
+    }
+    const float bvalue = bfloat16_to_float(h);
+    if (!std::isnan(bvalue)) {
+      EXPECT_EQ(h, float_to_bfloat16(bvalue));
+    }
+  }
+  EXPECT_EQ(std::ldexp(1.f, -24), half_to_float(1));
+  EXPECT_EQ(65504, half_to_float(0x7bff));
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestFastLog) {
+  // Absolute error within 1e-7 on [0.5, 2], relative within 2e-7 beyond,
+  // subnormals included.
+  for (double x = 1e-44; x < 1e38; x *= 1.0137) {
+    const TypeParam value = static_cast<TypeParam>(x);
+    const double expected = std::log(static_cast<double>(value));
+    EXPECT_NEAR(expected, fast_log(value),
+        std::max(1e-7, 2e-7 * std::fabs(expected))) << "x = " << x;
+  }
+  EXPECT_EQ(-std::numeric_limits<TypeParam>::infinity(),
+      fast_log(TypeParam(0)));
+  EXPECT_TRUE(std::isnan(fast_log(TypeParam(-1))));
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestFastTanhSigmoid) {
+  // Relative error within 5e-7.
+  for (double x = -30; x <= 30; x += 0.0071) {
+    const TypeParam value = static_cast<TypeParam>(x);
+    const double tanh_value = std::tanh(static_cast<double>(value));
+    EXPECT_NEAR(tanh_value, fast_tanh(value), 5e-7 * std::fabs(tanh_value))
+        << "x = " << x;
+    const double sigmoid_value =
+        1 / (1 + std::exp(-static_cast<double>(value)));
+    EXPECT_NEAR(sigmoid_value, fast_sigmoid(value), 5e-7 * sigmoid_value)
+        << "x = " << x;
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestSoftmax) {
+  // Rows long enough to span several chunks, with the max in a late one.
+  const int n = 1000;
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  x[n - 3] = 9;
+  TypeParam* y = this->blob_top_->mutable_cpu_data();
+  const TypeParam log_sum = caffe_cpu_softmax(n, x, y);
+  double sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += std::exp(static_cast<double>(x[i]));
+  }
+  EXPECT_NEAR(std::log(sum), log_sum, 1e-5);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(std::exp(static_cast<double>(x[i])) / sum, y[i], 1e-6);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
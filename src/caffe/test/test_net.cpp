@@ -1,3 +1,7 @@
+#include <stdint.h>
+
+#include <boost/thread.hpp>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,6 +13,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -24,10 +30,15 @@ class NetTest : public MultiDeviceTest<TypeParam> {
  protected:
   NetTest() : seed_(1701) {}
 
-  virtual void InitNetFromProtoString(const string& proto) {
+  virtual void InitNetFromProtoString(const string& proto,
+      const Net<Dtype>* weights_source = NULL) {
     NetParameter param;
     CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
-    net_.reset(new Net<Dtype>(param));
+    if (weights_source) {
+      net_.reset(new Net<Dtype>(param, *weights_source));
+    } else {
+      net_.reset(new Net<Dtype>(param));
+    }
   }
 
   virtual void InitNetFromProtoFileWithState(const string& proto,
@@ -440,6 +451,52 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  // Ties the weights of an Embed layer with a row-sparse gradient to those of
+  // an InnerProduct layer, which writes its gradient densely.
+  virtual void InitTiedEmbedNet() {
+    const string& proto =
+        "name: 'TiedEmbedNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 } } "
+        "} "
+        "layer { "
+        "  name: 'embed' "
+        "  type: 'Embed' "
+        "  embed_param { "
+        "    num_output: 2 "
+        "    input_dim: 3 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 1 } "
+        "    sparse_gradient: true "
+        "  } "
+        "  param { name: 'tiedweights' } "
+        "  bottom: 'data' "
+        "  top: 'embed' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    bias_term: false "
+        "  } "
+        "  param { name: 'tiedweights' } "
+        "  bottom: 'embed' "
+        "  top: 'innerproduct' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'Reduction' "
+        "  bottom: 'innerproduct' "
+        "  top: 'loss' "
+        "  loss_weight: 1 "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitDiffDataUnsharedWeightsNet() {
     const string& proto =
         "name: 'DiffDataUnsharedWeightsNetwork' "
@@ -839,12 +896,445 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  virtual void InitDeployNet(const bool memory_optimize,
+      const Net<Dtype>* weights_source = NULL) {
+    string proto =
+        "name: 'DeployNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'relu1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'relu1' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'ip2' "
+        "  top: 'ip3' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ip2' "
+        "  bottom: 'ip3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'sum' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'sigmoid' "
+        "  top: 'ip4' "
+        "} ";
+    if (memory_optimize) {
+      proto += "memory_optimize: true ";
+    }
+    InitNetFromProtoString(proto, weights_source);
+  }
+
+  // A TEST net of layers with and without support for blocked channels.
+  virtual void InitBlockedLayoutNet(const string& cpu_layout) {
+    string proto =
+        "name: 'BlockedLayoutNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 8 dim: 7 dim: 7 } } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 16 kernel_size: 3 pad: 1 stride: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  batch_norm_param { use_global_stats: true } "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: MAX kernel_size: 3 stride: 1 pad: 1 } "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 16 kernel_size: 3 pad: 1 stride: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 16 kernel_size: 1 pad: 0 stride: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'pool1' "
+        "  top: 'conv3' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv2' "
+        "  bottom: 'conv3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'conv4' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 16 kernel_size: 1 pad: 0 stride: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv1' "
+        "  top: 'conv4' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'pool1' "
+        "  bottom: 'sum' "
+        "  bottom: 'conv4' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'concat' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'pool2' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: AVE kernel_size: 3 stride: 2 pad: 1 } "
+        "  bottom: 'sigmoid' "
+        "  top: 'pool2' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'pool2' "
+        "  top: 'ip' "
+        "} "
+        "cpu_layout: " + cpu_layout;
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitBatchNormNet(const bool fuse, const string& cpu_layout) {
+    string proto =
+        "name: 'BatchNormNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 9 dim: 9 } } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 8 kernel_size: 3 pad: 1 stride: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'scale1' "
+        "  type: 'Scale' "
+        "  scale_param { "
+        "    bias_term: true "
+        "    filler { type: 'uniform' min: 0.5 max: 1.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  relu_param { negative_slope: 0.1 } "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 16 kernel_size: 1 stride: 1 bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'bn2' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'scale2' "
+        "  type: 'Scale' "
+        "  scale_param { filler { type: 'uniform' min: 0.5 max: 1.5 } } "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 8 kernel_size: 3 pad: 1 stride: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv2' "
+        "  top: 'conv3' "
+        "} "
+        "layer { "
+        "  name: 'bn3' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv3' "
+        "  top: 'conv3' "
+        "} "
+        "layer { "
+        "  name: 'relu3' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv3' "
+        "  top: 'conv3' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'conv3' "
+        "  top: 'ip' "
+        "} "
+        "cpu_layout: " + cpu_layout;
+    if (fuse) {
+      proto += " fuse_batch_norm: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  // Concatenates the outputs of two convolutions, and that of a third with
+  // the concatenation, along the channels of single images.
+  virtual void InitConcatNet(const bool zero_copy, const bool train,
+      const bool memory_optimize) {
+    string proto =
+        "name: 'ConcatNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 1 dim: 2 dim: 5 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 3 kernel_size: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 2 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'concat1' "
+        "  type: 'Concat' "
+        "  bottom: 'conv1' "
+        "  bottom: 'conv2' "
+        "  top: 'concat1' "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 2 kernel_size: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv3' "
+        "} "
+        "layer { "
+        "  name: 'concat2' "
+        "  type: 'Concat' "
+        "  bottom: 'concat1' "
+        "  bottom: 'conv3' "
+        "  top: 'concat2' "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  relu_param { negative_slope: 0.5 } "
+        "  bottom: 'concat2' "
+        "  top: 'concat2' "
+        "} ";
+    proto += train ? "state { phase: TRAIN } force_backward: true " :
+        "state { phase: TEST } ";
+    if (zero_copy) {
+      proto += "zero_copy_concat: true ";
+    }
+    if (memory_optimize) {
+      proto += "memory_optimize: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  // Slices the two rows of tanh(data), the first of which a ReLU may change
+  // in place.
+  virtual void InitSliceNet(const bool in_place) {
+    string proto =
+        "name: 'SliceNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 } } "
+        "} "
+        "layer { "
+        "  name: 'tanh' "
+        "  type: 'TanH' "
+        "  bottom: 'data' "
+        "  top: 'tanh' "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  slice_param { axis: 0 } "
+        "  bottom: 'tanh' "
+        "  top: 'a' "
+        "  top: 'b' "
+        "} ";
+    if (in_place) {
+      proto +=
+          "layer { "
+          "  name: 'relu' "
+          "  type: 'ReLU' "
+          "  bottom: 'a' "
+          "  top: 'a' "
+          "} ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
 
 TYPED_TEST_CASE(NetTest, TestDtypesAndDevices);
 
+template <typename Dtype>
+static void ForwardRepeatedly(Net<Dtype>* net, const Blob<Dtype>* input,
+    Caffe::Brew mode, Blob<Dtype>* output) {
+  Caffe::set_mode(mode);
+  for (int iter = 0; iter < 20; ++iter) {
+    net->input_blobs()[0]->CopyFrom(*input);
+    output->CopyFrom(*net->Forward()[0], false, true);
+  }
+}
+
 TYPED_TEST(NetTest, TestHasBlob) {
   this->InitTinyNet();
   EXPECT_TRUE(this->net_->has_blob("data"));
@@ -1216,6 +1706,33 @@ TYPED_TEST(NetTest, TestSharedWeightsDiffNet) {
   }
 }
 
+TYPED_TEST(NetTest, TestSharedRowSparseDiff) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTiedEmbedNet();
+  Net<Dtype>* net = this->net_.get();
+  Blob<Dtype>* weights = net->learnable_params()[0];
+  Blob<Dtype>* data = net->input_blobs()[0];
+  data->mutable_cpu_data()[0] = 0;
+  data->mutable_cpu_data()[1] = 2;
+  // The InnerProduct layer does not report the rows it writes, so the
+  // gradient is dense and does not build up over the iterations.
+  vector<Dtype> first_diff;
+  for (int iter = 0; iter < 2; ++iter) {
+    net->ClearParamDiffs();
+    EXPECT_FALSE(weights->row_sparse_diff());
+    net->Forward();
+    net->Backward();
+    const Dtype* diff = weights->cpu_diff();
+    if (iter == 0) {
+      first_diff.assign(diff, diff + weights->count());
+      continue;
+    }
+    for (int i = 0; i < weights->count(); ++i) {
+      EXPECT_EQ(first_diff[i], diff[i]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   typedef typename TypeParam::Dtype Dtype;
   Caffe::set_random_seed(this->seed_);
@@ -2601,4 +3118,501 @@ TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   ASSERT_TRUE(found_data);
 }
 
+TYPED_TEST(NetTest, TestMemoryOptimize) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> input(2, 3, 4, 5);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  Caffe::set_random_seed(this->seed_);
+  this->InitDeployNet(false);
+  this->net_->input_blobs()[0]->CopyFrom(input);
+  Blob<Dtype> reference;
+  reference.CopyFrom(*this->net_->Forward()[0], false, true);
+  Caffe::set_random_seed(this->seed_);
+  this->InitDeployNet(true);
+  // Some of the intermediate blobs must now share their storage.
+  const char* kIntermediate[] = { "ip1", "relu1", "ip3", "sum", "sigmoid" };
+  set<const void*> data_ptrs;
+  for (int i = 0; i < 5; ++i) {
+    const Blob<Dtype>* blob = this->net_->blob_by_name(kIntermediate[i]).get();
+    data_ptrs.insert(Caffe::mode() == Caffe::CPU ?
+        static_cast<const void*>(blob->cpu_data()) :
+        static_cast<const void*>(blob->gpu_data()));
+  }
+  EXPECT_LT(data_ptrs.size(), 5);
+  for (int iter = 0; iter < 2; ++iter) {
+    this->net_->input_blobs()[0]->CopyFrom(input);
+    const Blob<Dtype>* output = this->net_->Forward()[0];
+    ASSERT_EQ(reference.count(), output->count());
+    for (int i = 0; i < reference.count(); ++i) {
+      EXPECT_FLOAT_EQ(reference.cpu_data()[i], output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestBlockedLayout) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> input(2, 8, 7, 7);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  const char* kLayouts[] = { "NCHW", "NCHW8C", "NCHW16C" };
+  Blob<Dtype> reference;
+  for (int i = 0; i < 3; ++i) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitBlockedLayoutNet(kLayouts[i]);
+    // Give the batch norm some statistics: means, variances and their scale.
+    const vector<shared_ptr<Blob<Dtype> > >& stats =
+        this->net_->layer_by_name("bn1")->blobs();
+    filler.Fill(stats[0].get());
+    FillerParameter variance_param;
+    variance_param.set_min(0.5);
+    variance_param.set_max(2);
+    UniformFiller<Dtype> variance_filler(variance_param);
+    variance_filler.Fill(stats[1].get());
+    stats[2]->mutable_cpu_data()[0] = 2;
+    for (int iter = 0; iter < 2; ++iter) {
+      this->net_->input_blobs()[0]->CopyFrom(input);
+      const Blob<Dtype>* output = this->net_->Forward()[0];
+      EXPECT_EQ(1, output->channel_block());
+      if (i == 0 && iter == 0) {
+        reference.CopyFrom(*output, false, true);
+        continue;
+      }
+      ASSERT_EQ(reference.count(), output->count());
+      for (int j = 0; j < reference.count(); ++j) {
+        EXPECT_NEAR(reference.cpu_data()[j], output->cpu_data()[j], 1e-4);
+      }
+    }
+    // The chain from conv1 to the concat stays blocked; the layers without
+    // support for it, including the Winograd conv2, get and produce plain
+    // blobs.
+    if (Caffe::mode() == Caffe::CPU && i == 1) {
+      EXPECT_EQ(8, this->net_->blob_by_name("conv1")->channel_block());
+      EXPECT_EQ(8, this->net_->blob_by_name("pool1")->channel_block());
+      EXPECT_EQ(1, this->net_->blob_by_name("conv2")->channel_block());
+      EXPECT_EQ(8, this->net_->blob_by_name("sum")->channel_block());
+      EXPECT_EQ(8, this->net_->blob_by_name("concat")->channel_block());
+      EXPECT_EQ(1, this->net_->blob_by_name("sigmoid")->channel_block());
+      EXPECT_EQ(1, this->net_->blob_by_name("pool2")->channel_block());
+    }
+  }
+}
+
+// Counts the layers run by the forward passes of a net.
+template <typename Dtype>
+class ForwardCounter : public Net<Dtype>::Callback {
+ public:
+  ForwardCounter() : count_(0) {}
+  int count_;
+
+ protected:
+  virtual void run(int layer) { ++count_; }
+};
+
+TYPED_TEST(NetTest, TestFuseBatchNorm) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> input(2, 3, 9, 9);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  FillerParameter variance_param;
+  variance_param.set_min(0.5);
+  variance_param.set_max(2);
+  UniformFiller<Dtype> variance_filler(variance_param);
+  const char* kLayouts[] = { "NCHW", "NCHW8C" };
+  for (int i = 0; i < 2; ++i) {
+    // The unfused net, with statistics in its batch norms, and the fused one
+    // given its parameters after Init.
+    Caffe::set_random_seed(this->seed_);
+    this->InitBatchNormNet(false, kLayouts[i]);
+    shared_ptr<Net<Dtype> > unfused = this->net_;
+    const char* kBatchNorms[] = { "bn1", "bn2", "bn3" };
+    for (int j = 0; j < 3; ++j) {
+      const vector<shared_ptr<Blob<Dtype> > >& stats =
+          unfused->layer_by_name(kBatchNorms[j])->blobs();
+      filler.Fill(stats[0].get());
+      variance_filler.Fill(stats[1].get());
+      stats[2]->mutable_cpu_data()[0] = 2;
+    }
+    NetParameter trained;
+    unfused->ToProto(&trained);
+    this->InitBatchNormNet(true, kLayouts[i]);
+    shared_ptr<Net<Dtype> > fused = this->net_;
+    fused->CopyTrainedLayersFrom(trained);
+    ForwardCounter<Dtype> counter;
+    fused->add_before_forward(&counter);
+    for (int iter = 0; iter < 2; ++iter) {
+      // Changing a parameter after the first pass folds them again.
+      if (iter == 1) {
+        unfused->layer_by_name("scale1")->blobs()[0]->mutable_cpu_data()[1] =
+            -1;
+        fused->layer_by_name("scale1")->blobs()[0]->mutable_cpu_data()[1] =
+            -1;
+      }
+      unfused->input_blobs()[0]->CopyFrom(input);
+      fused->input_blobs()[0]->CopyFrom(input);
+      const Blob<Dtype>* reference = unfused->Forward()[0];
+      const Blob<Dtype>* output = fused->Forward()[0];
+      ASSERT_EQ(reference->count(), output->count());
+      for (int j = 0; j < reference->count(); ++j) {
+        EXPECT_NEAR(reference->cpu_data()[j], output->cpu_data()[j], 1e-4);
+      }
+    }
+    // The batch norms, scales and ReLUs after the convolutions are skipped
+    // on the CPU.
+    EXPECT_EQ(Caffe::mode() == Caffe::CPU ? 10 : 24, counter.count_);
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcat) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> input(1, 2, 5, 5);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  Blob<Dtype> output_diff(1, 7, 5, 5);
+  filler.Fill(&output_diff);
+  const bool cpu = Caffe::mode() == Caffe::CPU;
+  for (int train = 0; train < 2; ++train) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitConcatNet(false, train, false);
+    shared_ptr<Net<Dtype> > reference = this->net_;
+    for (int memory_optimize = 0; memory_optimize <= !train;
+         ++memory_optimize) {
+      Caffe::set_random_seed(this->seed_);
+      this->InitConcatNet(true, train, memory_optimize);
+      shared_ptr<Net<Dtype> > net = this->net_;
+      // The convolutions write into the concatenations, but in training
+      // concat1 keeps its own storage: relu2 changes concat2 in place, and
+      // relu1 needs the data of conv1 back.
+      const Dtype* concat1 = net->blob_by_name("concat1")->cpu_data();
+      const Dtype* concat2 = net->blob_by_name("concat2")->cpu_data();
+      EXPECT_EQ(cpu, net->blob_by_name("conv1")->cpu_data() == concat1);
+      EXPECT_EQ(cpu, net->blob_by_name("conv2")->cpu_data() == concat1 + 75);
+      EXPECT_EQ(cpu && !train, concat1 == concat2);
+      EXPECT_EQ(cpu && !train,
+          net->blob_by_name("conv3")->cpu_data() == concat2 + 125);
+      for (int iter = 0; iter < 2; ++iter) {
+        reference->input_blobs()[0]->CopyFrom(input);
+        net->input_blobs()[0]->CopyFrom(input);
+        const Blob<Dtype>* expected = reference->Forward()[0];
+        const Blob<Dtype>* output = net->Forward()[0];
+        ASSERT_EQ(expected->count(), output->count());
+        for (int i = 0; i < expected->count(); ++i) {
+          EXPECT_EQ(expected->cpu_data()[i], output->cpu_data()[i]);
+        }
+        if (!train) {
+          continue;
+        }
+        reference->output_blobs()[0]->CopyFrom(output_diff, true);
+        net->output_blobs()[0]->CopyFrom(output_diff, true);
+        reference->Backward();
+        net->Backward();
+        const Blob<Dtype>* expected_diff = reference->input_blobs()[0];
+        const Blob<Dtype>* diff = net->input_blobs()[0];
+        for (int i = 0; i < expected_diff->count(); ++i) {
+          EXPECT_EQ(expected_diff->cpu_diff()[i], diff->cpu_diff()[i]);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestSliceViewsInPlace) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kInput[] = { -1, 0.5, 2, 1, -2, 0.25 };
+  const Dtype kDiff[] = { 1, 2, 3, 4, 5, 6 };
+  for (int in_place = 0; in_place < 2; ++in_place) {
+    this->InitSliceNet(in_place);
+    const Blob<Dtype>* t = this->net_->blob_by_name("tanh").get();
+    Blob<Dtype>* a = this->net_->blob_by_name("a").get();
+    Blob<Dtype>* b = this->net_->blob_by_name("b").get();
+    // The rows are views of tanh, unless the ReLU would change it in place.
+    EXPECT_EQ(!in_place, a->cpu_data() == t->cpu_data());
+    EXPECT_EQ(!in_place, b->cpu_data() == t->cpu_data() + 3);
+    caffe_copy(6, kInput, this->net_->input_blobs()[0]->mutable_cpu_data());
+    this->net_->Forward();
+    caffe_copy(3, kDiff, a->mutable_cpu_diff());
+    caffe_copy(3, kDiff + 3, b->mutable_cpu_diff());
+    this->net_->Backward();
+    const Dtype* data_diff = this->net_->input_blobs()[0]->cpu_diff();
+    for (int i = 0; i < 6; ++i) {
+      const Dtype y = tanh(kInput[i]);
+      const bool kept = !in_place || i >= 3 || y > 0;
+      const Dtype* output = i < 3 ? a->cpu_data() + i : b->cpu_data() + i - 3;
+      EXPECT_NEAR(kept ? y : 0, *output, 1e-6);
+      EXPECT_NEAR(kept ? kDiff[i] * (1 - y * y) : 0, data_diff[i], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcatReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  // Smaller images move the views, and a batch of them gives the bottoms
+  // storage of their own until single images come back.
+  const int shapes[][4] = { {1, 2, 3, 3}, {2, 2, 3, 3}, {1, 2, 4, 4} };
+  for (int train = 0; train < 2; ++train) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitConcatNet(false, train, false);
+    shared_ptr<Net<Dtype> > reference = this->net_;
+    Caffe::set_random_seed(this->seed_);
+    this->InitConcatNet(true, train, false);
+    shared_ptr<Net<Dtype> > net = this->net_;
+    for (int s = 0; s < 3; ++s) {
+      Blob<Dtype> input(shapes[s][0], shapes[s][1], shapes[s][2],
+          shapes[s][3]);
+      filler.Fill(&input);
+      reference->input_blobs()[0]->CopyFrom(input, false, true);
+      net->input_blobs()[0]->CopyFrom(input, false, true);
+      reference->Reshape();
+      net->Reshape();
+      const bool single = shapes[s][0] == 1 && Caffe::mode() == Caffe::CPU;
+      EXPECT_EQ(single, net->blob_by_name("conv2")->cpu_data() ==
+          net->blob_by_name("concat1")->cpu_data() + 3 * shapes[s][2] *
+          shapes[s][3]);
+      const Blob<Dtype>* expected = reference->Forward()[0];
+      const Blob<Dtype>* output = net->Forward()[0];
+      ASSERT_EQ(expected->count(), output->count());
+      for (int i = 0; i < expected->count(); ++i) {
+        EXPECT_EQ(expected->cpu_data()[i], output->cpu_data()[i]);
+      }
+      if (!train) {
+        continue;
+      }
+      Blob<Dtype> output_diff(output->shape());
+      filler.Fill(&output_diff);
+      reference->output_blobs()[0]->CopyFrom(output_diff, true);
+      net->output_blobs()[0]->CopyFrom(output_diff, true);
+      reference->Backward();
+      net->Backward();
+      const Blob<Dtype>* expected_diff = reference->input_blobs()[0];
+      const Blob<Dtype>* diff = net->input_blobs()[0];
+      for (int i = 0; i < expected_diff->count(); ++i) {
+        EXPECT_EQ(expected_diff->cpu_diff()[i], diff->cpu_diff()[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestSharedWeightsExecutors) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDeployNet(false);
+  shared_ptr<Net<Dtype> > weights_source = this->net_;
+  const int kNumExecutors = 3;
+  vector<shared_ptr<Net<Dtype> > > executors;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    this->InitDeployNet(i == 0, weights_source.get());
+    executors.push_back(this->net_);
+  }
+  // The executors hold the very parameters of the source.
+  const vector<shared_ptr<Blob<Dtype> > >& params = weights_source->params();
+  for (int i = 0; i < kNumExecutors; ++i) {
+    ASSERT_EQ(params.size(), executors[i]->params().size());
+    for (int j = 0; j < params.size(); ++j) {
+      EXPECT_EQ(params[j]->cpu_data(), executors[i]->params()[j]->cpu_data());
+    }
+  }
+  // Running concurrently on different inputs, each executor gets the output
+  // of the source on its input.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  vector<shared_ptr<Blob<Dtype> > > inputs, references, outputs;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    inputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(2, 3, 4, 5)));
+    filler.Fill(inputs[i].get());
+    weights_source->input_blobs()[0]->CopyFrom(*inputs[i]);
+    references.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    references[i]->CopyFrom(*weights_source->Forward()[0], false, true);
+    outputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    threads.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &ForwardRepeatedly<Dtype>, executors[i].get(), inputs[i].get(),
+        Caffe::mode(), outputs[i].get())));
+  }
+  for (int i = 0; i < kNumExecutors; ++i) {
+    threads[i]->join();
+    ASSERT_EQ(references[i]->count(), outputs[i]->count());
+    for (int j = 0; j < references[i]->count(); ++j) {
+      EXPECT_FLOAT_EQ(references[i]->cpu_data()[j], outputs[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFlatWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDeployNet(false);
+  Blob<Dtype> input(2, 3, 4, 5);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  this->net_->input_blobs()[0]->CopyFrom(input);
+  Blob<Dtype> reference;
+  reference.CopyFrom(*this->net_->Forward()[0], false, true);
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToFlatWeights(filename);
+  EXPECT_TRUE(IsFlatWeightsFile(filename));
+
+  // Load the weights into a net initialized differently.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitDeployNet(false);
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(params[i]->cpu_data())
+        % kFlatWeightsAlignment, 0);
+  }
+  this->net_->input_blobs()[0]->CopyFrom(input);
+  const Blob<Dtype>* output = this->net_->Forward()[0];
+  ASSERT_EQ(reference.count(), output->count());
+  for (int i = 0; i < reference.count(); ++i) {
+    EXPECT_FLOAT_EQ(reference.cpu_data()[i], output->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestFlatWeightsOutliveNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDeployNet(false);
+  Blob<Dtype> input(2, 3, 4, 5);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&input);
+  this->net_->input_blobs()[0]->CopyFrom(input);
+  Blob<Dtype> reference;
+  reference.CopyFrom(*this->net_->Forward()[0], false, true);
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToFlatWeights(filename);
+
+  // An executor sharing the mapped weights keeps them mapped after the net
+  // they were loaded into is gone.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitDeployNet(false);
+  this->net_->CopyTrainedLayersFrom(filename);
+  shared_ptr<Net<Dtype> > source = this->net_;
+  this->InitDeployNet(false, source.get());
+  source.reset();
+  this->net_->input_blobs()[0]->CopyFrom(input);
+  const Blob<Dtype>* output = this->net_->Forward()[0];
+  ASSERT_EQ(reference.count(), output->count());
+  for (int i = 0; i < reference.count(); ++i) {
+    EXPECT_FLOAT_EQ(reference.cpu_data()[i], output->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'HalfStorageNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  param { storage: FLOAT16 } "
+      "  param { storage: BFLOAT16 } "
+      "  inner_product_param { "
+      "    num_output: 10 "
+      "    weight_filler { type: 'gaussian' std: 10 } "
+      "    bias_filler { type: 'gaussian' std: 10 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'ip' "
+      "} ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  const StorageType storages[] = {FLOAT16, BFLOAT16};
+  vector<shared_ptr<Blob<Dtype> > > rounded(2);
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& param = *this->net_->layers()[1]->blobs()[i];
+    rounded[i].reset(new Blob<Dtype>());
+    rounded[i]->CopyFrom(param, false, true);
+    vector<uint16_t> half(param.count());
+    caffe_cpu_to_half(storages[i], param.count(), param.cpu_data(), &half[0]);
+    caffe_cpu_from_half(storages[i], param.count(), &half[0],
+        rounded[i]->mutable_cpu_data());
+  }
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(storages[i], net_param.layer(1).blobs(i).half_data_type());
+    EXPECT_EQ(0, net_param.layer(1).blobs(i).data_size());
+  }
+  string filenames[2];
+  MakeTempFilename(&filenames[0]);
+  WriteProtoToBinaryFile(net_param, filenames[0]);
+#ifdef USE_HDF5
+  MakeTempFilename(&filenames[1]);
+  this->net_->ToHDF5(filenames[1]);
+#endif
+  // Both snapshots load into the rounded parameters.
+  for (int f = 0; f < 2; ++f) {
+    if (filenames[f].empty()) {
+      continue;
+    }
+    Caffe::set_random_seed(this->seed_ + 1);
+    this->InitNetFromProtoString(proto);
+    this->net_->CopyTrainedLayersFrom(filenames[f]);
+    for (int i = 0; i < 2; ++i) {
+      const Blob<Dtype>& param = *this->net_->layers()[1]->blobs()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(rounded[i]->cpu_data()[j], param.cpu_data()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFlatWeightsSharedResume) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype> shared_params;
+  shared_params.CopyFrom(*this->net_->layers()[1]->blobs()[0], false, true);
+  const int count = shared_params.count();
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToFlatWeights(filename);
+
+  for (int resume = 0; resume < 2; ++resume) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitDiffDataSharedWeightsNet();
+    this->net_->CopyTrainedLayersFrom(filename);
+    Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+    Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+    // The shared weights are mapped once and still share their memory.
+    EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+    EXPECT_EQ(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
+    for (int i = 0; i < count; ++i) {
+      EXPECT_FLOAT_EQ(shared_params.cpu_data()[i],
+          ip1_weights->cpu_data()[i]);
+    }
+    // Training the mapped weights must leave the file untouched.
+    this->net_->ForwardBackward();
+    this->net_->Update();
+  }
+}
+
 }  // namespace caffe
@@ -23,6 +23,7 @@
 #include "caffe/layers/swish_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
 #include "caffe/layers/threshold_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_relu_layer.hpp"
@@ -516,6 +517,44 @@ TYPED_TEST(NeuronLayerTest, TestTanHGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(NeuronLayerTest, TestElementwiseThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Enough elements for several chunks of the elementwise engine: any
+  // number of threads gives the same values.
+  this->blob_bottom_->Reshape(4, 16, 64, 64);
+  FillerParameter filler_param;
+  filler_param.set_std(3);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  Blob<Dtype> top, bottom_diff;
+  for (int threads = 1; threads <= 3; threads += 2) {
+    ThreadPool::Get().set_num_threads(threads);
+    TanHLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      this->blob_top_->mutable_cpu_diff()[i] = i % 7;
+    }
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    if (threads == 1) {
+      top.CopyFrom(*this->blob_top_, false, true);
+      bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+      continue;
+    }
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_EQ(top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+      EXPECT_EQ(bottom_diff.cpu_diff()[i], this->blob_bottom_->cpu_diff()[i]);
+    }
+  }
+  ThreadPool::Get().set_num_threads(1);
+  for (int i = 0; i < top.count(); ++i) {
+    EXPECT_NEAR(tanh(this->blob_bottom_->cpu_data()[i]), top.cpu_data()[i],
+        1e-6);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestExpLayer) {
   typedef typename TypeParam::Dtype Dtype;
   // Test default base of "-1" -- should actually set base := e.
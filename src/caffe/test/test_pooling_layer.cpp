@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -609,6 +611,130 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+// Pools with the plain window loops, for the specialized paths to match.
+template <typename Dtype>
+void pool_reference(int kernel, int stride, int pad, bool max_pool,
+    const Blob<Dtype>& bottom, const Blob<Dtype>& top, Blob<Dtype>* ref,
+    Blob<Dtype>* ref_mask) {
+  ref->ReshapeLike(top);
+  ref_mask->ReshapeLike(top);
+  const int height = bottom.height();
+  const int width = bottom.width();
+  for (int nc = 0; nc < bottom.num() * bottom.channels(); ++nc) {
+    const Dtype* in = bottom.cpu_data() + nc * height * width;
+    for (int ph = 0; ph < top.height(); ++ph) {
+      for (int pw = 0; pw < top.width(); ++pw) {
+        const int hstart = ph * stride - pad;
+        const int wstart = pw * stride - pad;
+        const int pool_size =
+            (std::min(hstart + kernel, height + pad) - hstart) *
+            (std::min(wstart + kernel, width + pad) - wstart);
+        Dtype value = max_pool ? -FLT_MAX : 0;
+        int index = -1;
+        for (int h = std::max(hstart, 0);
+             h < std::min(hstart + kernel, height); ++h) {
+          for (int w = std::max(wstart, 0);
+               w < std::min(wstart + kernel, width); ++w) {
+            if (!max_pool) {
+              value += in[h * width + w];
+            } else if (in[h * width + w] > value) {
+              value = in[h * width + w];
+              index = h * width + w;
+            }
+          }
+        }
+        const int offset = (nc * top.height() + ph) * top.width() + pw;
+        ref->mutable_cpu_data()[offset] =
+            max_pool ? value : value / pool_size;
+        ref_mask->mutable_cpu_data()[offset] = index;
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardFastPaths) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 3, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  // 2x2 and 3x3 with stride 2, the generic case, and global pooling.
+  const int kCases[][3] = { {2, 2, 0}, {3, 2, 0}, {3, 2, 1}, {3, 1, 1} };
+  for (int max_pool = 1; max_pool >= 0; --max_pool) {
+    if (!max_pool) {
+      this->blob_top_vec_.resize(1);
+    }
+    for (int i = 0; i <= 4; ++i) {
+      const bool global = i == 4;
+      const int kernel = global ? 0 : kCases[i][0];
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      if (global) {
+        pooling_param->set_global_pooling(true);
+      } else {
+        pooling_param->set_kernel_size(kernel);
+        pooling_param->set_stride(kCases[i][1]);
+        pooling_param->set_pad(kCases[i][2]);
+      }
+      pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+          PoolingParameter_PoolMethod_AVE);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype> ref, ref_mask;
+      if (global) {
+        pool_reference(7, 1, 0, max_pool, *this->blob_bottom_,
+            *this->blob_top_, &ref, &ref_mask);
+      } else {
+        pool_reference(kernel, kCases[i][1], kCases[i][2], max_pool,
+            *this->blob_bottom_, *this->blob_top_, &ref, &ref_mask);
+      }
+      for (int j = 0; j < ref.count(); ++j) {
+        EXPECT_NEAR(ref.cpu_data()[j], this->blob_top_->cpu_data()[j], 1e-5);
+        if (max_pool) {
+          EXPECT_EQ(ref_mask.cpu_data()[j],
+              this->blob_top_mask_->cpu_data()[j]);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // In TEST, the forward pass skips the mask; a backward pass still gets the
+  // gradient of TRAIN.
+  Blob<Dtype> train_top, train_diff;
+  for (int phase = 0; phase <= 1; ++phase) {
+    LayerParameter layer_param;
+    layer_param.set_phase(phase ? TEST : TRAIN);
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      this->blob_top_->mutable_cpu_diff()[i] = i + 1;
+    }
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    if (!phase) {
+      train_top.CopyFrom(*this->blob_top_, false, true);
+      train_diff.CopyFrom(*this->blob_bottom_, true, true);
+      continue;
+    }
+    for (int i = 0; i < train_top.count(); ++i) {
+      EXPECT_EQ(train_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+    }
+    for (int i = 0; i < train_diff.count(); ++i) {
+      EXPECT_EQ(train_diff.cpu_diff()[i], this->blob_bottom_->cpu_diff()[i]);
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -132,6 +132,31 @@ TYPED_TEST(SliceLayerTest, TestSliceAcrossNum) {
   }
 }
 
+TYPED_TEST(SliceLayerTest, TestSliceViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_axis(0);
+  layer_param.add_top("top0");
+  layer_param.add_top("top1");
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // The slices along the first axis are views of the bottom, into whose diff
+  // the top diffs go.
+  EXPECT_TRUE(layer.SharesBottomData());
+  const int top_count = this->blob_top_0_->count();
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  EXPECT_EQ(this->blob_bottom_->cpu_data(), this->blob_top_0_->cpu_data());
+  EXPECT_EQ(this->blob_bottom_->cpu_data() + top_count,
+      this->blob_top_1_->cpu_data());
+  caffe_set(top_count, Dtype(1), this->blob_top_0_->mutable_cpu_diff());
+  caffe_set(top_count, Dtype(2), this->blob_top_1_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_0_, vector<bool>(1, true),
+      this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(i < top_count ? 1 : 2, this->blob_bottom_->cpu_diff()[i]);
+  }
+}
+
 TYPED_TEST(SliceLayerTest, TestSliceAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
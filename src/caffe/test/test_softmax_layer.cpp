@@ -74,6 +74,31 @@ TYPED_TEST(SoftmaxLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A softmax over the last axis, as for a classifier, takes the two pass
+  // kernel.
+  this->blob_bottom_->Reshape(3, 700, 1, 1);
+  FillerParameter filler_param;
+  filler_param.set_std(5);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_bottom_->num(); ++i) {
+    Dtype scale = 0;
+    for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+      scale += exp(this->blob_bottom_->data_at(i, j, 0, 0));
+    }
+    for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+      EXPECT_NEAR(exp(this->blob_bottom_->data_at(i, j, 0, 0)) / scale,
+          this->blob_top_->data_at(i, j, 0, 0), 1e-6);
+    }
+  }
+}
+
 TYPED_TEST(SoftmaxLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
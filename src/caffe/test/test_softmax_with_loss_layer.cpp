@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <vector>
 
@@ -105,4 +107,52 @@ TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientUnnormalized) {
       this->blob_top_vec_, 0);
 }
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestForwardContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With the classes on the last axis the loss comes from the fused path.
+  this->blob_bottom_data_->Reshape(6, 30, 1, 1);
+  this->blob_bottom_label_->Reshape(6, 1, 1, 1);
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_data_);
+  for (int i = 0; i < 6; ++i) {
+    this->blob_bottom_label_->mutable_cpu_data()[i] = (i * 7) % 30;
+  }
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_ignore_label(7);
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Dtype loss = 0;
+  for (int i = 0; i < 6; ++i) {
+    const int label = (i * 7) % 30;
+    if (label == 7) {
+      continue;
+    }
+    Dtype scale = 0;
+    for (int j = 0; j < 30; ++j) {
+      scale += exp(this->blob_bottom_data_->data_at(i, j, 0, 0));
+    }
+    const Dtype prob =
+        exp(this->blob_bottom_data_->data_at(i, label, 0, 0)) / scale;
+    loss -= log(std::max(prob, Dtype(FLT_MIN)));
+  }
+  EXPECT_NEAR(loss / 5, this->blob_top_loss_->cpu_data()[0],
+      1e-4 * std::max(Dtype(1), loss));
+}
+
+TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_data_->Reshape(4, 5, 1, 1);
+  this->blob_bottom_label_->Reshape(4, 1, 1, 1);
+  LayerParameter layer_param;
+  layer_param.add_loss_weight(3);
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
 }  // namespace caffe
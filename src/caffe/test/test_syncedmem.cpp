@@ -22,6 +22,20 @@ TEST_F(SyncedMemoryTest, TestInitialization) {
   delete p_mem;
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  EXPECT_EQ(mem.version(), 0);
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), 0);
+  mem.mutable_cpu_data();
+  EXPECT_EQ(mem.version(), 1);
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), 1);
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_EQ(mem.version(), 2);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestAllocationCPUGPU) {
@@ -0,0 +1,137 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  ThreadPoolTest() : pool_(ThreadPool::Get()) {}
+  virtual void TearDown() {
+    pool_.set_num_threads(1);
+  }
+
+  ThreadPool& pool_;
+};
+
+static void Square(vector<int>* results, int task) {
+  (*results)[task] = task * task;
+}
+
+static void RecordThread(vector<boost::thread::id>* threads, int task) {
+  (*threads)[task] = boost::this_thread::get_id();
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+}
+
+TEST_F(ThreadPoolTest, TestSingleThread) {
+  EXPECT_EQ(pool_.num_threads(), 1);
+  vector<boost::thread::id> threads(5);
+  pool_.Run(threads.size(), boost::bind(&RecordThread, &threads, _1));
+  for (int i = 0; i < threads.size(); ++i) {
+    EXPECT_EQ(threads[i], boost::this_thread::get_id());
+  }
+}
+
+TEST_F(ThreadPoolTest, TestRunsEveryTask) {
+  pool_.set_num_threads(3);
+  EXPECT_EQ(pool_.num_threads(), 3);
+  for (int num_tasks = 0; num_tasks < 20; ++num_tasks) {
+    vector<int> results(num_tasks, -1);
+    pool_.Run(num_tasks, boost::bind(&Square, &results, _1));
+    for (int i = 0; i < num_tasks; ++i) {
+      EXPECT_EQ(results[i], i * i);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestUsesWorkers) {
+  pool_.set_num_threads(4);
+  vector<boost::thread::id> threads(8);
+  pool_.Run(threads.size(), boost::bind(&RecordThread, &threads, _1));
+  int other_threads = 0;
+  for (int i = 0; i < threads.size(); ++i) {
+    other_threads += threads[i] != boost::this_thread::get_id();
+  }
+  EXPECT_GT(other_threads, 0);
+  pool_.set_num_threads(2);
+  EXPECT_EQ(pool_.num_threads(), 2);
+  vector<int> results(10, -1);
+  pool_.Run(results.size(), boost::bind(&Square, &results, _1));
+  for (int i = 0; i < results.size(); ++i) {
+    EXPECT_EQ(results[i], i * i);
+  }
+}
+
+static void RunSquares(ThreadPool* pool, vector<int>* results) {
+  for (int i = 0; i < 10; ++i) {
+    pool->Run(results->size(), boost::bind(&Square, results, _1));
+  }
+}
+
+TEST_F(ThreadPoolTest, TestConcurrentRuns) {
+  pool_.set_num_threads(3);
+  vector<vector<int> > results(4, vector<int>(50, -1));
+  vector<shared_ptr<boost::thread> > threads;
+  for (int i = 0; i < results.size(); ++i) {
+    threads.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&RunSquares, &pool_, &results[i])));
+  }
+  for (int i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+  }
+  for (int i = 0; i < results.size(); ++i) {
+    for (int j = 0; j < results[i].size(); ++j) {
+      EXPECT_EQ(results[i][j], j * j);
+    }
+  }
+}
+
+// A task that waits, up to a second, for the task of another call of Run to
+// start; records whether it did.
+class Rendezvous {
+ public:
+  Rendezvous() : arrived_(0) {}
+  void Meet(bool* met, int task) {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++arrived_;
+    arrived_changed_.notify_all();
+    const boost::system_time deadline =
+        boost::get_system_time() + boost::posix_time::seconds(1);
+    while (arrived_ < 2) {
+      if (!arrived_changed_.timed_wait(lock, deadline)) {
+        break;
+      }
+    }
+    *met = arrived_ >= 2;
+  }
+
+ private:
+  boost::mutex mutex_;
+  boost::condition_variable arrived_changed_;
+  int arrived_;
+};
+
+static void RunMeet(ThreadPool* pool, Rendezvous* rendezvous, bool* met) {
+  pool->Run(1, boost::bind(&Rendezvous::Meet, rendezvous, met, _1));
+}
+
+TEST_F(ThreadPoolTest, TestInlineRunsAreConcurrent) {
+  // Calls that run their tasks on the calling thread do not wait for each
+  // other.
+  Rendezvous rendezvous;
+  bool met[2] = {false, false};
+  boost::thread other(&RunMeet, &pool_, &rendezvous, &met[1]);
+  RunMeet(&pool_, &rendezvous, &met[0]);
+  other.join();
+  EXPECT_TRUE(met[0]);
+  EXPECT_TRUE(met[1]);
+}
+
+}  // namespace caffe
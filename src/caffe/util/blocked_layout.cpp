@@ -0,0 +1,75 @@
+#include "caffe/util/blocked_layout.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void nchw_to_blocked_cpu(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* src, Dtype* dst) {
+  CHECK_EQ(channels % block, 0);
+  for (int n = 0; n < num * channels / block; ++n) {
+    for (int i = 0; i < block; ++i) {
+      const Dtype* src_channel = src + (n * block + i) * spatial_dim;
+      Dtype* dst_channel = dst + n * block * spatial_dim + i;
+      for (int j = 0; j < spatial_dim; ++j) {
+        dst_channel[j * block] = src_channel[j];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void blocked_to_nchw_cpu(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* src, Dtype* dst) {
+  CHECK_EQ(channels % block, 0);
+  for (int n = 0; n < num * channels / block; ++n) {
+    for (int i = 0; i < block; ++i) {
+      const Dtype* src_channel = src + n * block * spatial_dim + i;
+      Dtype* dst_channel = dst + (n * block + i) * spatial_dim;
+      for (int j = 0; j < spatial_dim; ++j) {
+        dst_channel[j] = src_channel[j * block];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ReorderChannelBlock(const Blob<Dtype>& src, const int channel_block,
+    Blob<Dtype>* dst) {
+  CHECK_NE(&src, dst);
+  dst->ReshapeLike(src);
+  dst->set_channel_block(channel_block);
+  if (src.channel_block() == channel_block) {
+    caffe_copy(src.count(), src.cpu_data(), dst->mutable_cpu_data());
+    return;
+  }
+  CHECK_EQ(src.num_axes(), 4) << "Only 4D blobs have blocked layouts.";
+  const int spatial_dim = src.count(2);
+  if (src.channel_block() == 1) {
+    nchw_to_blocked_cpu(src.num(), src.channels(), spatial_dim, channel_block,
+        src.cpu_data(), dst->mutable_cpu_data());
+  } else if (channel_block == 1) {
+    blocked_to_nchw_cpu(src.num(), src.channels(), spatial_dim,
+        src.channel_block(), src.cpu_data(), dst->mutable_cpu_data());
+  } else {
+    Blob<Dtype> nchw;
+    ReorderChannelBlock(src, 1, &nchw);
+    ReorderChannelBlock(nchw, channel_block, dst);
+  }
+}
+
+// Explicit instantiation
+template void nchw_to_blocked_cpu<float>(const int num, const int channels,
+    const int spatial_dim, const int block, const float* src, float* dst);
+template void nchw_to_blocked_cpu<double>(const int num, const int channels,
+    const int spatial_dim, const int block, const double* src, double* dst);
+template void blocked_to_nchw_cpu<float>(const int num, const int channels,
+    const int spatial_dim, const int block, const float* src, float* dst);
+template void blocked_to_nchw_cpu<double>(const int num, const int channels,
+    const int spatial_dim, const int block, const double* src, double* dst);
+template void ReorderChannelBlock<float>(const Blob<float>& src,
+    const int channel_block, Blob<float>* dst);
+template void ReorderChannelBlock<double>(const Blob<double>& src,
+    const int channel_block, Blob<double>* dst);
+
+}  // namespace caffe
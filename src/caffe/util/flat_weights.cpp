@@ -0,0 +1,170 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/flat_weights.hpp"
+
+namespace caffe {
+
+const char kFlatWeightsMagic[8] = { 'C', 'A', 'F', 'F', 'E', 'F', 'L', 'T' };
+
+static const size_t kFlatWeightsHeaderSize =
+    sizeof(kFlatWeightsMagic) + sizeof(uint64_t);
+
+static uint64_t RoundUp(uint64_t size, uint64_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+static uint64_t FlatBlobCount(const FlatBlob& blob) {
+  uint64_t count = 1;
+  for (int i = 0; i < blob.shape().dim_size(); ++i) {
+    CHECK_GE(blob.shape().dim(i), 0);
+    count *= blob.shape().dim(i);
+  }
+  return count;
+}
+
+static void WritePadding(std::ofstream* output, uint64_t size) {
+  static const char kZeros[kFlatWeightsPageSize] = {};
+  while (size > 0) {
+    const uint64_t chunk = std::min<uint64_t>(size, kFlatWeightsPageSize);
+    output->write(kZeros, chunk);
+    size -= chunk;
+  }
+}
+
+size_t FlatWeightsElementSize(FlatWeightsIndex::DataType data_type) {
+  switch (data_type) {
+  case FlatWeightsIndex_DataType_FLOAT:
+    return sizeof(float);
+  case FlatWeightsIndex_DataType_DOUBLE:
+    return sizeof(double);
+  default:
+    LOG(FATAL) << "Unknown flat weights data type: " << data_type;
+  }
+  return 0;
+}
+
+bool IsFlatWeightsFile(const string& filename) {
+  std::ifstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kFlatWeightsMagic)];
+  return input.read(magic, sizeof(magic)) &&
+      memcmp(magic, kFlatWeightsMagic, sizeof(magic)) == 0;
+}
+
+void WriteFlatWeightsFile(const string& filename, FlatWeightsIndex* index,
+    const vector<const void*>& data) {
+  const size_t element_size = FlatWeightsElementSize(index->data_type());
+  // Lay out the data region, storing shared blobs once.
+  std::map<std::pair<const void*, uint64_t>, uint64_t> offsets;
+  vector<std::pair<const void*, uint64_t> > regions;
+  uint64_t data_size = 0;
+  int k = 0;
+  for (int i = 0; i < index->layer_size(); ++i) {
+    FlatLayerWeights* layer = index->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j, ++k) {
+      CHECK_LT(k, data.size()) << "Missing data for the flat weights index";
+      FlatBlob* blob = layer->mutable_blobs(j);
+      const std::pair<const void*, uint64_t> region(data[k],
+          FlatBlobCount(*blob) * element_size);
+      if (!offsets.count(region)) {
+        data_size = RoundUp(data_size, kFlatWeightsAlignment);
+        offsets[region] = data_size;
+        regions.push_back(region);
+        data_size += region.second;
+      }
+      blob->set_offset(offsets[region]);
+    }
+  }
+  CHECK_EQ(k, data.size()) << "More data than blobs in the flat weights index";
+  string index_string;
+  CHECK(index->SerializeToString(&index_string));
+  const uint64_t index_size = index_string.size();
+
+  // Write to a temporary file first: renaming it over filename leaves any
+  // mapping of a previous version intact.
+  const string temp_filename = filename + ".tmp";
+  std::ofstream output(temp_filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output) << "Cannot create " << temp_filename;
+  output.write(kFlatWeightsMagic, sizeof(kFlatWeightsMagic));
+  output.write(reinterpret_cast<const char*>(&index_size), sizeof(index_size));
+  output.write(index_string.data(), index_size);
+  const uint64_t header_size = kFlatWeightsHeaderSize + index_size;
+  WritePadding(&output, RoundUp(header_size, kFlatWeightsPageSize)
+      - header_size);
+  uint64_t position = 0;
+  for (int i = 0; i < regions.size(); ++i) {
+    const uint64_t offset = offsets[regions[i]];
+    WritePadding(&output, offset - position);
+    output.write(static_cast<const char*>(regions[i].first),
+        regions[i].second);
+    position = offset + regions[i].second;
+  }
+  output.close();
+  CHECK(output) << "Failed to write " << temp_filename;
+  CHECK_EQ(std::rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Cannot rename " << temp_filename << " to " << filename;
+}
+
+MappedFile::MappedFile(const string& filename)
+    : data_(NULL), size_(0) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Cannot stat " << filename;
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    void* ptr = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    CHECK(ptr != MAP_FAILED) << "Cannot map " << filename;
+    data_ = static_cast<char*>(ptr);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+char* ReadFlatWeightsIndex(const MappedFile& file, FlatWeightsIndex* index) {
+  CHECK(file.size() >= kFlatWeightsHeaderSize && memcmp(file.data(),
+      kFlatWeightsMagic, sizeof(kFlatWeightsMagic)) == 0)
+      << "Not a flat weights file";
+  const uint64_t index_size = *reinterpret_cast<const uint64_t*>(
+      file.data() + sizeof(kFlatWeightsMagic));
+  CHECK_LE(index_size, file.size() - kFlatWeightsHeaderSize)
+      << "Truncated flat weights file";
+  CHECK(index->ParseFromArray(file.data() + kFlatWeightsHeaderSize,
+      index_size)) << "Corrupted flat weights index";
+  const uint64_t data_start = RoundUp(kFlatWeightsHeaderSize + index_size,
+      kFlatWeightsPageSize);
+  const uint64_t data_size =
+      file.size() > data_start ? file.size() - data_start : 0;
+  const size_t element_size = FlatWeightsElementSize(index->data_type());
+  for (int i = 0; i < index->layer_size(); ++i) {
+    const FlatLayerWeights& layer = index->layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const FlatBlob& blob = layer.blobs(j);
+      CHECK_EQ(blob.offset() % kFlatWeightsAlignment, 0)
+          << "Misaligned blob " << j << " of layer " << layer.name();
+      CHECK_LE(blob.offset() + FlatBlobCount(blob) * element_size, data_size)
+          << "Truncated flat weights file";
+    }
+  }
+  return file.data() + data_start;
+}
+
+}  // namespace caffe
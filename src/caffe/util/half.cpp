@@ -0,0 +1,54 @@
+#include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_to_half(const StorageType type, const int n, const Dtype* x,
+    uint16_t* y) {
+  switch (type) {
+  case FLOAT16:
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_half(x[i]);
+    }
+    break;
+  case BFLOAT16:
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_bfloat16(x[i]);
+    }
+    break;
+  default:
+    LOG(FATAL) << "Not a 16-bit storage type: " << StorageType_Name(type);
+  }
+}
+
+template void caffe_cpu_to_half<float>(const StorageType type, const int n,
+    const float* x, uint16_t* y);
+template void caffe_cpu_to_half<double>(const StorageType type, const int n,
+    const double* x, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const StorageType type, const int n,
+    const uint16_t* x, Dtype* y) {
+  switch (type) {
+  case FLOAT16:
+    for (int i = 0; i < n; ++i) {
+      y[i] = half_to_float(x[i]);
+    }
+    break;
+  case BFLOAT16:
+    for (int i = 0; i < n; ++i) {
+      y[i] = bfloat16_to_float(x[i]);
+    }
+    break;
+  default:
+    LOG(FATAL) << "Not a 16-bit storage type: " << StorageType_Name(type);
+  }
+}
+
+template void caffe_cpu_from_half<float>(const StorageType type, const int n,
+    const uint16_t* x, float* y);
+template void caffe_cpu_from_half<double>(const StorageType type, const int n,
+    const uint16_t* x, double* y);
+
+}  // namespace caffe
@@ -1,9 +1,12 @@
 #ifdef USE_HDF5
 #include "caffe/util/hdf5.hpp"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#include "caffe/util/half.hpp"
+
 namespace caffe {
 
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
@@ -84,11 +87,66 @@ void hdf5_load_nd_dataset_helper(
   }
 }
 
+// Datasets saved in 16 bits (see ParamSpec.storage) are unsigned shorts with
+// the storage type in their "storage" attribute.
+static const char kStorageAttribute[] = "storage";
+
+// Widens a dataset saved in 16 bits into the blob; returns false for the
+// datasets of other types.
+template <typename Dtype>
+static bool hdf5_load_half_dataset(hid_t file_id, const char* dataset_name_,
+    Blob<Dtype>* blob) {
+  if (H5Aexists_by_name(file_id, dataset_name_, kStorageAttribute,
+      H5P_DEFAULT) <= 0) {
+    return false;
+  }
+  hsize_t dims;
+  H5T_class_t class_;
+  size_t size;
+  herr_t status = H5LTget_attribute_info(file_id, dataset_name_,
+      kStorageAttribute, &dims, &class_, &size);
+  CHECK_GE(status, 0) << "Failed to get the storage of " << dataset_name_;
+  vector<char> name(size + 1, 0);
+  status = H5LTget_attribute_string(file_id, dataset_name_,
+      kStorageAttribute, name.data());
+  CHECK_GE(status, 0) << "Failed to get the storage of " << dataset_name_;
+  StorageType storage;
+  CHECK(StorageType_Parse(name.data(), &storage))
+      << "Unknown storage " << name.data() << " of " << dataset_name_;
+  vector<uint16_t> half(std::max(blob->count(), 1));
+  status = H5LTread_dataset(file_id, dataset_name_, H5T_NATIVE_USHORT,
+      half.data());
+  CHECK_GE(status, 0) << "Failed to read 16-bit dataset " << dataset_name_;
+  caffe_cpu_from_half(storage, blob->count(), half.data(),
+      blob->mutable_cpu_data());
+  return true;
+}
+
+template <typename Dtype>
+static void hdf5_save_half_dataset(hid_t file_id, const string& dataset_name,
+    const Blob<Dtype>& blob, StorageType storage) {
+  vector<hsize_t> dims(std::max(blob.num_axes(), 1));
+  for (int i = 0; i < blob.num_axes(); ++i) {
+    dims[i] = blob.shape(i);
+  }
+  vector<uint16_t> half(std::max(blob.count(), 1));
+  caffe_cpu_to_half(storage, blob.count(), blob.cpu_data(), half.data());
+  herr_t status = H5LTmake_dataset(file_id, dataset_name.c_str(),
+      blob.num_axes(), dims.data(), H5T_NATIVE_USHORT, half.data());
+  CHECK_GE(status, 0) << "Failed to make 16-bit dataset " << dataset_name;
+  status = H5LTset_attribute_string(file_id, dataset_name.c_str(),
+      kStorageAttribute, StorageType_Name(storage).c_str());
+  CHECK_GE(status, 0) << "Failed to set the storage of " << dataset_name;
+}
+
 template <>
 void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<float>* blob, bool reshape) {
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
+  if (hdf5_load_half_dataset(file_id, dataset_name_, blob)) {
+    return;
+  }
   herr_t status = H5LTread_dataset_float(
     file_id, dataset_name_, blob->mutable_cpu_data());
   CHECK_GE(status, 0) << "Failed to read float dataset " << dataset_name_;
@@ -99,6 +157,9 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<double>* blob, bool reshape) {
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
+  if (hdf5_load_half_dataset(file_id, dataset_name_, blob)) {
+    return;
+  }
   herr_t status = H5LTread_dataset_double(
     file_id, dataset_name_, blob->mutable_cpu_data());
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
@@ -107,7 +168,11 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
-    bool write_diff) {
+    bool write_diff, StorageType storage) {
+  if (is_half_storage(storage) && !write_diff) {
+    hdf5_save_half_dataset(file_id, dataset_name, blob, storage);
+    return;
+  }
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -128,7 +193,11 @@ void hdf5_save_nd_dataset<float>(
 template <>
 void hdf5_save_nd_dataset<double>(
     hid_t file_id, const string& dataset_name, const Blob<double>& blob,
-    bool write_diff) {
+    bool write_diff, StorageType storage) {
+  if (is_half_storage(storage) && !write_diff) {
+    hdf5_save_half_dataset(file_id, dataset_name, blob, storage);
+    return;
+  }
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -0,0 +1,188 @@
+#include <boost/thread.hpp>
+#include <cstdlib>
+#include <limits>
+
+#ifdef USE_MKL
+  #include "mkl.h"
+#endif
+
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+
+const size_t HostAllocator::kAlignment;
+const size_t HostAllocator::kDefaultMaxCachedBytes;
+
+// Size classes start at 64 bytes and split every power of two above in four.
+static const int kMinSizeLog2 = 6;
+static const int kClassesPerOctave = 4;
+
+static void* SystemAlloc(size_t size) {
+  void* ptr = NULL;
+#ifdef USE_MKL
+  ptr = mkl_malloc(size, HostAllocator::kAlignment);
+#else
+  if (posix_memalign(&ptr, HostAllocator::kAlignment, size) != 0) {
+    ptr = NULL;
+  }
+#endif
+  return ptr;
+}
+
+static void SystemFree(void* ptr) {
+#ifdef USE_MKL
+  mkl_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+HostAllocator& HostAllocator::Get() {
+  // Never destroyed, as SyncedMemory may still be freed during static
+  // destruction.
+  static HostAllocator* allocator = new HostAllocator();
+  return *allocator;
+}
+
+HostAllocator::HostAllocator()
+    : hits_(0), misses_(0), cached_bytes_(0),
+      max_cached_bytes_(kDefaultMaxCachedBytes),
+      mutex_(new boost::mutex()) {
+}
+
+// The block size of the class index, the inverse of RoundSize.
+static size_t ClassSize(int index) {
+  if (index == 0) {
+    return size_t(1) << kMinSizeLog2;
+  }
+  const size_t base = size_t(1) << (kMinSizeLog2 +
+      (index - 1) / kClassesPerOctave);
+  return base + ((index - 1) % kClassesPerOctave + 1) *
+      (base / kClassesPerOctave);
+}
+
+size_t HostAllocator::RoundSize(size_t size, int* index) {
+  const size_t min_size = size_t(1) << kMinSizeLog2;
+  if (size <= min_size) {
+    if (index) { *index = 0; }
+    return min_size;
+  }
+  // Find the octave such that 2^octave < size <= 2^(octave + 1).
+  int octave = kMinSizeLog2;
+  while (octave < std::numeric_limits<size_t>::digits - 2 &&
+         (size_t(2) << octave) < size) {
+    ++octave;
+  }
+  const size_t base = size_t(1) << octave;
+  const size_t step = base / kClassesPerOctave;
+  const size_t sub_class = (size - base + step - 1) / step;
+  if (index) {
+    *index = (octave - kMinSizeLog2) * kClassesPerOctave + sub_class;
+  }
+  return base + sub_class * step;
+}
+
+void* HostAllocator::Allocate(size_t size) {
+  int index;
+  const size_t rounded = RoundSize(size, &index);
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    if (index < free_lists_.size() && !free_lists_[index].empty()) {
+      void* ptr = free_lists_[index].back();
+      free_lists_[index].pop_back();
+      cached_bytes_ -= rounded;
+      ++hits_;
+      return ptr;
+    }
+    ++misses_;
+  }
+  void* ptr = SystemAlloc(rounded);
+  if (!ptr) {
+    // The cache may hold enough memory of other classes to succeed.
+    Trim();
+    ptr = SystemAlloc(rounded);
+  }
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr, size_t size) {
+  if (!ptr) { return; }
+  int index;
+  const size_t rounded = RoundSize(size, &index);
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    if (cached_bytes_ <= max_cached_bytes_ &&
+        rounded <= max_cached_bytes_ - cached_bytes_) {
+      if (free_lists_.size() <= index) {
+        free_lists_.resize(index + 1);
+      }
+      free_lists_[index].push_back(ptr);
+      cached_bytes_ += rounded;
+      return;
+    }
+  }
+  SystemFree(ptr);
+}
+
+void HostAllocator::Trim() {
+  vector<vector<void*> > free_lists;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    free_lists.swap(free_lists_);
+    cached_bytes_ = 0;
+  }
+  for (int i = 0; i < free_lists.size(); ++i) {
+    for (int j = 0; j < free_lists[i].size(); ++j) {
+      SystemFree(free_lists[i][j]);
+    }
+  }
+}
+
+size_t HostAllocator::hits() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return hits_;
+}
+
+size_t HostAllocator::misses() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return misses_;
+}
+
+size_t HostAllocator::cached_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return cached_bytes_;
+}
+
+void HostAllocator::ResetCounters() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  hits_ = 0;
+  misses_ = 0;
+}
+
+void HostAllocator::set_max_cached_bytes(size_t max_cached_bytes) {
+  vector<void*> released;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    max_cached_bytes_ = max_cached_bytes;
+    // Take blocks off the cache, largest first, until it fits the limit.
+    for (int i = free_lists_.size() - 1;
+         i >= 0 && cached_bytes_ > max_cached_bytes_; --i) {
+      const size_t size = ClassSize(i);
+      while (!free_lists_[i].empty() && cached_bytes_ > max_cached_bytes_) {
+        released.push_back(free_lists_[i].back());
+        free_lists_[i].pop_back();
+        cached_bytes_ -= size;
+      }
+    }
+  }
+  for (int i = 0; i < released.size(); ++i) {
+    SystemFree(released[i]);
+  }
+}
+
+size_t HostAllocator::max_cached_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return max_cached_bytes_;
+}
+
+}  // namespace caffe
@@ -1,3 +1,9 @@
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_IM2COL_AVX2
+#endif
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
@@ -16,7 +22,7 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
 }
 
 template <typename Dtype>
-void im2col_cpu(const Dtype* data_im, const int channels,
+void im2col_generic_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
@@ -54,6 +60,180 @@ void im2col_cpu(const Dtype* data_im, const int channels,
   }
 }
 
+// The output columns [*begin, *end) of a row of output_w columns whose input
+// column offset + stride * output_col lies within [0, width).
+inline void valid_output_cols(int offset, int stride, int width,
+    int output_w, int* begin, int* end) {
+  *end = width > offset ? (width - offset + stride - 1) / stride : 0;
+  *end = std::min(*end, output_w);
+  *begin = offset < 0 ? (-offset + stride - 1) / stride : 0;
+  *begin = std::min(*begin, *end);
+}
+
+namespace {
+
+// Row kernels of the 2D fast paths: out[i] = in[2 * i] and
+// out[2 * i] += in[i] for i in [0, n), and out[i] += in[i] for stride 1.
+template <typename Dtype>
+void gather_stride2(const Dtype* in, int n, Dtype* out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = in[2 * i];
+  }
+}
+
+template <typename Dtype>
+void scatter_add_stride2(const Dtype* in, int n, Dtype* out) {
+  for (int i = 0; i < n; ++i) {
+    out[2 * i] += in[i];
+  }
+}
+
+template <typename Dtype>
+void add_stride1(const Dtype* in, int n, Dtype* out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] += in[i];
+  }
+}
+
+#ifdef CAFFE_IM2COL_AVX2
+// AVX2 versions for float, selected at run time. The vector loops stop one
+// element short of the end so they never touch out[2 * n - 1], which may lie
+// past the image.
+__attribute__((target("avx2")))
+void gather_stride2_avx2(const float* in, int n, float* out) {
+  int i = 0;
+  for (; i + 8 < n; i += 8) {
+    const __m256 lo = _mm256_loadu_ps(in + 2 * i);
+    const __m256 hi = _mm256_loadu_ps(in + 2 * i + 8);
+    // The even elements, in the order 0 2 8 10 4 6 12 14 of in + 2 * i.
+    const __m256 even = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    _mm256_storeu_ps(out + i, _mm256_castpd_ps(_mm256_permute4x64_pd(
+        _mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0))));
+  }
+  gather_stride2(in + 2 * i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void scatter_add_stride2_avx2(const float* in, int n, float* out) {
+  int i = 0;
+  const __m256 zero = _mm256_setzero_ps();
+  for (; i + 8 < n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(in + i);
+    const __m256 lo = _mm256_unpacklo_ps(x, zero);
+    const __m256 hi = _mm256_unpackhi_ps(x, zero);
+    // x0 0 x1 0 x2 0 x3 0 and x4 0 x5 0 x6 0 x7 0.
+    const __m256 first = _mm256_permute2f128_ps(lo, hi, 0x20);
+    const __m256 second = _mm256_permute2f128_ps(lo, hi, 0x31);
+    _mm256_storeu_ps(out + 2 * i,
+        _mm256_add_ps(_mm256_loadu_ps(out + 2 * i), first));
+    _mm256_storeu_ps(out + 2 * i + 8,
+        _mm256_add_ps(_mm256_loadu_ps(out + 2 * i + 8), second));
+  }
+  scatter_add_stride2(in + i, n - i, out + 2 * i);
+}
+
+__attribute__((target("avx2")))
+void add_stride1_avx2(const float* in, int n, float* out) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(out + i,
+        _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_loadu_ps(in + i)));
+  }
+  add_stride1(in + i, n - i, out + i);
+}
+#endif  // CAFFE_IM2COL_AVX2
+
+// The row kernels for Dtype, chosen once for the CPU at hand.
+template <typename Dtype>
+struct RowKernels {
+  typedef void (*Kernel)(const Dtype* in, int n, Dtype* out);
+  Kernel gather_stride2;
+  Kernel scatter_add_stride2;
+  Kernel add_stride1;
+
+  RowKernels()
+      : gather_stride2(&caffe::gather_stride2<Dtype>),
+        scatter_add_stride2(&caffe::scatter_add_stride2<Dtype>),
+        add_stride1(&caffe::add_stride1<Dtype>) {}
+
+  static const RowKernels& Get() {
+    static const RowKernels kernels;
+    return kernels;
+  }
+};
+
+#ifdef CAFFE_IM2COL_AVX2
+template <>
+RowKernels<float>::RowKernels()
+    : gather_stride2(&caffe::gather_stride2<float>),
+      scatter_add_stride2(&caffe::scatter_add_stride2<float>),
+      add_stride1(&caffe::add_stride1<float>) {
+  if (__builtin_cpu_supports("avx2")) {
+    gather_stride2 = &gather_stride2_avx2;
+    scatter_add_stride2 = &scatter_add_stride2_avx2;
+    add_stride1 = &add_stride1_avx2;
+  }
+}
+#endif  // CAFFE_IM2COL_AVX2
+
+}  // namespace
+
+// im2col for stride_w 1 or 2 without dilation: the columns of the padding are
+// known ahead of each row, which leaves a plain copy or gather in between.
+template <typename Dtype>
+static void im2col_fast_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_col) {
+  const RowKernels<Dtype>& kernels = RowKernels<Dtype>::Get();
+  const int output_h = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  const int channel_size = height * width;
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+        const int input_col = -pad_w + kernel_col;
+        int begin, end;
+        valid_output_cols(input_col, stride_w, width, output_w, &begin, &end);
+        int input_row = -pad_h + kernel_row;
+        for (int output_rows = output_h; output_rows; output_rows--) {
+          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+            std::fill(data_col, data_col + output_w, Dtype(0));
+          } else {
+            const Dtype* data_row =
+                data_im + input_row * width + input_col + begin * stride_w;
+            std::fill(data_col, data_col + begin, Dtype(0));
+            if (stride_w == 1) {
+              std::copy(data_row, data_row + end - begin, data_col + begin);
+            } else {
+              kernels.gather_stride2(data_row, end - begin, data_col + begin);
+            }
+            std::fill(data_col + end, data_col + output_w, Dtype(0));
+          }
+          data_col += output_w;
+          input_row += stride_h;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  if (dilation_h == 1 && dilation_w == 1 && (stride_w == 1 || stride_w == 2)) {
+    im2col_fast_cpu(data_im, channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, data_col);
+  } else {
+    im2col_generic_cpu(data_im, channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, data_col);
+  }
+}
+
 // Explicit instantiation
 template void im2col_cpu<float>(const float* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -65,6 +245,18 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_col);
+template void im2col_generic_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* data_col);
+template void im2col_generic_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* data_col);
 
 template <typename Dtype>
 inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
@@ -160,7 +352,7 @@ template void im2col_nd_cpu<double>(const double* data_im,
     const int* dilation, double* data_col);
 
 template <typename Dtype>
-void col2im_cpu(const Dtype* data_col, const int channels,
+void col2im_generic_cpu(const Dtype* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
@@ -196,6 +388,60 @@ void col2im_cpu(const Dtype* data_col, const int channels,
   }
 }
 
+// col2im for stride_w 1 or 2 without dilation, the counterpart of
+// im2col_fast_cpu.
+template <typename Dtype>
+static void col2im_fast_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_im) {
+  const RowKernels<Dtype>& kernels = RowKernels<Dtype>::Get();
+  std::fill(data_im, data_im + height * width * channels, Dtype(0));
+  const int output_h = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  const int channel_size = height * width;
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+        const int input_col = -pad_w + kernel_col;
+        int begin, end;
+        valid_output_cols(input_col, stride_w, width, output_w, &begin, &end);
+        int input_row = -pad_h + kernel_row;
+        for (int output_rows = output_h; output_rows; output_rows--) {
+          if (is_a_ge_zero_and_a_lt_b(input_row, height)) {
+            Dtype* data_row =
+                data_im + input_row * width + input_col + begin * stride_w;
+            if (stride_w == 1) {
+              kernels.add_stride1(data_col + begin, end - begin, data_row);
+            } else {
+              kernels.scatter_add_stride2(data_col + begin, end - begin,
+                  data_row);
+            }
+          }
+          data_col += output_w;
+          input_row += stride_h;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void col2im_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
+  if (dilation_h == 1 && dilation_w == 1 && (stride_w == 1 || stride_w == 2)) {
+    col2im_fast_cpu(data_col, channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, data_im);
+  } else {
+    col2im_generic_cpu(data_col, channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, data_im);
+  }
+}
+
 // Explicit instantiation
 template void col2im_cpu<float>(const float* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -207,6 +453,18 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_im);
+template void col2im_generic_cpu<float>(const float* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* data_im);
+template void col2im_generic_cpu<double>(const double* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* data_im);
 
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
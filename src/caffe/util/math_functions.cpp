@@ -1,9 +1,12 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
+#include <cfloat>
 #include <limits>
 
 #include "caffe/common.hpp"
+#include "caffe/util/fast_math.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
@@ -382,4 +385,36 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+template <typename Dtype>
+Dtype caffe_cpu_softmax(const int n, const Dtype* x, Dtype* y) {
+  // The max and the sum go by chunks, so that the exponentials of a chunk
+  // vectorize against its max.
+  const int kChunk = 64;
+  Dtype max_value = -FLT_MAX;
+  Dtype sum = 0;
+  for (int begin = 0; begin < n; begin += kChunk) {
+    const int end = std::min(begin + kChunk, n);
+    Dtype chunk_max = max_value;
+    for (int i = begin; i < end; ++i) {
+      chunk_max = std::max(chunk_max, x[i]);
+    }
+    sum *= fast_exp(max_value - chunk_max);
+    max_value = chunk_max;
+    for (int i = begin; i < end; ++i) {
+      sum += fast_exp(x[i] - max_value);
+    }
+  }
+  const Dtype inv_sum = Dtype(1) / sum;
+  for (int i = 0; i < n; ++i) {
+    y[i] = fast_exp(x[i] - max_value) * inv_sum;
+  }
+  return max_value + std::log(sum);
+}
+
+template
+float caffe_cpu_softmax<float>(const int n, const float* x, float* y);
+
+template
+double caffe_cpu_softmax<double>(const int n, const double* x, double* y);
+
 }  // namespace caffe
@@ -0,0 +1,160 @@
+#include <algorithm>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/packed_gemm.hpp"
+
+namespace caffe {
+
+// The built-in kernel: C(m, r) = sum_c A(m, c) W(r, c) for the M x cols A,
+// the M x rows C and the rows r of the panels [begin, end) of W.
+template <typename Dtype>
+static void packed_gemm_cpu(const int M, const int rows, const int cols,
+    const Dtype* A, const Dtype* panels, const int begin, const int end,
+    Dtype* C) {
+  const int kPanel = PackedWeights<Dtype>::kPanelRows;
+  for (int p = begin; p < end; ++p) {
+    const Dtype* panel = panels + p * kPanel * cols;
+    const int r0 = p * kPanel;
+    const int panel_rows = std::min(rows - r0, kPanel);
+    for (int m = 0; m < M; ++m) {
+      const Dtype* a = A + m * cols;
+      Dtype s[kPanel] = {0};
+      for (int c = 0; c < cols; ++c) {
+        const Dtype* w = panel + c * kPanel;
+        const Dtype x = a[c];
+        for (int i = 0; i < kPanel; ++i) {
+          s[i] += x * w[i];
+        }
+      }
+      for (int i = 0; i < panel_rows; ++i) {
+        C[m * rows + r0 + i] = s[i];
+      }
+    }
+  }
+}
+
+#ifdef USE_MKL
+// The float and double packed GEMMs of MKL under one name.
+inline size_t mkl_gemm_pack_get_size(const float*,
+    const CBLAS_IDENTIFIER identifier, const int m, const int n, const int k) {
+  return cblas_sgemm_pack_get_size(identifier, m, n, k);
+}
+inline size_t mkl_gemm_pack_get_size(const double*,
+    const CBLAS_IDENTIFIER identifier, const int m, const int n, const int k) {
+  return cblas_dgemm_pack_get_size(identifier, m, n, k);
+}
+inline void mkl_gemm_pack(const CBLAS_IDENTIFIER identifier,
+    const CBLAS_TRANSPOSE trans, const int m, const int n, const int k,
+    const float* src, const int ld, float* dest) {
+  cblas_sgemm_pack(CblasRowMajor, identifier, trans, m, n, k, 1.f, src, ld,
+      dest);
+}
+inline void mkl_gemm_pack(const CBLAS_IDENTIFIER identifier,
+    const CBLAS_TRANSPOSE trans, const int m, const int n, const int k,
+    const double* src, const int ld, double* dest) {
+  cblas_dgemm_pack(CblasRowMajor, identifier, trans, m, n, k, 1., src, ld,
+      dest);
+}
+inline void mkl_gemm_compute(const int transa, const int transb,
+    const int m, const int n, const int k, const float* a, const int lda,
+    const float* b, const int ldb, float* c, const int ldc) {
+  cblas_sgemm_compute(CblasRowMajor, transa, transb, m, n, k, a, lda, b, ldb,
+      0.f, c, ldc);
+}
+inline void mkl_gemm_compute(const int transa, const int transb,
+    const int m, const int n, const int k, const double* a, const int lda,
+    const double* b, const int ldb, double* c, const int ldc) {
+  cblas_dgemm_compute(CblasRowMajor, transa, transb, m, n, k, a, lda, b, ldb,
+      0., c, ldc);
+}
+#endif  // USE_MKL
+
+template <typename Dtype>
+bool PackedWeights<Dtype>::Suits(const int dim) {
+#ifdef USE_MKL
+  return true;
+#else
+  // From two inputs on, BLAS spends less time packing than multiplying and
+  // its kernels win.
+  return dim == 1;
+#endif
+}
+
+template <typename Dtype>
+void PackedWeights<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const bool transpose, const int dim) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+#ifdef USE_MKL
+  const bool same_dim = dim_ == dim;
+#else
+  const bool same_dim = true;
+#endif
+  if (source_ == source && version_ == source->version() && rows_ == rows &&
+      same_dim) {
+    return;
+  }
+  const int cols = weights.count() / rows;
+  CHECK_EQ(rows * cols, weights.count());
+  const Dtype* w = weights.cpu_data();
+#ifdef USE_MKL
+  const size_t size = mkl_gemm_pack_get_size(w, CblasBMatrix, dim, rows,
+      cols);
+  if (!packed_ || packed_->size() != size) {
+    packed_.reset(new SyncedMemory(size));
+  }
+  // C = A W^T is C = A B with W^T packed as B.
+  mkl_gemm_pack(CblasBMatrix, transpose ? CblasNoTrans : CblasTrans, dim,
+      rows, cols, w, transpose ? rows : cols,
+      static_cast<Dtype*>(packed_->mutable_cpu_data()));
+#else
+  // The element (r, c) is at r * row_stride + c * col_stride.
+  const int row_stride = transpose ? 1 : cols;
+  const int col_stride = transpose ? rows : 1;
+  const int panels = (rows + kPanelRows - 1) / kPanelRows;
+  const size_t size = sizeof(Dtype) * panels * kPanelRows * cols;
+  if (!packed_ || packed_->size() != size) {
+    packed_.reset(new SyncedMemory(size));
+  }
+  Dtype* packed = static_cast<Dtype*>(packed_->mutable_cpu_data());
+  for (int p = 0; p < panels; ++p) {
+    // The last panel is padded with rows of zeros.
+    for (int c = 0; c < cols; ++c) {
+      for (int i = 0; i < kPanelRows; ++i) {
+        const int r = p * kPanelRows + i;
+        *packed++ = r < rows ? w[r * row_stride + c * col_stride] : 0;
+      }
+    }
+  }
+#endif  // USE_MKL
+  source_ = source;
+  version_ = source->version();
+  rows_ = rows;
+  cols_ = cols;
+  dim_ = dim;
+}
+
+template <typename Dtype>
+int PackedWeights<Dtype>::blocks() const {
+#ifdef USE_MKL
+  return 1;
+#else
+  return (rows_ + kPanelRows - 1) / kPanelRows;
+#endif
+}
+
+template <typename Dtype>
+void PackedWeights<Dtype>::gemm_nt(const int M, const Dtype* A, Dtype* C,
+    const int begin, const int end) const {
+  const Dtype* packed = static_cast<const Dtype*>(packed_->cpu_data());
+#ifdef USE_MKL
+  DCHECK_EQ(M, dim_);
+  mkl_gemm_compute(CblasNoTrans, CblasPacked, M, rows_, cols_, A, cols_,
+      packed, rows_, C, rows_);
+#else
+  packed_gemm_cpu(M, rows_, cols_, A, packed, begin, end, C);
+#endif
+}
+
+INSTANTIATE_CLASS(PackedWeights);
+
+}  // namespace caffe
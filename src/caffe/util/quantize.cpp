@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype inverse_scale,
+    const Dtype* x, int8_t* y) {
+  for (int i = 0; i < n; ++i) {
+    Dtype v = x[i] * inverse_scale;
+    v = v < Dtype(-127) ? Dtype(-127) : (v > Dtype(127) ? Dtype(127) : v);
+    y[i] = static_cast<int8_t>(v + (v < 0 ? Dtype(-0.5) : Dtype(0.5)));
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int n, const float inverse_scale,
+    const float* x, int8_t* y);
+template void caffe_cpu_quantize<double>(const int n,
+    const double inverse_scale, const double* x, int8_t* y);
+
+namespace {
+
+// The rows of B that are multiplied against all rows of A at once, so that
+// they stay in cache.
+const int kGemmS8BlockN = 32;
+
+inline int32_t dot_s8(const int K, const int8_t* a, const int8_t* b) {
+  int32_t sum = 0;
+  for (int k = 0; k < K; ++k) {
+    sum += static_cast<int16_t>(a[k]) * static_cast<int16_t>(b[k]);
+  }
+  return sum;
+}
+
+}  // namespace
+
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const int lda, const int8_t* B, const int ldb,
+    int32_t* C, const int ldc) {
+  for (int j_block = 0; j_block < N; j_block += kGemmS8BlockN) {
+    const int j_end = std::min(N, j_block + kGemmS8BlockN);
+    for (int i = 0; i < M; ++i) {
+      const int8_t* a = A + i * lda;
+      int32_t* c = C + i * ldc;
+      int j = j_block;
+      // Four rows of B per pass over the row of A.
+      for (; j + 4 <= j_end; j += 4) {
+        const int8_t* b0 = B + j * ldb;
+        const int8_t* b1 = b0 + ldb;
+        const int8_t* b2 = b1 + ldb;
+        const int8_t* b3 = b2 + ldb;
+        int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (int k = 0; k < K; ++k) {
+          const int16_t x = a[k];
+          s0 += x * static_cast<int16_t>(b0[k]);
+          s1 += x * static_cast<int16_t>(b1[k]);
+          s2 += x * static_cast<int16_t>(b2[k]);
+          s3 += x * static_cast<int16_t>(b3[k]);
+        }
+        c[j] = s0;
+        c[j + 1] = s1;
+        c[j + 2] = s2;
+        c[j + 3] = s3;
+      }
+      for (; j < j_end; ++j) {
+        c[j] = dot_s8(K, a, B + j * ldb);
+      }
+    }
+  }
+}
+
+void im2row_s8(const int8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, int8_t* data_row) {
+  for (int oh = 0; oh < output_h; ++oh) {
+    for (int ow = 0; ow < output_w; ++ow) {
+      const int iw_begin = ow * stride_w - pad_w;
+      const int iw_last = iw_begin + (kernel_w - 1) * dilation_w;
+      const bool row_inside = iw_begin >= 0 && iw_last < width;
+      for (int c = 0; c < channels; ++c) {
+        const int8_t* plane = data_im + c * height * width;
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          const int ih = oh * stride_h - pad_h + kh * dilation_h;
+          if (ih < 0 || ih >= height) {
+            std::fill(data_row, data_row + kernel_w, 0);
+            data_row += kernel_w;
+            continue;
+          }
+          const int8_t* in_row = plane + ih * width;
+          if (row_inside) {
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              *data_row++ = in_row[iw_begin + kw * dilation_w];
+            }
+          } else {
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              const int iw = iw_begin + kw * dilation_w;
+              *data_row++ = iw >= 0 && iw < width ? in_row[iw] : 0;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void QuantizedWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const int rows, const bool transpose) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source_ == source && version_ == source->version()) {
+    return;
+  }
+  const int count = weights.count();
+  const int cols = count / rows;
+  CHECK_EQ(rows * cols, count);
+  const Dtype* w = weights.cpu_data();
+  vector<int> scales_shape(1, rows);
+  scales_.Reshape(scales_shape);
+  Dtype* scales = scales_.mutable_cpu_data();
+  int8_t* data = static_cast<int8_t*>(int8_buffer(&data_, count));
+  // The element (r, c) is at r * row_stride + c * col_stride.
+  const int row_stride = transpose ? 1 : cols;
+  const int col_stride = transpose ? rows : 1;
+  for (int r = 0; r < rows; ++r) {
+    const Dtype* row = w + r * row_stride;
+    Dtype max_abs = 0;
+    for (int c = 0; c < cols; ++c) {
+      max_abs = std::max(max_abs, std::fabs(row[c * col_stride]));
+    }
+    scales[r] = max_abs / 127;
+    const Dtype inverse_scale = max_abs > 0 ? 127 / max_abs : Dtype(0);
+    for (int c = 0; c < cols; ++c) {
+      caffe_cpu_quantize(1, inverse_scale, row + c * col_stride,
+          data + r * cols + c);
+    }
+  }
+  source_ = source;
+  version_ = source->version();
+}
+
+INSTANTIATE_CLASS(QuantizedWeights);
+
+}  // namespace caffe
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/sparse.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_csr_gemm(const int M, const int N, const int* row_offsets,
+    const int* columns, const Dtype* values, const Dtype* B, Dtype* C) {
+  for (int i = 0; i < M; ++i) {
+    Dtype* c = C + i * N;
+    for (int j = 0; j < N; ++j) {
+      c[j] = 0;
+    }
+    for (int k = row_offsets[i]; k < row_offsets[i + 1]; ++k) {
+      const Dtype a = values[k];
+      const Dtype* b = B + columns[k] * N;
+      for (int j = 0; j < N; ++j) {
+        c[j] += a * b[j];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_csr_gemm<float>(const int M, const int N,
+    const int* row_offsets, const int* columns, const float* values,
+    const float* B, float* C);
+template void caffe_cpu_csr_gemm<double>(const int M, const int N,
+    const int* row_offsets, const int* columns, const double* values,
+    const double* B, double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemm_csr_t(const int M, const int N, const int K,
+    const Dtype* A, const int* row_offsets, const int* columns,
+    const Dtype* values, Dtype* C, const int ldc) {
+  for (int j = 0; j < N; ++j) {
+    const int begin = row_offsets[j];
+    const int end = row_offsets[j + 1];
+    int i = 0;
+    for (; i + 4 <= M; i += 4) {
+      const Dtype* a0 = A + i * K;
+      const Dtype* a1 = a0 + K;
+      const Dtype* a2 = a1 + K;
+      const Dtype* a3 = a2 + K;
+      Dtype s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+      for (int k = begin; k < end; ++k) {
+        const int column = columns[k];
+        const Dtype b = values[k];
+        s0 += a0[column] * b;
+        s1 += a1[column] * b;
+        s2 += a2[column] * b;
+        s3 += a3[column] * b;
+      }
+      C[i * ldc + j] = s0;
+      C[(i + 1) * ldc + j] = s1;
+      C[(i + 2) * ldc + j] = s2;
+      C[(i + 3) * ldc + j] = s3;
+    }
+    for (; i < M; ++i) {
+      const Dtype* a = A + i * K;
+      Dtype sum = 0;
+      for (int k = begin; k < end; ++k) {
+        sum += a[columns[k]] * values[k];
+      }
+      C[i * ldc + j] = sum;
+    }
+  }
+}
+
+template void caffe_cpu_gemm_csr_t<float>(const int M, const int N,
+    const int K, const float* A, const int* row_offsets, const int* columns,
+    const float* values, float* C, const int ldc);
+template void caffe_cpu_gemm_csr_t<double>(const int M, const int N,
+    const int K, const double* A, const int* row_offsets, const int* columns,
+    const double* values, double* C, const int ldc);
+
+template <typename Dtype>
+bool SparseWeights<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const bool transpose, const float max_density) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source_ == source && version_ == source->version()) {
+    return compressed_;
+  }
+  const int count = weights.count();
+  const int cols = count / rows;
+  CHECK_EQ(rows * cols, count);
+  const Dtype* w = weights.cpu_data();
+  int nonzeros = 0;
+  for (int i = 0; i < count; ++i) {
+    nonzeros += w[i] != 0;
+  }
+  density_ = count > 0 ? static_cast<float>(nonzeros) / count : 1;
+  compressed_ = density_ <= max_density;
+  source_ = source;
+  version_ = source->version();
+  if (!compressed_) {
+    return false;
+  }
+  row_offsets_.Reshape(vector<int>(1, rows + 1));
+  // At least one entry, since empty blobs have no memory.
+  columns_.Reshape(vector<int>(1, std::max(1, nonzeros)));
+  values_.Reshape(vector<int>(1, std::max(1, nonzeros)));
+  int* row_offsets = row_offsets_.mutable_cpu_data();
+  int* columns = columns_.mutable_cpu_data();
+  Dtype* values = values_.mutable_cpu_data();
+  // The element (r, c) is at r * row_stride + c * col_stride.
+  const int row_stride = transpose ? 1 : cols;
+  const int col_stride = transpose ? rows : 1;
+  int k = 0;
+  for (int r = 0; r < rows; ++r) {
+    row_offsets[r] = k;
+    for (int c = 0; c < cols; ++c) {
+      const Dtype value = w[r * row_stride + c * col_stride];
+      if (value != 0) {
+        columns[k] = c;
+        values[k++] = value;
+      }
+    }
+  }
+  row_offsets[rows] = k;
+  return true;
+}
+
+INSTANTIATE_CLASS(SparseWeights);
+
+}  // namespace caffe
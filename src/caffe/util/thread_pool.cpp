@@ -0,0 +1,122 @@
+#include <boost/thread.hpp>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::Sync {
+ public:
+  Sync() : num_workers_(0) {}
+  // Serializes the calls of Run that dispatch to the workers, and
+  // set_num_threads.
+  boost::mutex run_mutex_;
+  // Guards the state of the current call of Run, and num_workers_.
+  boost::mutex mutex_;
+  // The size of workers_, for the calls of Run that do not take run_mutex_.
+  int num_workers_;
+  boost::condition_variable task_ready_;
+  boost::condition_variable task_done_;
+};
+
+ThreadPool& ThreadPool::Get() {
+  static ThreadPool pool;
+  return pool;
+}
+
+ThreadPool::ThreadPool()
+    : sync_(new Sync()), task_(NULL), num_tasks_(0), next_task_(0),
+      pending_tasks_(0), generation_(0), stop_(false) {}
+
+ThreadPool::~ThreadPool() {
+  set_num_threads(1);
+}
+
+void ThreadPool::set_num_threads(int num_threads) {
+  CHECK_GE(num_threads, 1);
+  boost::mutex::scoped_lock run_lock(sync_->run_mutex_);
+  if (num_threads == this->num_threads()) {
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->task_ready_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+  workers_.clear();
+  stop_ = false;
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &ThreadPool::WorkerEntry, this, generation_)));
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->num_workers_ = workers_.size();
+}
+
+bool ThreadPool::RunsInline(int num_tasks) const {
+  if (num_tasks <= 1) {
+    return true;
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return sync_->num_workers_ == 0;
+}
+
+void ThreadPool::Run(int num_tasks, const boost::function<void(int)>& task) {
+  // Without workers to share, the tasks run on the calling thread, and
+  // concurrently with those of other calls.
+  if (RunsInline(num_tasks)) {
+    for (int i = 0; i < num_tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+  boost::mutex::scoped_lock run_lock(sync_->run_mutex_);
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_ = 0;
+    pending_tasks_ = num_tasks;
+    ++generation_;
+  }
+  sync_->task_ready_.notify_all();
+  RunTasks();
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (pending_tasks_ > 0) {
+    sync_->task_done_.wait(lock);
+  }
+  task_ = NULL;
+}
+
+void ThreadPool::WorkerEntry(size_t generation) {
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!stop_ && generation_ == generation) {
+        sync_->task_ready_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      generation = generation_;
+    }
+    RunTasks();
+  }
+}
+
+void ThreadPool::RunTasks() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (next_task_ < num_tasks_) {
+    const int task = next_task_++;
+    lock.unlock();
+    (*task_)(task);
+    lock.lock();
+    if (--pending_tasks_ == 0) {
+      sync_->task_done_.notify_all();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,112 @@
+// This program calibrates the int8 inference of the Convolution and
+// InnerProduct layers of a net: it runs TEST-phase batches, as `caffe test`
+// does, records the largest magnitude of the input of each of these layers,
+// and writes the model definition with quantization_param.input_scale set
+// to max |x| / 127 for each of them.
+// Usage:
+//    calibrate_int8 --model=net.prototxt --weights=net.caffemodel
+//        --output=net_int8.prototxt [--iterations=50]
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights.");
+DEFINE_string(output, "",
+    "The model definition to write, with the calibrated scales.");
+DEFINE_int32(iterations, 50,
+    "The number of batches to calibrate on.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads of the CPU layers that split their "
+    "work, such as Convolution.");
+
+static bool IsQuantizable(const LayerParameter& param) {
+  return param.type() == "Convolution" || param.type() == "InnerProduct";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Calibrate the int8 input scales of the "
+      "Convolution and InnerProduct layers of a net\n"
+      "Usage:\n"
+      "    calibrate_int8 --model=net.prototxt --weights=net.caffemodel "
+      "--output=net_int8.prototxt [--iterations=50]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to calibrate.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to calibrate.";
+  CHECK_GT(FLAGS_output.size(), 0) << "Need an output model definition.";
+
+  Caffe::set_mode(Caffe::CPU);
+  ThreadPool::Get().set_num_threads(FLAGS_cpu_threads);
+  NetParameter model;
+  ReadNetParamsFromTextFileOrDie(FLAGS_model, &model);
+  // Calibrate in floating point, even if the model was calibrated before.
+  NetParameter net_param(model);
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    net_param.mutable_layer(i)->clear_quantization_param();
+  }
+  net_param.mutable_state()->set_phase(TEST);
+  Net<float> net(net_param);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  // Run the layers one by one, to see each input before any in-place layer
+  // after it changes it.
+  const vector<shared_ptr<Layer<float> > >& layers = net.layers();
+  vector<float> max_abs(layers.size(), 0);
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < layers.size(); ++i) {
+      if (IsQuantizable(layers[i]->layer_param())) {
+        const Blob<float>* input = net.bottom_vecs()[i][0];
+        const float* data = input->cpu_data();
+        for (int j = 0; j < input->count(); ++j) {
+          max_abs[i] = std::max(max_abs[i], std::fabs(data[j]));
+        }
+      }
+      net.ForwardFromTo(i, i);
+    }
+    LOG_EVERY_N(INFO, 10) << "Batch " << iter + 1 << " of "
+        << FLAGS_iterations;
+  }
+
+  std::map<string, float> scales;
+  for (int i = 0; i < layers.size(); ++i) {
+    if (IsQuantizable(layers[i]->layer_param()) && max_abs[i] > 0) {
+      scales[net.layer_names()[i]] = max_abs[i] / 127;
+    }
+  }
+  for (int i = 0; i < model.layer_size(); ++i) {
+    LayerParameter* layer = model.mutable_layer(i);
+    if (scales.count(layer->name())) {
+      layer->mutable_quantization_param()->set_input_scale(
+          scales[layer->name()]);
+      LOG(INFO) << layer->name() << ": input scale "
+          << scales[layer->name()];
+    }
+  }
+  WriteProtoToTextFile(model, FLAGS_output);
+  LOG(INFO) << "Wrote the model with " << scales.size()
+      << " calibrated layers to " << FLAGS_output;
+  return 0;
+}
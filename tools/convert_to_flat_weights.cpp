@@ -0,0 +1,75 @@
+// This program converts trained weights to the flat weights format, which
+// Net::CopyTrainedLayersFrom maps into memory instead of parsing.
+// Usage:
+//    convert_to_flat_weights weights_in.caffemodel weights_out.caffemodel.flat
+
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: "
+        << "convert_to_flat_weights weights_in.caffemodel weights_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+  FlatWeightsIndex index;
+  index.set_data_type(FlatWeightsIndex_DataType_FLOAT);
+  vector<const void*> data;
+  // Blobs stored as doubles, in 16 bits or in sparse rows are read back into
+  // dense floats, those of the index.
+  vector<shared_ptr<vector<float> > > converted;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& layer_param = net_param.layer(i);
+    if (layer_param.blobs_size() == 0) {
+      continue;
+    }
+    FlatLayerWeights* layer = index.add_layer();
+    layer->set_name(layer_param.name());
+    for (int j = 0; j < layer_param.blobs_size(); ++j) {
+      const BlobProto& blob_proto = layer_param.blobs(j);
+      BlobShape* shape = layer->add_blobs()->mutable_shape();
+      if (blob_proto.has_shape()) {
+        shape->CopyFrom(blob_proto.shape());
+      } else {
+        shape->add_dim(blob_proto.num());
+        shape->add_dim(blob_proto.channels());
+        shape->add_dim(blob_proto.height());
+        shape->add_dim(blob_proto.width());
+      }
+      int count = 1;
+      for (int k = 0; k < shape->dim_size(); ++k) {
+        count *= shape->dim(k);
+      }
+      if (blob_proto.has_half_data_type() ||
+          blob_proto.csr_row_offsets_size() > 0 ||
+          blob_proto.double_data_size() > 0) {
+        Blob<float> blob;
+        blob.FromProto(blob_proto);
+        CHECK_EQ(count, blob.count());
+        converted.push_back(shared_ptr<vector<float> >(new vector<float>(
+            blob.cpu_data(), blob.cpu_data() + blob.count())));
+        data.push_back(converted.back()->data());
+      } else {
+        CHECK_EQ(count, blob_proto.data_size());
+        data.push_back(blob_proto.data().data());
+      }
+    }
+  }
+  WriteFlatWeightsFile(argv[2], &index, data);
+
+  LOG(INFO) << "Wrote flat weights of " << index.layer_size() << " layers to "
+      << argv[2];
+  return 0;
+}
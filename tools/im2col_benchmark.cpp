@@ -0,0 +1,103 @@
+// This program times im2col_cpu and col2im_cpu against the generic kernels
+// for common convolution shapes.
+// Usage:
+//    im2col_benchmark [-iterations 20]
+
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 20, "The number of runs of each kernel per shape.");
+
+struct Shape {
+  int channels, height, width, kernel, pad, stride;
+};
+
+static const Shape kShapes[] = {
+  { 64, 112, 112, 3, 1, 1 },
+  { 64, 56, 56, 3, 1, 1 },
+  { 128, 28, 28, 3, 1, 1 },
+  { 256, 14, 14, 3, 1, 1 },
+  { 512, 7, 7, 3, 1, 1 },
+  { 32, 28, 28, 5, 2, 1 },
+  { 32, 224, 224, 3, 1, 2 },
+  { 64, 112, 112, 3, 1, 2 },
+  { 128, 56, 56, 3, 1, 2 },
+  { 64, 56, 56, 7, 3, 2 },
+};
+
+typedef void (*Kernel)(const float* input, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* output);
+
+// Returns the average milliseconds of kernel on shape.
+static double Time(Kernel kernel, const Shape& shape, const float* input,
+    float* output) {
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    kernel(input, shape.channels, shape.height, shape.width, shape.kernel,
+        shape.kernel, shape.pad, shape.pad, shape.stride, shape.stride, 1, 1,
+        output);
+  }
+  timer.Stop();
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Times the im2col and col2im CPU kernels\n"
+        "Usage:\n"
+        "    im2col_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_iterations, 0);
+
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  LOG(INFO) << "shape (C x H x W, kernel, pad, stride): "
+      << "im2col generic / fast ms, col2im generic / fast ms";
+  for (int i = 0; i < sizeof(kShapes) / sizeof(kShapes[0]); ++i) {
+    const Shape& shape = kShapes[i];
+    const int output_h =
+        (shape.height + 2 * shape.pad - shape.kernel) / shape.stride + 1;
+    const int output_w =
+        (shape.width + 2 * shape.pad - shape.kernel) / shape.stride + 1;
+    Blob<float> im(1, shape.channels, shape.height, shape.width);
+    Blob<float> col(1, shape.channels * shape.kernel * shape.kernel,
+        output_h, output_w);
+    filler.Fill(&im);
+    filler.Fill(&col);
+    const double im2col_generic = Time(&im2col_generic_cpu<float>, shape,
+        im.cpu_data(), col.mutable_cpu_data());
+    const double im2col_fast = Time(&im2col_cpu<float>, shape,
+        im.cpu_data(), col.mutable_cpu_data());
+    const double col2im_generic = Time(&col2im_generic_cpu<float>, shape,
+        col.cpu_data(), im.mutable_cpu_data());
+    const double col2im_fast = Time(&col2im_cpu<float>, shape,
+        col.cpu_data(), im.mutable_cpu_data());
+    LOG(INFO) << shape.channels << "x" << shape.height << "x" << shape.width
+        << ", " << shape.kernel << ", " << shape.pad << ", " << shape.stride
+        << ": im2col " << im2col_generic << " / " << im2col_fast << " ("
+        << im2col_generic / im2col_fast << "x), col2im " << col2im_generic
+        << " / " << col2im_fast << " (" << col2im_generic / col2im_fast
+        << "x)";
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// This program prunes the weights of the Convolution and InnerProduct layers
+// of a trained net by magnitude: the weights below --threshold in magnitude
+// become zero, and the weights are written in compressed sparse rows (see
+// ParamSpec.storage), which the layers multiply as sparse matrices at test
+// time once dense enough (see max_sparse_density).
+// Usage:
+//    sparsify_weights --model=net.prototxt --weights=net.caffemodel
+//        --output=net_sparse.caffemodel [--threshold=0.001]
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights.");
+DEFINE_string(output, "",
+    "The weights to write, pruned and in compressed sparse rows.");
+DEFINE_double(threshold, 0,
+    "The magnitude below which weights are pruned.");
+
+static bool IsPrunable(const LayerParameter& param) {
+  return param.type() == "Convolution" || param.type() == "InnerProduct";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Prune the Convolution and InnerProduct weights "
+      "of a net by magnitude, and store them in compressed sparse rows\n"
+      "Usage:\n"
+      "    sparsify_weights --model=net.prototxt --weights=net.caffemodel "
+      "--output=net_sparse.caffemodel [--threshold=0.001]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to prune.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to prune.";
+  CHECK_GT(FLAGS_output.size(), 0) << "Need an output weights file.";
+  CHECK_GE(FLAGS_threshold, 0) << "The threshold is a magnitude.";
+
+  Caffe::set_mode(Caffe::CPU);
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  net_param.mutable_state()->set_phase(TEST);
+  // Store the weights of the pruned layers as CSR.
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    if (IsPrunable(*layer)) {
+      if (layer->param_size() == 0) {
+        layer->add_param();
+      }
+      layer->mutable_param(0)->set_storage(CSR);
+    }
+  }
+  Net<float> net(net_param);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  const vector<shared_ptr<Layer<float> > >& layers = net.layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    if (!IsPrunable(layers[i]->layer_param())) {
+      continue;
+    }
+    Blob<float>* weights = layers[i]->blobs()[0].get();
+    float* data = weights->mutable_cpu_data();
+    int nonzeros = 0;
+    for (int j = 0; j < weights->count(); ++j) {
+      if (std::fabs(data[j]) < FLAGS_threshold) {
+        data[j] = 0;
+      }
+      nonzeros += data[j] != 0;
+    }
+    LOG(INFO) << net.layer_names()[i] << ": " << nonzeros << " of "
+        << weights->count() << " weights kept (density "
+        << static_cast<float>(nonzeros) / weights->count() << ")";
+  }
+
+  NetParameter output;
+  net.ToProto(&output, false);
+  WriteProtoToBinaryFile(output, FLAGS_output);
+  LOG(INFO) << "Wrote the pruned weights to " << FLAGS_output;
+  return 0;
+}